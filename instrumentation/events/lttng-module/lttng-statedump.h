@@ -29,6 +29,30 @@ LTTNG_TRACEPOINT_EVENT(lttng_statedump_end,
 	TP_FIELDS()
 )
 
+/* Time spent by one shard on each per-task phase, in ns. */
+LTTNG_TRACEPOINT_EVENT(lttng_statedump_shard,
+	TP_PROTO(struct lttng_session *session,
+		unsigned int shard, unsigned int nr_shards,
+		u64 process_ns, u64 fd_ns, u64 vm_map_ns),
+	TP_ARGS(session, shard, nr_shards, process_ns, fd_ns, vm_map_ns),
+	TP_FIELDS(
+		ctf_integer(unsigned int, shard, shard)
+		ctf_integer(unsigned int, nr_shards, nr_shards)
+		ctf_integer(uint64_t, process_ns, process_ns)
+		ctf_integer(uint64_t, fd_ns, fd_ns)
+		ctf_integer(uint64_t, vm_map_ns, vm_map_ns)
+	)
+)
+
+/* Time spent on interrupts, network interfaces and block devices, in ns. */
+LTTNG_TRACEPOINT_EVENT(lttng_statedump_system,
+	TP_PROTO(struct lttng_session *session, u64 duration_ns),
+	TP_ARGS(session, duration_ns),
+	TP_FIELDS(
+		ctf_integer(uint64_t, duration_ns, duration_ns)
+	)
+)
+
 LTTNG_TRACEPOINT_EVENT(lttng_statedump_process_state,
 	TP_PROTO(struct lttng_session *session,
 		struct task_struct *p,
@@ -58,6 +58,10 @@ extern struct page **
 lib_ring_buffer_read_get_page(struct lib_ring_buffer_backend *bufb, size_t offset,
 			      void ***virt);
 
+extern struct page *
+lib_ring_buffer_read_replace_page(struct lib_ring_buffer_backend *bufb,
+				  size_t offset, struct page *new_page);
+
 /*
  * Return the address where a given offset is located.
  * Should be used to get the current subbuffer header pointer. Given we know
@@ -81,7 +85,8 @@ lib_ring_buffer_read_offset_address(struct lib_ring_buffer_backend *bufb,
  * This function copies "len" bytes of data from a source pointer to a buffer
  * backend, at the current context offset. This is more or less a buffer
  * backend-specific memcpy() operation. Calls the slow path (_ring_buffer_write)
- * if copy is crossing a page boundary.
+ * if copy is crossing a page boundary of a sub-buffer which has no contiguous
+ * mapping.
  */
 static inline
 void lib_ring_buffer_write(const struct lib_ring_buffer_config *config,
@@ -94,6 +99,7 @@ void lib_ring_buffer_write(const struct lib_ring_buffer_config *config,
 	size_t offset = ctx->buf_offset;
 	struct lib_ring_buffer_backend_pages *rpages;
 	unsigned long sb_bindex, id;
+	void *virt;
 
 	if (unlikely(!len))
 		return;
@@ -107,7 +113,12 @@ void lib_ring_buffer_write(const struct lib_ring_buffer_config *config,
 	CHAN_WARN_ON(ctx->chan,
 		     config->mode == RING_BUFFER_OVERWRITE
 		     && subbuffer_id_is_noref(config, id));
-	if (likely(pagecpy == len))
+	virt = subbuffer_get_contig_virt(config, rpages);
+	if (virt)
+		lib_ring_buffer_do_copy(config,
+					virt + (offset & (chanb->subbuf_size - 1)),
+					src, len);
+	else if (likely(pagecpy == len))
 		lib_ring_buffer_do_copy(config,
 					rpages->p[index].virt
 					    + (offset & ~PAGE_MASK),
@@ -141,6 +152,7 @@ void lib_ring_buffer_memset(const struct lib_ring_buffer_config *config,
 	size_t offset = ctx->buf_offset;
 	struct lib_ring_buffer_backend_pages *rpages;
 	unsigned long sb_bindex, id;
+	void *virt;
 
 	if (unlikely(!len))
 		return;
@@ -154,7 +166,12 @@ void lib_ring_buffer_memset(const struct lib_ring_buffer_config *config,
 	CHAN_WARN_ON(ctx->chan,
 		     config->mode == RING_BUFFER_OVERWRITE
 		     && subbuffer_id_is_noref(config, id));
-	if (likely(pagecpy == len))
+	virt = subbuffer_get_contig_virt(config, rpages);
+	if (virt)
+		lib_ring_buffer_do_memset(virt
+					  + (offset & (chanb->subbuf_size - 1)),
+					  c, len);
+	else if (likely(pagecpy == len))
 		lib_ring_buffer_do_memset(rpages->p[index].virt
 					  + (offset & ~PAGE_MASK),
 					  c, len);
@@ -244,6 +261,7 @@ void lib_ring_buffer_strcpy(const struct lib_ring_buffer_config *config,
 	size_t offset = ctx->buf_offset;
 	struct lib_ring_buffer_backend_pages *rpages;
 	unsigned long sb_bindex, id;
+	void *virt;
 
 	if (unlikely(!len))
 		return;
@@ -257,27 +275,22 @@ void lib_ring_buffer_strcpy(const struct lib_ring_buffer_config *config,
 	CHAN_WARN_ON(ctx->chan,
 		     config->mode == RING_BUFFER_OVERWRITE
 		     && subbuffer_id_is_noref(config, id));
-	if (likely(pagecpy == len)) {
+	virt = subbuffer_get_contig_virt(config, rpages);
+	if (virt || likely(pagecpy == len)) {
+		char *dest;
 		size_t count;
 
-		count = lib_ring_buffer_do_strcpy(config,
-					rpages->p[index].virt
-					    + (offset & ~PAGE_MASK),
-					src, len - 1);
-		offset += count;
+		if (virt)
+			dest = virt + (offset & (chanb->subbuf_size - 1));
+		else
+			dest = rpages->p[index].virt + (offset & ~PAGE_MASK);
+		count = lib_ring_buffer_do_strcpy(config, dest, src, len - 1);
 		/* Padding */
-		if (unlikely(count < len - 1)) {
-			size_t pad_len = len - 1 - count;
-
-			lib_ring_buffer_do_memset(rpages->p[index].virt
-						+ (offset & ~PAGE_MASK),
-					pad, pad_len);
-			offset += pad_len;
-		}
+		if (unlikely(count < len - 1))
+			lib_ring_buffer_do_memset(dest + count, pad,
+						  len - 1 - count);
 		/* Ending '\0' */
-		lib_ring_buffer_do_memset(rpages->p[index].virt
-					+ (offset & ~PAGE_MASK),
-				'\0', 1);
+		lib_ring_buffer_do_memset(dest + len - 1, '\0', 1);
 	} else {
 		_lib_ring_buffer_strcpy(bufb, offset, src, len, 0, pad);
 	}
@@ -308,6 +321,7 @@ void lib_ring_buffer_copy_from_user_inatomic(const struct lib_ring_buffer_config
 	size_t offset = ctx->buf_offset;
 	struct lib_ring_buffer_backend_pages *rpages;
 	unsigned long sb_bindex, id;
+	void *virt;
 	unsigned long ret;
 	mm_segment_t old_fs = get_fs();
 
@@ -329,7 +343,17 @@ void lib_ring_buffer_copy_from_user_inatomic(const struct lib_ring_buffer_config
 	if (unlikely(!access_ok(VERIFY_READ, src, len)))
 		goto fill_buffer;
 
-	if (likely(pagecpy == len)) {
+	virt = subbuffer_get_contig_virt(config, rpages);
+	if (virt) {
+		ret = lib_ring_buffer_do_copy_from_user_inatomic(
+			virt + (offset & (chanb->subbuf_size - 1)),
+			src, len);
+		if (unlikely(ret > 0)) {
+			offset += (len - ret);
+			len = ret;
+			goto fill_buffer;
+		}
+	} else if (likely(pagecpy == len)) {
 		ret = lib_ring_buffer_do_copy_from_user_inatomic(
 			rpages->p[index].virt + (offset & ~PAGE_MASK),
 			src, len);
@@ -386,6 +410,7 @@ void lib_ring_buffer_strcpy_from_user_inatomic(const struct lib_ring_buffer_conf
 	size_t offset = ctx->buf_offset;
 	struct lib_ring_buffer_backend_pages *rpages;
 	unsigned long sb_bindex, id;
+	void *virt;
 	mm_segment_t old_fs = get_fs();
 
 	if (unlikely(!len))
@@ -406,27 +431,23 @@ void lib_ring_buffer_strcpy_from_user_inatomic(const struct lib_ring_buffer_conf
 	if (unlikely(!access_ok(VERIFY_READ, src, len)))
 		goto fill_buffer;
 
-	if (likely(pagecpy == len)) {
+	virt = subbuffer_get_contig_virt(config, rpages);
+	if (virt || likely(pagecpy == len)) {
+		char *dest;
 		size_t count;
 
+		if (virt)
+			dest = virt + (offset & (chanb->subbuf_size - 1));
+		else
+			dest = rpages->p[index].virt + (offset & ~PAGE_MASK);
 		count = lib_ring_buffer_do_strcpy_from_user_inatomic(config,
-					rpages->p[index].virt
-					    + (offset & ~PAGE_MASK),
-					src, len - 1);
-		offset += count;
+					dest, src, len - 1);
 		/* Padding */
-		if (unlikely(count < len - 1)) {
-			size_t pad_len = len - 1 - count;
-
-			lib_ring_buffer_do_memset(rpages->p[index].virt
-						+ (offset & ~PAGE_MASK),
-					pad, pad_len);
-			offset += pad_len;
-		}
+		if (unlikely(count < len - 1))
+			lib_ring_buffer_do_memset(dest + count, pad,
+						  len - 1 - count);
 		/* Ending '\0' */
-		lib_ring_buffer_do_memset(rpages->p[index].virt
-					+ (offset & ~PAGE_MASK),
-				'\0', 1);
+		lib_ring_buffer_do_memset(dest + len - 1, '\0', 1);
 	} else {
 		_lib_ring_buffer_strcpy_from_user_inatomic(bufb, offset, src,
 					len, 0, pad);
@@ -47,9 +47,18 @@ void channel_backend_free(struct channel_backend *chanb);
 void lib_ring_buffer_backend_reset(struct lib_ring_buffer_backend *bufb);
 void channel_backend_reset(struct channel_backend *chanb);
 
+void lib_ring_buffer_backend_restore_read_subbuf(struct lib_ring_buffer_backend *bufb);
+
 int lib_ring_buffer_backend_init(void);
 void lib_ring_buffer_backend_exit(void);
 
+struct lib_ring_buffer_page_pool_stats;
+
+int lib_ring_buffer_page_pool_create(struct lib_ring_buffer_backend *bufb);
+void lib_ring_buffer_page_pool_destroy(struct lib_ring_buffer_backend *bufb);
+void lib_ring_buffer_page_pool_stats(struct lib_ring_buffer_backend *bufb,
+				     struct lib_ring_buffer_page_pool_stats *stats);
+
 extern void _lib_ring_buffer_write(struct lib_ring_buffer_backend *bufb,
 				   size_t offset, const void *src, size_t len,
 				   size_t pagecpy);
@@ -309,6 +318,19 @@ unsigned long subbuffer_get_data_size(
 	return pages->data_size;
 }
 
+/*
+ * Return the contiguous mapping of a sub-buffer, or NULL if its pages need to
+ * be accessed one at a time.
+ */
+static inline
+void *subbuffer_get_contig_virt(const struct lib_ring_buffer_config *config,
+				struct lib_ring_buffer_backend_pages *pages)
+{
+	if (config->backend == RING_BUFFER_PAGE)
+		return NULL;
+	return pages->virt;
+}
+
 static inline
 void subbuffer_inc_packet_count(const struct lib_ring_buffer_config *config,
 				struct lib_ring_buffer_backend *bufb,
@@ -25,6 +25,10 @@
 
 #include <linux/cpumask.h>
 #include <linux/types.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/kref.h>
+#include <linux/atomic.h>
 
 struct lib_ring_buffer_backend_page {
 	void *virt;			/* page virtual address (cached) */
@@ -36,6 +40,10 @@ struct lib_ring_buffer_backend_pages {
 	union v_atomic records_commit;	/* current records committed count */
 	union v_atomic records_unread;	/* records to read */
 	unsigned long data_size;	/* Amount of data to read from subbuf */
+	void *virt;			/*
+					 * Contiguous sub-buffer mapping, NULL
+					 * if pages must be accessed one by one
+					 */
 	struct lib_ring_buffer_backend_page p[];
 };
 
@@ -60,6 +68,24 @@ struct lib_ring_buffer_backend_counts {
 struct channel;
 struct lib_ring_buffer;
 
+/*
+ * Pages released by the splice pipe, recycled to replace the pages moved
+ * out of the reader sub-buffer. Pages in flight within a pipe hold a
+ * reference on the pool, which can therefore outlive its buffer.
+ */
+struct lib_ring_buffer_page_pool {
+	spinlock_t lock;		/* Protects pages and count */
+	struct list_head pages;		/* Free pages, chained by page->lru */
+	unsigned int count;		/* Number of free pages */
+	int node;			/* NUMA node of the pages */
+	int dead;			/* Buffer freed, stop recycling */
+	struct kref ref;
+	atomic_long_t hits;		/* Replacement taken from the pool */
+	atomic_long_t misses;		/* Replacement allocated */
+	atomic_long_t recycled;		/* Released page kept in the pool */
+	atomic_long_t released;		/* Released page freed */
+};
+
 struct lib_ring_buffer_backend {
 	/* Array of ring_buffer_backend_subbuffer for writer */
 	struct lib_ring_buffer_backend_subbuffer *buf_wsb;
@@ -77,6 +103,7 @@ struct lib_ring_buffer_backend {
 	struct channel *chan;		/* Associated channel */
 	int cpu;			/* This buffer's cpu. -1 if global. */
 	union v_atomic records_read;	/* Number of records read */
+	struct lib_ring_buffer_page_pool *page_pool;	/* Splice output only */
 	unsigned int allocated:1;	/* is buffer allocated ? */
 };
 
@@ -91,6 +118,7 @@ struct channel_backend {
 	unsigned int buf_size_order;	/* Order of buffer size */
 	unsigned int extra_reader_sb:1;	/* has extra reader subbuffer ? */
 	struct lib_ring_buffer *buf;	/* Channel per-cpu buffers */
+	struct lib_ring_buffer **node_buf;	/* Channel per-node buffers */
 
 	unsigned long num_subbuf;	/* Number of sub-buffers for writer */
 	u64 start_tsc;			/* Channel creation TSC value */
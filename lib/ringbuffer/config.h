@@ -104,6 +104,12 @@ struct lib_ring_buffer_client_cb {
  * RING_BUFFER_ALLOC_GLOBAL and RING_BUFFER_SYNC_GLOBAL :
  *   Global shared buffer with global synchronization.
  *
+ * RING_BUFFER_ALLOC_PER_NODE and RING_BUFFER_SYNC_GLOBAL :
+ *   One buffer per NUMA node, allocated on that node, with global
+ *   synchronization shared by the CPUs of the node only. Each buffer is
+ *   identified by the first possible CPU of its node, which is the only CPU
+ *   of the node set in the channel cpumask. Iterator output is not supported.
+ *
  * wakeup:
  *
  * RING_BUFFER_WAKEUP_BY_TIMER uses per-cpu timers to poll the
@@ -117,11 +123,33 @@ struct lib_ring_buffer_client_cb {
  *
  * RING_BUFFER_WAKEUP_NONE does not perform any wakeup whatsoever. The client
  * has the responsibility to perform wakeups.
+ *
+ * backend:
+ *
+ * RING_BUFFER_PAGE allocates each buffer page individually. Records crossing
+ * a page boundary are copied page by page.
+ *
+ * RING_BUFFER_PAGE_CONTIG allocates each sub-buffer as a single high-order
+ * chunk of physically contiguous pages (up to MAX_ORDER - 1), mapped by the
+ * kernel linear mapping (which uses huge TLB entries on most architectures).
+ * Writes into such sub-buffers never need to check for page boundaries.
+ * Falls back on individual pages for a sub-buffer when the high-order
+ * allocation fails. Splice copies the pages of contiguous sub-buffers into
+ * pages handed to the pipe rather than stealing them, so the contiguity is
+ * kept for the lifetime of the buffer, at the cost of zero-copy splice.
+ * Writers that favour write throughput over consumer cost opt into it.
+ *
+ * RING_BUFFER_VMAP allocates individual pages and maps each sub-buffer into a
+ * virtually contiguous kernel range, so writes and reads are single copies
+ * regardless of page boundaries, at the cost of vmap TLB entries. Mapping is
+ * done per sub-buffer rather than per buffer so that splice, which exchanges
+ * the pages of the reader sub-buffer, only needs to remap that sub-buffer.
  */
 struct lib_ring_buffer_config {
 	enum {
 		RING_BUFFER_ALLOC_PER_CPU,
 		RING_BUFFER_ALLOC_GLOBAL,
+		RING_BUFFER_ALLOC_PER_NODE,
 	} alloc;
 	enum {
 		RING_BUFFER_SYNC_PER_CPU,	/* Wait-free */
@@ -140,7 +168,12 @@ struct lib_ring_buffer_config {
 	} output;
 	enum {
 		RING_BUFFER_PAGE,
-		RING_BUFFER_VMAP,		/* TODO */
+		RING_BUFFER_PAGE_CONTIG,	/*
+						 * Physically contiguous
+						 * sub-buffers, page by page
+						 * fallback.
+						 */
+		RING_BUFFER_VMAP,		/* Per sub-buffer vmap */
 		RING_BUFFER_STATIC,		/* TODO */
 	} backend;
 	enum {
@@ -307,6 +340,10 @@ int lib_ring_buffer_check_config(const struct lib_ring_buffer_config *config,
 	    && config->sync == RING_BUFFER_SYNC_PER_CPU
 	    && switch_timer_interval)
 		return -EINVAL;
+	if (config->alloc == RING_BUFFER_ALLOC_PER_NODE
+	    && (config->sync != RING_BUFFER_SYNC_GLOBAL
+		|| config->output == RING_BUFFER_ITERATOR))
+		return -EINVAL;
 	return 0;
 }
 
@@ -167,6 +167,8 @@ int lib_ring_buffer_reserve(const struct lib_ring_buffer_config *config,
 
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
 		buf = per_cpu_ptr(chan->backend.buf, ctx->cpu);
+	else if (config->alloc == RING_BUFFER_ALLOC_PER_NODE)
+		buf = chan->backend.node_buf[cpu_to_node(ctx->cpu)];
 	else
 		buf = chan->backend.buf;
 	if (atomic_read(&buf->record_disabled))
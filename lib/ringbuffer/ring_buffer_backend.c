@@ -27,12 +27,88 @@
 #include <linux/slab.h>
 #include <linux/cpu.h>
 #include <linux/mm.h>
+#include <linux/vmalloc.h>
 
 #include "../../wrapper/vmalloc.h"	/* for wrapper_vmalloc_sync_all() */
 #include "../../wrapper/ringbuffer/config.h"
 #include "../../wrapper/ringbuffer/backend.h"
 #include "../../wrapper/ringbuffer/frontend.h"
 
+/*
+ * Allocate a sub-buffer as a single physically contiguous chunk. The chunk is
+ * split into order-0 pages, so each page can still be handed out on its own
+ * by mmap and splice. Returns NULL if the allocation cannot be satisfied
+ * without effort, in which case the caller falls back on individual pages.
+ */
+static
+struct page *lib_ring_buffer_alloc_subbuf_contig(struct channel_backend *chanb,
+						 int node)
+{
+	unsigned int order = get_order(chanb->subbuf_size);
+	struct page *page;
+
+	if (order >= MAX_ORDER)
+		return NULL;
+	page = alloc_pages_node(node, GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN
+				      | __GFP_NORETRY, order);
+	if (!page)
+		return NULL;
+	split_page(page, order);
+	return page;
+}
+
+/*
+ * Return the linear mapping address of a sub-buffer if all its pages are
+ * physically contiguous, else NULL.
+ */
+static
+void *lib_ring_buffer_subbuf_contig_virt(struct lib_ring_buffer_backend_pages *rpages,
+					 unsigned long num_pages_per_subbuf)
+{
+	unsigned long j;
+
+	for (j = 1; j < num_pages_per_subbuf; j++) {
+		if (page_to_pfn(rpages->p[j].page)
+		    != page_to_pfn(rpages->p[0].page) + j)
+			return NULL;
+	}
+	return rpages->p[0].virt;
+}
+
+/*
+ * Map a sub-buffer into a virtually contiguous kernel range. Use the linear
+ * mapping when the pages happen to be physically contiguous, which saves a
+ * vmap area and its TLB entries.
+ */
+static
+void *lib_ring_buffer_subbuf_vmap(struct lib_ring_buffer_backend_pages *rpages,
+				  unsigned long num_pages_per_subbuf)
+{
+	struct page **pages;
+	unsigned long j;
+	void *virt;
+
+	virt = lib_ring_buffer_subbuf_contig_virt(rpages, num_pages_per_subbuf);
+	if (virt)
+		return virt;
+	pages = kmalloc(sizeof(*pages) * num_pages_per_subbuf, GFP_KERNEL);
+	if (!pages)
+		return NULL;
+	for (j = 0; j < num_pages_per_subbuf; j++)
+		pages[j] = rpages->p[j].page;
+	virt = vmap(pages, num_pages_per_subbuf, VM_MAP, PAGE_KERNEL);
+	kfree(pages);
+	return virt;
+}
+
+static
+void lib_ring_buffer_subbuf_vunmap(struct lib_ring_buffer_backend_pages *rpages)
+{
+	if (rpages->virt && is_vmalloc_addr(rpages->virt))
+		vunmap(rpages->virt);
+	rpages->virt = NULL;
+}
+
 /**
  * lib_ring_buffer_backend_allocate - allocate a channel buffer
  * @config: ring buffer instance configuration
@@ -85,6 +161,25 @@ int lib_ring_buffer_backend_allocate(const struct lib_ring_buffer_config *config
 		goto array_error;
 
 	for (i = 0; i < num_pages; i++) {
+		/*
+		 * Try to get the whole sub-buffer as a single chunk when
+		 * starting a new sub-buffer.
+		 */
+		if (config->backend == RING_BUFFER_PAGE_CONTIG
+		    && !(i & (num_pages_per_subbuf - 1))) {
+			struct page *chunk;
+
+			chunk = lib_ring_buffer_alloc_subbuf_contig(chanb,
+					cpu_to_node(max(bufb->cpu, 0)));
+			if (chunk) {
+				for (j = 0; j < num_pages_per_subbuf; j++) {
+					pages[i + j] = chunk + j;
+					virt[i + j] = page_address(chunk + j);
+				}
+				i += num_pages_per_subbuf - 1;
+				continue;
+			}
+		}
 		pages[i] = alloc_pages_node(cpu_to_node(max(bufb->cpu, 0)),
 					    GFP_KERNEL | __GFP_ZERO, 0);
 		if (unlikely(!pages[i]))
@@ -142,6 +237,17 @@ int lib_ring_buffer_backend_allocate(const struct lib_ring_buffer_config *config
 			bufb->array[i]->p[j].page = pages[page_idx];
 			page_idx++;
 		}
+		if (config->backend == RING_BUFFER_PAGE_CONTIG)
+			bufb->array[i]->virt =
+				lib_ring_buffer_subbuf_contig_virt(bufb->array[i],
+						num_pages_per_subbuf);
+		if (config->backend == RING_BUFFER_VMAP) {
+			bufb->array[i]->virt =
+				lib_ring_buffer_subbuf_vmap(bufb->array[i],
+						num_pages_per_subbuf);
+			if (unlikely(!bufb->array[i]->virt))
+				goto free_vmap;
+		}
 		if (config->output == RING_BUFFER_MMAP) {
 			bufb->array[i]->mmap_offset = mmap_offset;
 			mmap_offset += subbuf_size;
@@ -157,6 +263,10 @@ int lib_ring_buffer_backend_allocate(const struct lib_ring_buffer_config *config
 	kfree(pages);
 	return 0;
 
+free_vmap:
+	for (i = 0; i < num_subbuf_alloc; i++)
+		lib_ring_buffer_subbuf_vunmap(bufb->array[i]);
+	kfree(bufb->buf_cnt);
 free_wsb:
 	kfree(bufb->buf_wsb);
 free_array:
@@ -180,12 +290,22 @@ int lib_ring_buffer_backend_create(struct lib_ring_buffer_backend *bufb,
 {
 	const struct lib_ring_buffer_config *config = &chanb->config;
 
+	int ret;
+
 	bufb->chan = container_of(chanb, struct channel, backend);
 	bufb->cpu = cpu;
 
-	return lib_ring_buffer_backend_allocate(config, bufb, chanb->buf_size,
-						chanb->num_subbuf,
-						chanb->extra_reader_sb);
+	if (config->output == RING_BUFFER_SPLICE) {
+		ret = lib_ring_buffer_page_pool_create(bufb);
+		if (ret)
+			return ret;
+	}
+	ret = lib_ring_buffer_backend_allocate(config, bufb, chanb->buf_size,
+					       chanb->num_subbuf,
+					       chanb->extra_reader_sb);
+	if (ret)
+		lib_ring_buffer_page_pool_destroy(bufb);
+	return ret;
 }
 
 void lib_ring_buffer_backend_free(struct lib_ring_buffer_backend *bufb)
@@ -200,11 +320,13 @@ void lib_ring_buffer_backend_free(struct lib_ring_buffer_backend *bufb)
 	kfree(bufb->buf_wsb);
 	kfree(bufb->buf_cnt);
 	for (i = 0; i < num_subbuf_alloc; i++) {
+		lib_ring_buffer_subbuf_vunmap(bufb->array[i]);
 		for (j = 0; j < bufb->num_pages_per_subbuf; j++)
 			__free_page(bufb->array[i]->p[j].page);
 		kfree(bufb->array[i]);
 	}
 	kfree(bufb->array);
+	lib_ring_buffer_page_pool_destroy(bufb);
 	bufb->allocated = 0;
 }
 
@@ -238,6 +360,36 @@ void lib_ring_buffer_backend_reset(struct lib_ring_buffer_backend *bufb)
 	v_set(config, &bufb->records_read, 0);
 }
 
+/**
+ * lib_ring_buffer_backend_restore_read_subbuf - restore reader sub-buffer layout
+ * @bufb: buffer backend
+ *
+ * With the vmap backend, splice gives the reader sub-buffer pages away and
+ * replaces them with new pages, which unmaps the sub-buffer. Map the new
+ * pages again before handing the sub-buffer back to writers. The
+ * page-contig backend does not need this, since splice copies its pages.
+ *
+ * Called by the reader with exclusive sub-buffer access, from process
+ * context.
+ */
+void lib_ring_buffer_backend_restore_read_subbuf(struct lib_ring_buffer_backend *bufb)
+{
+	struct channel_backend *chanb = &bufb->chan->backend;
+	const struct lib_ring_buffer_config *config = &chanb->config;
+	struct lib_ring_buffer_backend_pages *rpages;
+	unsigned long sb_bindex;
+
+	if (config->backend != RING_BUFFER_VMAP
+	    || config->output != RING_BUFFER_SPLICE)
+		return;
+	sb_bindex = subbuffer_id_get_index(config, bufb->buf_rsb.id);
+	rpages = bufb->array[sb_bindex];
+	if (rpages->virt)
+		return;
+	rpages->virt = lib_ring_buffer_subbuf_vmap(rpages,
+				bufb->num_pages_per_subbuf);
+}
+
 /*
  * The frontend is responsible for also calling ring_buffer_backend_reset for
  * each buffer when calling channel_backend_reset.
@@ -366,7 +518,7 @@ int channel_backend_init(struct channel_backend *chanb,
 	strlcpy(chanb->name, name, NAME_MAX);
 	memcpy(&chanb->config, config, sizeof(chanb->config));
 
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL) {
 		if (!zalloc_cpumask_var(&chanb->cpumask, GFP_KERNEL))
 			return -ENOMEM;
 	}
@@ -410,6 +562,30 @@ int channel_backend_init(struct channel_backend *chanb,
 				goto free_bufs;	/* cpu hotplug locked */
 		}
 #endif
+	} else if (config->alloc == RING_BUFFER_ALLOC_PER_NODE) {
+		chanb->node_buf = kzalloc(sizeof(*chanb->node_buf)
+					  * nr_node_ids, GFP_KERNEL);
+		if (!chanb->node_buf)
+			goto free_cpumask;
+		/*
+		 * Allocate a buffer for each node having possible CPUs, so
+		 * CPUs brought online later on always find their node buffer.
+		 */
+		for_each_possible_cpu(i) {
+			int node = cpu_to_node(i);
+			struct lib_ring_buffer *buf;
+
+			if (chanb->node_buf[node])
+				continue;
+			buf = kzalloc_node(sizeof(struct lib_ring_buffer),
+					   GFP_KERNEL, node);
+			if (!buf)
+				goto free_bufs;
+			chanb->node_buf[node] = buf;
+			ret = lib_ring_buffer_create(buf, chanb, i);
+			if (ret)
+				goto free_bufs;
+		}
 	} else {
 		chanb->buf = kzalloc(sizeof(struct lib_ring_buffer), GFP_KERNEL);
 		if (!chanb->buf)
@@ -435,10 +611,21 @@ free_bufs:
 		put_online_cpus();
 #endif
 		free_percpu(chanb->buf);
+	} else if (config->alloc == RING_BUFFER_ALLOC_PER_NODE) {
+		for (i = 0; i < nr_node_ids; i++) {
+			struct lib_ring_buffer *buf = chanb->node_buf[i];
+
+			if (!buf)
+				continue;
+			if (buf->backend.allocated)
+				lib_ring_buffer_free(buf);
+			kfree(buf);
+		}
+		kfree(chanb->node_buf);
 	} else
 		kfree(chanb->buf);
 free_cpumask:
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL)
 		free_cpumask_var(chanb->cpumask);
 	return -ENOMEM;
 }
@@ -478,6 +665,18 @@ void channel_backend_free(struct channel_backend *chanb)
 		}
 		free_cpumask_var(chanb->cpumask);
 		free_percpu(chanb->buf);
+	} else if (config->alloc == RING_BUFFER_ALLOC_PER_NODE) {
+		for (i = 0; i < nr_node_ids; i++) {
+			struct lib_ring_buffer *buf = chanb->node_buf[i];
+
+			if (!buf)
+				continue;
+			CHAN_WARN_ON(chanb, !buf->backend.allocated);
+			lib_ring_buffer_free(buf);
+			kfree(buf);
+		}
+		free_cpumask_var(chanb->cpumask);
+		kfree(chanb->node_buf);
 	} else {
 		struct lib_ring_buffer *buf = chanb->buf;
 
@@ -822,6 +1021,16 @@ size_t lib_ring_buffer_read(struct lib_ring_buffer_backend *bufb, size_t offset,
 	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
 	if (unlikely(!len))
 		return 0;
+	id = bufb->buf_rsb.id;
+	sb_bindex = subbuffer_id_get_index(config, id);
+	rpages = bufb->array[sb_bindex];
+	if (rpages->virt) {
+		CHAN_WARN_ON(chanb, config->mode == RING_BUFFER_OVERWRITE
+			     && subbuffer_id_is_noref(config, id));
+		memcpy(dest, rpages->virt + (offset & (chanb->subbuf_size - 1)),
+		       len);
+		return orig_len;
+	}
 	for (;;) {
 		pagecpy = min_t(size_t, len, PAGE_SIZE - (offset & ~PAGE_MASK));
 		id = bufb->buf_rsb.id;
@@ -873,6 +1082,18 @@ int __lib_ring_buffer_copy_to_user(struct lib_ring_buffer_backend *bufb,
 	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
 	if (unlikely(!len))
 		return 0;
+	id = bufb->buf_rsb.id;
+	sb_bindex = subbuffer_id_get_index(config, id);
+	rpages = bufb->array[sb_bindex];
+	if (rpages->virt) {
+		CHAN_WARN_ON(chanb, config->mode == RING_BUFFER_OVERWRITE
+			     && subbuffer_id_is_noref(config, id));
+		if (__copy_to_user(dest,
+			       rpages->virt + (offset & (chanb->subbuf_size - 1)),
+			       len))
+			return -EFAULT;
+		return 0;
+	}
 	for (;;) {
 		pagecpy = min_t(size_t, len, PAGE_SIZE - (offset & ~PAGE_MASK));
 		id = bufb->buf_rsb.id;
@@ -990,6 +1211,44 @@ struct page **lib_ring_buffer_read_get_page(struct lib_ring_buffer_backend *bufb
 }
 EXPORT_SYMBOL_GPL(lib_ring_buffer_read_get_page);
 
+/**
+ * lib_ring_buffer_read_replace_page - Replace a page of the reader sub-buffer
+ * @bufb : buffer backend
+ * @offset : offset within the buffer
+ * @new_page : page to put in place of the current page
+ *
+ * Should be protected by get_subbuf/put_subbuf.
+ * Returns the page previously located at @offset, now owned by the caller.
+ * The reader sub-buffer of the vmap backend loses its mapping until
+ * lib_ring_buffer_backend_restore_read_subbuf() is called. Not used with the
+ * page-contig backend, which would lose its contiguity.
+ */
+struct page *lib_ring_buffer_read_replace_page(struct lib_ring_buffer_backend *bufb,
+					       size_t offset,
+					       struct page *new_page)
+{
+	size_t index;
+	struct lib_ring_buffer_backend_pages *rpages;
+	struct channel_backend *chanb = &bufb->chan->backend;
+	const struct lib_ring_buffer_config *config = &chanb->config;
+	unsigned long sb_bindex, id;
+	struct page *old_page;
+
+	offset &= chanb->buf_size - 1;
+	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
+	id = bufb->buf_rsb.id;
+	sb_bindex = subbuffer_id_get_index(config, id);
+	rpages = bufb->array[sb_bindex];
+	CHAN_WARN_ON(chanb, config->mode == RING_BUFFER_OVERWRITE
+		     && subbuffer_id_is_noref(config, id));
+	old_page = rpages->p[index].page;
+	rpages->p[index].page = new_page;
+	rpages->p[index].virt = page_address(new_page);
+	lib_ring_buffer_subbuf_vunmap(rpages);
+	return old_page;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_read_replace_page);
+
 /**
  * lib_ring_buffer_read_offset_address - get address of a buffer location
  * @bufb : buffer backend
@@ -0,0 +1,648 @@
+/*
+ * ring_buffer_benchmark.c
+ *
+ * Ring Buffer Library benchmark module.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; only
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Standalone client of the ring buffer library, also meant as an example of
+ * its use outside of LTTng. Each supported combination of allocation,
+ * synchronization, mode and wakeup scheme has its own static configuration,
+ * so the write fast paths are specialized exactly as they would be in a real
+ * client.
+ *
+ * Usage, through debugfs:
+ *
+ *   echo all > /sys/kernel/debug/lttng-ring-buffer-benchmark/run
+ *   echo percpu-percpu-discard-timer > .../lttng-ring-buffer-benchmark/run
+ *   cat /sys/kernel/debug/lttng-ring-buffer-benchmark/results
+ *
+ * Reading "configs" lists the available configurations. Writing to "run"
+ * blocks until the benchmark completes.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/types.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/debugfs.h>
+#include <linux/uaccess.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/time.h>
+#include <linux/trace_clock.h>
+
+#include "../../wrapper/perf.h"
+#include "../../wrapper/ringbuffer/config.h"
+#include "../../wrapper/ringbuffer/frontend_types.h"
+#include "../../lttng-tracer.h"
+
+#define BENCH_MAX_PAYLOAD	512
+#define BENCH_RESULTS_LEN	(4 * PAGE_SIZE)
+#define BENCH_RESCHED_EVENTS	1024
+
+static unsigned int nr_threads;
+module_param(nr_threads, uint, 0644);
+MODULE_PARM_DESC(nr_threads, "Number of writer threads (default: number of online CPUs)");
+
+static unsigned long nr_events = 1000000;
+module_param(nr_events, ulong, 0644);
+MODULE_PARM_DESC(nr_events, "Number of events written by each writer thread");
+
+static unsigned int payload_size = 16;
+module_param(payload_size, uint, 0644);
+MODULE_PARM_DESC(payload_size, "Event payload size, in bytes");
+
+static unsigned long subbuf_size = 262144;
+module_param(subbuf_size, ulong, 0644);
+MODULE_PARM_DESC(subbuf_size, "Sub-buffer size, in bytes");
+
+static unsigned long num_subbuf = 4;
+module_param(num_subbuf, ulong, 0644);
+MODULE_PARM_DESC(num_subbuf, "Number of sub-buffers per buffer");
+
+static unsigned int read_timer_interval = 200;
+module_param(read_timer_interval, uint, 0644);
+MODULE_PARM_DESC(read_timer_interval, "Reader wakeup timer interval, in us");
+
+static bool consume = true;
+module_param(consume, bool, 0644);
+MODULE_PARM_DESC(consume, "Consume sub-buffers while writing");
+
+struct bench_packet_header {
+	uint64_t timestamp_begin;	/* Cycle count at subbuffer start */
+	uint64_t timestamp_end;		/* Cycle count at subbuffer end */
+	uint64_t content_size;		/* Size of data in subbuffer */
+	uint8_t header_end[0];		/* End of header */
+};
+
+struct bench_thread {
+	struct task_struct *task;
+	struct channel *chan;
+	struct completion *start;
+	struct completion done;
+	u64 duration_ns;
+	u64 cache_misses;
+	unsigned long failed;
+};
+
+static char bench_payload[BENCH_MAX_PAYLOAD];
+static char *bench_results;
+static size_t bench_results_len;
+static DEFINE_MUTEX(bench_mutex);
+static struct dentry *bench_dentry;
+
+static inline
+u64 lib_ring_buffer_clock_read(struct channel *chan)
+{
+	return trace_clock_local();
+}
+
+static inline
+unsigned char record_header_size(const struct lib_ring_buffer_config *config,
+				 struct channel *chan, size_t offset,
+				 size_t *pre_header_padding,
+				 struct lib_ring_buffer_ctx *ctx)
+{
+	*pre_header_padding = 0;
+	return 0;
+}
+
+#include "../../wrapper/ringbuffer/api.h"
+
+static u64 client_ring_buffer_clock_read(struct channel *chan)
+{
+	return lib_ring_buffer_clock_read(chan);
+}
+
+static
+size_t client_record_header_size(const struct lib_ring_buffer_config *config,
+				 struct channel *chan, size_t offset,
+				 size_t *pre_header_padding,
+				 struct lib_ring_buffer_ctx *ctx)
+{
+	return record_header_size(config, chan, offset,
+				  pre_header_padding, ctx);
+}
+
+static size_t client_packet_header_size(void)
+{
+	return offsetof(struct bench_packet_header, header_end);
+}
+
+static void client_buffer_begin(struct lib_ring_buffer *buf, u64 tsc,
+				unsigned int subbuf_idx)
+{
+	struct channel *chan = buf->backend.chan;
+	struct bench_packet_header *header =
+		(struct bench_packet_header *)
+			lib_ring_buffer_offset_address(&buf->backend,
+				subbuf_idx * chan->backend.subbuf_size);
+
+	header->timestamp_begin = tsc;
+	header->timestamp_end = 0;
+	header->content_size = ~0ULL;	/* for debugging */
+}
+
+static void client_buffer_end(struct lib_ring_buffer *buf, u64 tsc,
+			      unsigned int subbuf_idx, unsigned long data_size)
+{
+	struct channel *chan = buf->backend.chan;
+	struct bench_packet_header *header =
+		(struct bench_packet_header *)
+			lib_ring_buffer_offset_address(&buf->backend,
+				subbuf_idx * chan->backend.subbuf_size);
+
+	header->timestamp_end = tsc;
+	header->content_size = data_size;
+}
+
+static int client_buffer_create(struct lib_ring_buffer *buf, void *priv,
+				int cpu, const char *name)
+{
+	return 0;
+}
+
+static void client_buffer_finalize(struct lib_ring_buffer *buf, void *priv, int cpu)
+{
+}
+
+#define BENCH_CONFIG_INIT(_alloc, _sync, _mode, _wakeup)		\
+	{								\
+		.cb.ring_buffer_clock_read = client_ring_buffer_clock_read, \
+		.cb.record_header_size = client_record_header_size,	\
+		.cb.subbuffer_header_size = client_packet_header_size,	\
+		.cb.buffer_begin = client_buffer_begin,			\
+		.cb.buffer_end = client_buffer_end,			\
+		.cb.buffer_create = client_buffer_create,		\
+		.cb.buffer_finalize = client_buffer_finalize,		\
+									\
+		.tsc_bits = 0,						\
+		.alloc = _alloc,					\
+		.sync = _sync,						\
+		.mode = _mode,						\
+		.backend = RING_BUFFER_PAGE_CONTIG,			\
+		.output = RING_BUFFER_NONE,				\
+		.oops = RING_BUFFER_OOPS_CONSISTENCY,			\
+		.ipi = RING_BUFFER_IPI_BARRIER,				\
+		.wakeup = _wakeup,					\
+	}
+
+/*
+ * Writer loop. Always inlined in the per-configuration thread functions, so
+ * the configuration is a compile-time constant within the fast paths.
+ */
+static __always_inline
+int bench_writer(const struct lib_ring_buffer_config *config,
+		 struct bench_thread *thread)
+{
+	struct lib_ring_buffer_ctx ctx;
+	struct perf_event *event = NULL;
+	unsigned long i;
+	u64 begin, end;
+	int ret, cpu;
+
+#ifdef CONFIG_PERF_EVENTS
+	{
+		struct perf_event_attr attr;
+
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.size = sizeof(attr);
+		attr.pinned = 1;
+		event = wrapper_perf_event_create_kernel_counter(&attr, -1,
+				current, NULL);
+		if (IS_ERR(event))
+			event = NULL;
+	}
+#endif /* CONFIG_PERF_EVENTS */
+
+	wait_for_completion(thread->start);
+	begin = ktime_to_ns(ktime_get());
+	for (i = 0; i < nr_events; i++) {
+		cpu = lib_ring_buffer_get_cpu(config);
+		if (cpu < 0) {
+			thread->failed++;
+			continue;
+		}
+		lib_ring_buffer_ctx_init(&ctx, thread->chan, NULL,
+					 payload_size, sizeof(uint64_t), cpu);
+		ret = lib_ring_buffer_reserve(config, &ctx);
+		if (!ret) {
+			lib_ring_buffer_write(config, &ctx, bench_payload,
+					      payload_size);
+			lib_ring_buffer_commit(config, &ctx);
+		} else {
+			thread->failed++;
+		}
+		lib_ring_buffer_put_cpu(config);
+		if (!(i & (BENCH_RESCHED_EVENTS - 1)))
+			cond_resched();
+	}
+	end = ktime_to_ns(ktime_get());
+	thread->duration_ns = end - begin;
+
+#ifdef CONFIG_PERF_EVENTS
+	if (event) {
+		u64 enabled, running;
+
+		thread->cache_misses = perf_event_read_value(event, &enabled,
+							     &running);
+		perf_event_release_kernel(event);
+	}
+#endif /* CONFIG_PERF_EVENTS */
+
+	complete(&thread->done);
+	/* Wait for kthread_stop() to collect us. */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+#define DEFINE_BENCH_CONFIG(_name, _alloc, _sync, _mode, _wakeup)	\
+static const struct lib_ring_buffer_config bench_config_##_name =	\
+	BENCH_CONFIG_INIT(_alloc, _sync, _mode, _wakeup);		\
+									\
+static int bench_writer_##_name(void *data)				\
+{									\
+	return bench_writer(&bench_config_##_name, data);		\
+}
+
+#define DEFINE_BENCH_CONFIG_WAKEUP(_name, _alloc, _sync, _mode)		\
+	DEFINE_BENCH_CONFIG(_name##_timer, _alloc, _sync, _mode,	\
+			    RING_BUFFER_WAKEUP_BY_TIMER)		\
+	DEFINE_BENCH_CONFIG(_name##_writer, _alloc, _sync, _mode,	\
+			    RING_BUFFER_WAKEUP_BY_WRITER)
+
+#define DEFINE_BENCH_CONFIG_MODE(_name, _alloc, _sync)			\
+	DEFINE_BENCH_CONFIG_WAKEUP(_name##_discard, _alloc, _sync,	\
+				   RING_BUFFER_DISCARD)			\
+	DEFINE_BENCH_CONFIG_WAKEUP(_name##_overwrite, _alloc, _sync,	\
+				   RING_BUFFER_OVERWRITE)
+
+/* Global and per-node buffers require global synchronization. */
+DEFINE_BENCH_CONFIG_MODE(percpu_percpu, RING_BUFFER_ALLOC_PER_CPU,
+			 RING_BUFFER_SYNC_PER_CPU)
+DEFINE_BENCH_CONFIG_MODE(percpu_global, RING_BUFFER_ALLOC_PER_CPU,
+			 RING_BUFFER_SYNC_GLOBAL)
+DEFINE_BENCH_CONFIG_MODE(global_global, RING_BUFFER_ALLOC_GLOBAL,
+			 RING_BUFFER_SYNC_GLOBAL)
+DEFINE_BENCH_CONFIG_MODE(pernode_global, RING_BUFFER_ALLOC_PER_NODE,
+			 RING_BUFFER_SYNC_GLOBAL)
+
+struct bench_config {
+	const char *name;
+	const struct lib_ring_buffer_config *config;
+	int (*writer)(void *data);
+};
+
+#define BENCH_CONFIG_ENTRY(_name, _str)					\
+	{ _str, &bench_config_##_name, bench_writer_##_name }
+
+#define BENCH_CONFIG_ENTRIES(_name, _str)				\
+	BENCH_CONFIG_ENTRY(_name##_discard_timer, _str "-discard-timer"), \
+	BENCH_CONFIG_ENTRY(_name##_discard_writer, _str "-discard-writer"), \
+	BENCH_CONFIG_ENTRY(_name##_overwrite_timer, _str "-overwrite-timer"), \
+	BENCH_CONFIG_ENTRY(_name##_overwrite_writer, _str "-overwrite-writer")
+
+static const struct bench_config bench_configs[] = {
+	BENCH_CONFIG_ENTRIES(percpu_percpu, "percpu-percpu"),
+	BENCH_CONFIG_ENTRIES(percpu_global, "percpu-global"),
+	BENCH_CONFIG_ENTRIES(global_global, "global-global"),
+	BENCH_CONFIG_ENTRIES(pernode_global, "pernode-global"),
+};
+
+static
+void bench_consume_buffer(struct lib_ring_buffer *buf)
+{
+	while (!lib_ring_buffer_get_next_subbuf(buf))
+		lib_ring_buffer_put_next_subbuf(buf);
+}
+
+/*
+ * Reader thread: discards the content of delivered sub-buffers, so writers
+ * see a consumer keeping up.
+ */
+static
+int bench_reader(void *data)
+{
+	struct channel *chan = data;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	struct lib_ring_buffer *buf;
+	int cpu;
+
+	while (!kthread_should_stop()) {
+		if (config->alloc != RING_BUFFER_ALLOC_GLOBAL) {
+			for_each_channel_cpu(cpu, chan)
+				bench_consume_buffer(
+					channel_get_ring_buffer(config,
+								chan, cpu));
+		} else {
+			buf = channel_get_ring_buffer(config, chan, 0);
+			bench_consume_buffer(buf);
+		}
+		schedule_timeout_interruptible(1);
+	}
+	return 0;
+}
+
+static
+int bench_open_read(const struct lib_ring_buffer_config *config,
+		    struct channel *chan, int open)
+{
+	struct lib_ring_buffer *buf;
+	int cpu, ret;
+
+	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL) {
+		buf = channel_get_ring_buffer(config, chan, 0);
+		if (!open) {
+			lib_ring_buffer_release_read(buf);
+			return 0;
+		}
+		return lib_ring_buffer_open_read(buf);
+	}
+	for_each_channel_cpu(cpu, chan) {
+		buf = channel_get_ring_buffer(config, chan, cpu);
+		if (!open) {
+			lib_ring_buffer_release_read(buf);
+			continue;
+		}
+		ret = lib_ring_buffer_open_read(buf);
+		if (ret) {
+			bench_open_read(config, chan, 0);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+static
+void bench_buffer_stats(const struct lib_ring_buffer_config *config,
+			struct lib_ring_buffer *buf,
+			unsigned long *lost, unsigned long *overrun)
+{
+	*lost += lib_ring_buffer_get_records_lost_full(config, buf);
+	*lost += lib_ring_buffer_get_records_lost_wrap(config, buf);
+	*lost += lib_ring_buffer_get_records_lost_big(config, buf);
+	*overrun += lib_ring_buffer_get_records_overrun(config, buf);
+}
+
+static
+void bench_results_append(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	bench_results_len += vscnprintf(bench_results + bench_results_len,
+					BENCH_RESULTS_LEN - bench_results_len,
+					fmt, args);
+	va_end(args);
+}
+
+/*
+ * Called with bench_mutex held.
+ */
+static
+int bench_run(const struct bench_config *bconfig)
+{
+	const struct lib_ring_buffer_config *config = bconfig->config;
+	unsigned int i, nr = nr_threads ? : num_online_cpus();
+	struct bench_thread *threads;
+	struct task_struct *reader = NULL;
+	struct completion start;
+	struct channel *chan;
+	unsigned long failed = 0, lost = 0, overrun = 0;
+	u64 duration_ns = 0, cache_misses = 0, events;
+	int cpu, ret = 0;
+
+	if (payload_size > BENCH_MAX_PAYLOAD || !payload_size)
+		return -EINVAL;
+	threads = kcalloc(nr, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+	chan = channel_create(config, "lttng-ring-buffer-benchmark", NULL,
+			      NULL, subbuf_size, num_subbuf, 0,
+			      read_timer_interval);
+	if (!chan) {
+		ret = -EINVAL;
+		goto chan_error;
+	}
+	if (consume) {
+		ret = bench_open_read(config, chan, 1);
+		if (ret)
+			goto open_error;
+		reader = kthread_run(bench_reader, chan, "lttng_rb_bench_rd");
+		if (IS_ERR(reader)) {
+			ret = PTR_ERR(reader);
+			reader = NULL;
+			goto reader_error;
+		}
+	}
+
+	init_completion(&start);
+	cpu = -1;
+	for (i = 0; i < nr; i++) {
+		struct bench_thread *thread = &threads[i];
+
+		thread->chan = chan;
+		thread->start = &start;
+		init_completion(&thread->done);
+		thread->task = kthread_create(bconfig->writer, thread,
+					      "lttng_rb_bench/%u", i);
+		if (IS_ERR(thread->task)) {
+			ret = PTR_ERR(thread->task);
+			thread->task = NULL;
+			break;
+		}
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+		kthread_bind(thread->task, cpu);
+		wake_up_process(thread->task);
+	}
+	complete_all(&start);
+	for (i = 0; i < nr && threads[i].task; i++) {
+		wait_for_completion(&threads[i].done);
+		kthread_stop(threads[i].task);
+		failed += threads[i].failed;
+		duration_ns += threads[i].duration_ns;
+		cache_misses += threads[i].cache_misses;
+	}
+	nr = i;
+
+	if (reader)
+		kthread_stop(reader);
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL) {
+		for_each_channel_cpu(cpu, chan)
+			bench_buffer_stats(config,
+				channel_get_ring_buffer(config, chan, cpu),
+				&lost, &overrun);
+	} else {
+		bench_buffer_stats(config,
+			channel_get_ring_buffer(config, chan, 0),
+			&lost, &overrun);
+	}
+
+	events = (u64) nr * nr_events;
+	if (events) {
+		bench_results_append("%-28s %8u %12llu %10llu %10llu %10lu %10lu %10lu\n",
+			bconfig->name, nr,
+			(unsigned long long) events,
+			(unsigned long long) div64_u64(duration_ns, events),
+			(unsigned long long) div64_u64(cache_misses * 1000, events),
+			lost, overrun, failed);
+	}
+
+reader_error:
+	if (consume)
+		bench_open_read(config, chan, 0);
+open_error:
+	channel_destroy(chan);
+chan_error:
+	kfree(threads);
+	return ret;
+}
+
+static
+ssize_t bench_run_write(struct file *file, const char __user *user_buf,
+			size_t count, loff_t *ppos)
+{
+	char name[64];
+	size_t len = min(count, sizeof(name) - 1);
+	int i, ret = -ENOENT;
+
+	if (copy_from_user(name, user_buf, len))
+		return -EFAULT;
+	name[len] = '\0';
+	strim(name);
+
+	mutex_lock(&bench_mutex);
+	bench_results_len = 0;
+	bench_results_append("%-28s %8s %12s %10s %10s %10s %10s %10s\n",
+			"config", "threads", "events", "ns/event",
+			"miss/kev", "lost", "overrun", "failed");
+	for (i = 0; i < ARRAY_SIZE(bench_configs); i++) {
+		if (strcmp(name, "all") && strcmp(name, bench_configs[i].name))
+			continue;
+		ret = bench_run(&bench_configs[i]);
+		if (ret)
+			break;
+	}
+	mutex_unlock(&bench_mutex);
+	if (ret)
+		return ret;
+	return count;
+}
+
+static
+ssize_t bench_results_read(struct file *file, char __user *user_buf,
+			   size_t count, loff_t *ppos)
+{
+	ssize_t ret;
+
+	mutex_lock(&bench_mutex);
+	ret = simple_read_from_buffer(user_buf, count, ppos, bench_results,
+				      bench_results_len);
+	mutex_unlock(&bench_mutex);
+	return ret;
+}
+
+static
+ssize_t bench_configs_read(struct file *file, char __user *user_buf,
+			   size_t count, loff_t *ppos)
+{
+	char *buf;
+	size_t len = 0;
+	ssize_t ret;
+	int i;
+
+	buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	for (i = 0; i < ARRAY_SIZE(bench_configs); i++)
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%s\n",
+				 bench_configs[i].name);
+	ret = simple_read_from_buffer(user_buf, count, ppos, buf, len);
+	kfree(buf);
+	return ret;
+}
+
+static const struct file_operations bench_run_fops = {
+	.owner = THIS_MODULE,
+	.write = bench_run_write,
+};
+
+static const struct file_operations bench_results_fops = {
+	.owner = THIS_MODULE,
+	.read = bench_results_read,
+};
+
+static const struct file_operations bench_configs_fops = {
+	.owner = THIS_MODULE,
+	.read = bench_configs_read,
+};
+
+static int __init ring_buffer_benchmark_init(void)
+{
+	bench_results = kzalloc(BENCH_RESULTS_LEN, GFP_KERNEL);
+	if (!bench_results)
+		return -ENOMEM;
+	memset(bench_payload, 0x55, sizeof(bench_payload));
+
+	bench_dentry = debugfs_create_dir("lttng-ring-buffer-benchmark", NULL);
+	if (IS_ERR_OR_NULL(bench_dentry))
+		goto error;
+	if (!debugfs_create_file("run", S_IWUSR, bench_dentry, NULL,
+				 &bench_run_fops))
+		goto error;
+	if (!debugfs_create_file("results", S_IRUSR, bench_dentry, NULL,
+				 &bench_results_fops))
+		goto error;
+	if (!debugfs_create_file("configs", S_IRUSR, bench_dentry, NULL,
+				 &bench_configs_fops))
+		goto error;
+	return 0;
+
+error:
+	debugfs_remove_recursive(bench_dentry);
+	kfree(bench_results);
+	return -ENOMEM;
+}
+
+static void __exit ring_buffer_benchmark_exit(void)
+{
+	debugfs_remove_recursive(bench_dentry);
+	kfree(bench_results);
+}
+
+module_init(ring_buffer_benchmark_init);
+module_exit(ring_buffer_benchmark_exit);
+
+MODULE_LICENSE("GPL and additional rights");
+MODULE_AUTHOR("agent <agent@local>");
+MODULE_DESCRIPTION("Ring Buffer Library Benchmark");
+MODULE_VERSION(__stringify(LTTNG_MODULES_MAJOR_VERSION) "."
+	__stringify(LTTNG_MODULES_MINOR_VERSION) "."
+	__stringify(LTTNG_MODULES_PATCHLEVEL_VERSION)
+	LTTNG_MODULES_EXTRAVERSION);
@@ -246,7 +246,7 @@ int lib_ring_buffer_create(struct lib_ring_buffer *buf,
 	smp_wmb();
 	buf->backend.allocated = 1;
 
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL) {
 		CHAN_WARN_ON(chan, cpumask_test_cpu(cpu,
 			     chan->backend.cpumask));
 		cpumask_set_cpu(cpu, chan->backend.cpumask);
@@ -424,6 +424,10 @@ int lib_ring_buffer_cpu_hp_callback(struct notifier_block *nb,
 	case CPU_DOWN_FAILED_FROZEN:
 	case CPU_ONLINE:
 	case CPU_ONLINE_FROZEN:
+		/*
+		 * A single channel poller needs to pick up the new stream:
+		 * wake at most one exclusive waiter.
+		 */
 		wake_up_interruptible(&chan->hp_wait);
 		lib_ring_buffer_start_switch_timer(buf);
 		lib_ring_buffer_start_read_timer(buf);
@@ -576,6 +580,14 @@ static void channel_unregister_notifiers(struct channel *chan)
 			lib_ring_buffer_stop_read_timer(buf);
 		}
 #endif
+	} else if (config->alloc == RING_BUFFER_ALLOC_PER_NODE) {
+		for_each_channel_cpu(cpu, chan) {
+			struct lib_ring_buffer *buf =
+				channel_get_ring_buffer(config, chan, cpu);
+
+			lib_ring_buffer_stop_switch_timer(buf);
+			lib_ring_buffer_stop_read_timer(buf);
+		}
 	} else {
 		struct lib_ring_buffer *buf = chan->backend.buf;
 
@@ -688,6 +700,14 @@ struct channel *channel_create(const struct lib_ring_buffer_config *config,
 			spin_unlock(&per_cpu(ring_buffer_nohz_lock, cpu));
 		}
 #endif
+	} else if (config->alloc == RING_BUFFER_ALLOC_PER_NODE) {
+		for_each_channel_cpu(cpu, chan) {
+			struct lib_ring_buffer *buf =
+				channel_get_ring_buffer(config, chan, cpu);
+
+			lib_ring_buffer_start_switch_timer(buf);
+			lib_ring_buffer_start_read_timer(buf);
+		}
 	} else {
 		struct lib_ring_buffer *buf = chan->backend.buf;
 
@@ -731,14 +751,14 @@ void *channel_destroy(struct channel *chan)
 
 	channel_unregister_notifiers(chan);
 
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL) {
 		/*
 		 * No need to hold cpu hotplug, because all notifiers have been
 		 * unregistered.
 		 */
 		for_each_channel_cpu(cpu, chan) {
-			struct lib_ring_buffer *buf = per_cpu_ptr(chan->backend.buf,
-							      cpu);
+			struct lib_ring_buffer *buf =
+				channel_get_ring_buffer(config, chan, cpu);
 
 			if (config->cb.buffer_finalize)
 				config->cb.buffer_finalize(buf,
@@ -751,7 +771,7 @@ void *channel_destroy(struct channel *chan)
 			 */
 			smp_wmb();
 			ACCESS_ONCE(buf->finalized) = 1;
-			wake_up_interruptible(&buf->read_wait);
+			wake_up_interruptible_all(&buf->read_wait);
 		}
 	} else {
 		struct lib_ring_buffer *buf = chan->backend.buf;
@@ -765,11 +785,15 @@ void *channel_destroy(struct channel *chan)
 		 */
 		smp_wmb();
 		ACCESS_ONCE(buf->finalized) = 1;
-		wake_up_interruptible(&buf->read_wait);
+		wake_up_interruptible_all(&buf->read_wait);
 	}
 	ACCESS_ONCE(chan->finalized) = 1;
-	wake_up_interruptible(&chan->hp_wait);
-	wake_up_interruptible(&chan->read_wait);
+	/*
+	 * Every waiter must observe the hangup, including exclusive
+	 * waiters.
+	 */
+	wake_up_interruptible_all(&chan->hp_wait);
+	wake_up_interruptible_all(&chan->read_wait);
 	priv = chan->backend.priv;
 	kref_put(&chan->ref, channel_release);
 	return priv;
@@ -782,6 +806,8 @@ struct lib_ring_buffer *channel_get_ring_buffer(
 {
 	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL)
 		return chan->backend.buf;
+	else if (config->alloc == RING_BUFFER_ALLOC_PER_NODE)
+		return chan->backend.node_buf[cpu_to_node(cpu)];
 	else
 		return per_cpu_ptr(chan->backend.buf, cpu);
 }
@@ -1109,6 +1135,11 @@ void lib_ring_buffer_put_subbuf(struct lib_ring_buffer *buf)
 	v_set(config, &bufb->array[read_sb_bindex]->records_unread, 0);
 	CHAN_WARN_ON(chan, config->mode == RING_BUFFER_OVERWRITE
 		     && subbuffer_id_is_noref(config, bufb->buf_rsb.id));
+	/*
+	 * Restore the sub-buffer layout while we still have exclusive
+	 * access to it.
+	 */
+	lib_ring_buffer_backend_restore_read_subbuf(bufb);
 	subbuffer_id_set_noref(config, &bufb->buf_rsb.id);
 
 	/*
@@ -1757,6 +1788,8 @@ int lib_ring_buffer_reserve_slow(struct lib_ring_buffer_ctx *ctx)
 
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
 		buf = per_cpu_ptr(chan->backend.buf, ctx->cpu);
+	else if (config->alloc == RING_BUFFER_ALLOC_PER_NODE)
+		buf = chan->backend.node_buf[cpu_to_node(ctx->cpu)];
 	else
 		buf = chan->backend.buf;
 	ctx->buf = buf;
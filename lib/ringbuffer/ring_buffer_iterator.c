@@ -417,7 +417,7 @@ int channel_iterator_init(struct channel *chan)
 			lib_ring_buffer_iterator_init(chan, buf);
 		}
 #endif
-	} else {
+	} else if (config->alloc == RING_BUFFER_ALLOC_GLOBAL) {
 		buf = channel_get_ring_buffer(config, chan, 0);
 		lib_ring_buffer_iterator_init(chan, buf);
 	}
@@ -26,6 +26,8 @@
 #include <linux/module.h>
 #include <linux/fs.h>
 #include <linux/version.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
 
 #include "../../wrapper/splice.h"
 #include "../../wrapper/ringbuffer/backend.h"
@@ -38,6 +40,143 @@
 #define printk_dbg(fmt, args...)
 #endif
 
+/*
+ * Maximum number of free pages kept in each buffer page pool. 0 disables
+ * recycling.
+ */
+static unsigned int splice_page_pool_max = 2 * PIPE_DEF_BUFFERS;
+module_param(splice_page_pool_max, uint, 0644);
+MODULE_PARM_DESC(splice_page_pool_max,
+		 "Maximum number of free pages kept per buffer for splice");
+
+static void lib_ring_buffer_page_pool_free_pages(struct list_head *head)
+{
+	struct page *page, *tmp;
+
+	list_for_each_entry_safe(page, tmp, head, lru) {
+		list_del(&page->lru);
+		__free_page(page);
+	}
+}
+
+static void lib_ring_buffer_page_pool_release(struct kref *kref)
+{
+	struct lib_ring_buffer_page_pool *pool =
+		container_of(kref, struct lib_ring_buffer_page_pool, ref);
+
+	lib_ring_buffer_page_pool_free_pages(&pool->pages);
+	kfree(pool);
+}
+
+int lib_ring_buffer_page_pool_create(struct lib_ring_buffer_backend *bufb)
+{
+	struct lib_ring_buffer_page_pool *pool;
+	int node = cpu_to_node(max(bufb->cpu, 0));
+
+	pool = kzalloc_node(sizeof(*pool), GFP_KERNEL, node);
+	if (!pool)
+		return -ENOMEM;
+	spin_lock_init(&pool->lock);
+	INIT_LIST_HEAD(&pool->pages);
+	pool->node = node;
+	kref_init(&pool->ref);
+	atomic_long_set(&pool->hits, 0);
+	atomic_long_set(&pool->misses, 0);
+	atomic_long_set(&pool->recycled, 0);
+	atomic_long_set(&pool->released, 0);
+	bufb->page_pool = pool;
+	return 0;
+}
+
+/*
+ * Pages still in flight within a pipe keep the pool alive; they are freed
+ * rather than recycled once the pool is dead.
+ */
+void lib_ring_buffer_page_pool_destroy(struct lib_ring_buffer_backend *bufb)
+{
+	struct lib_ring_buffer_page_pool *pool = bufb->page_pool;
+	LIST_HEAD(pages);
+
+	if (!pool)
+		return;
+	spin_lock(&pool->lock);
+	pool->dead = 1;
+	list_splice_init(&pool->pages, &pages);
+	pool->count = 0;
+	spin_unlock(&pool->lock);
+	lib_ring_buffer_page_pool_free_pages(&pages);
+	bufb->page_pool = NULL;
+	kref_put(&pool->ref, lib_ring_buffer_page_pool_release);
+}
+
+/*
+ * Get a page to hand to the pipe: the replacement for the buffer page
+ * moved into it, or the copy destination for page-contig buffers. Both
+ * come back through lib_ring_buffer_page_pool_put() once the pipe is
+ * done with them. Recycled pages are not zeroed: they only ever held
+ * data from this same buffer.
+ */
+static struct page *
+lib_ring_buffer_page_pool_get(struct lib_ring_buffer_page_pool *pool)
+{
+	struct page *page = NULL;
+
+	spin_lock(&pool->lock);
+	if (pool->count) {
+		page = list_first_entry(&pool->pages, struct page, lru);
+		list_del(&page->lru);
+		pool->count--;
+	}
+	spin_unlock(&pool->lock);
+	if (page) {
+		atomic_long_inc(&pool->hits);
+		return page;
+	}
+	atomic_long_inc(&pool->misses);
+	return alloc_pages_node(pool->node, GFP_KERNEL | __GFP_ZERO, 0);
+}
+
+/*
+ * Give back a page released by the pipe, and the pool reference it held.
+ * Only pages we hold the last reference to can be recycled.
+ */
+static void lib_ring_buffer_page_pool_put(struct lib_ring_buffer_page_pool *pool,
+					  struct page *page)
+{
+	int recycled = 0;
+
+	if (page_count(page) == 1) {
+		spin_lock(&pool->lock);
+		if (!pool->dead
+		    && pool->count < ACCESS_ONCE(splice_page_pool_max)) {
+			list_add(&page->lru, &pool->pages);
+			pool->count++;
+			recycled = 1;
+		}
+		spin_unlock(&pool->lock);
+	}
+	if (recycled) {
+		atomic_long_inc(&pool->recycled);
+	} else {
+		atomic_long_inc(&pool->released);
+		__free_page(page);
+	}
+	kref_put(&pool->ref, lib_ring_buffer_page_pool_release);
+}
+
+void lib_ring_buffer_page_pool_stats(struct lib_ring_buffer_backend *bufb,
+				     struct lib_ring_buffer_page_pool_stats *stats)
+{
+	struct lib_ring_buffer_page_pool *pool = bufb->page_pool;
+
+	stats->hits = atomic_long_read(&pool->hits);
+	stats->misses = atomic_long_read(&pool->misses);
+	stats->recycled = atomic_long_read(&pool->recycled);
+	stats->released = atomic_long_read(&pool->released);
+	stats->count = ACCESS_ONCE(pool->count);
+	stats->max = ACCESS_ONCE(splice_page_pool_max);
+}
+
 loff_t vfs_lib_ring_buffer_no_llseek(struct file *file, loff_t offset,
 		int origin)
 {
@@ -52,7 +191,9 @@ EXPORT_SYMBOL_GPL(vfs_lib_ring_buffer_no_llseek);
 static void lib_ring_buffer_pipe_buf_release(struct pipe_inode_info *pipe,
 					     struct pipe_buffer *pbuf)
 {
-	__free_page(pbuf->page);
+	lib_ring_buffer_page_pool_put(
+		(struct lib_ring_buffer_page_pool *) pbuf->private,
+		pbuf->page);
 }
 
 static const struct pipe_buf_operations ring_buffer_pipe_buf_ops = {
@@ -73,7 +214,9 @@ static const struct pipe_buf_operations ring_buffer_pipe_buf_ops = {
 static void lib_ring_buffer_page_release(struct splice_pipe_desc *spd,
 					 unsigned int i)
 {
-	__free_page(spd->pages[i]);
+	lib_ring_buffer_page_pool_put(
+		(struct lib_ring_buffer_page_pool *) spd->partial[i].private,
+		spd->pages[i]);
 }
 
 /*
@@ -88,6 +231,7 @@ static int subbuf_splice_actor(struct file *in,
 {
 	struct channel *chan = buf->backend.chan;
 	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	struct lib_ring_buffer_page_pool *pool = buf->backend.page_pool;
 	unsigned int poff, subbuf_pages, nr_pages;
 	struct page *pages[PIPE_DEF_BUFFERS];
 	struct partial_page partial[PIPE_DEF_BUFFERS];
@@ -126,8 +270,7 @@ static int subbuf_splice_actor(struct file *in,
 
 	for (; spd.nr_pages < nr_pages; spd.nr_pages++) {
 		unsigned int this_len;
-		struct page **page, *new_page;
-		void **virt;
+		struct page *new_page;
 
 		if (!len)
 			break;
@@ -136,21 +279,35 @@ static int subbuf_splice_actor(struct file *in,
 
 		/*
 		 * We have to replace the page we are moving into the splice
-		 * pipe.
+		 * pipe, or copy it for the page-contig backend. Each page in
+		 * flight holds a reference on the pool.
 		 */
-		new_page = alloc_pages_node(cpu_to_node(max(buf->backend.cpu,
-							    0)),
-					    GFP_KERNEL | __GFP_ZERO, 0);
+		new_page = lib_ring_buffer_page_pool_get(pool);
 		if (!new_page)
 			break;
+		kref_get(&pool->ref);
 
 		this_len = PAGE_SIZE - poff;
-		page = lib_ring_buffer_read_get_page(&buf->backend, roffset, &virt);
-		spd.pages[spd.nr_pages] = *page;
-		*page = new_page;
-		*virt = page_address(new_page);
+		if (config->backend == RING_BUFFER_PAGE_CONTIG) {
+			void **virt;
+
+			/*
+			 * Keep the sub-buffer pages, and thus its
+			 * contiguity: hand a copy to the pipe instead.
+			 */
+			lib_ring_buffer_read_get_page(&buf->backend, roffset,
+						      &virt);
+			memcpy(page_address(new_page) + poff, *virt + poff,
+			       this_len);
+			spd.pages[spd.nr_pages] = new_page;
+		} else {
+			spd.pages[spd.nr_pages] =
+				lib_ring_buffer_read_replace_page(&buf->backend,
+							roffset, new_page);
+		}
 		spd.partial[spd.nr_pages].offset = poff;
 		spd.partial[spd.nr_pages].len = this_len;
+		spd.partial[spd.nr_pages].private = (unsigned long) pool;
 
 		poff = 0;
 		roffset += PAGE_SIZE;
@@ -35,6 +35,19 @@ static int put_ulong(unsigned long val, unsigned long arg)
 	return put_user(val, (unsigned long __user *)arg);
 }
 
+static long get_page_pool_stats(struct lib_ring_buffer *buf,
+				unsigned long arg)
+{
+	struct lib_ring_buffer_page_pool_stats stats;
+
+	if (!buf->backend.page_pool)
+		return -EINVAL;
+	lib_ring_buffer_page_pool_stats(&buf->backend, &stats);
+	if (copy_to_user((void __user *) arg, &stats, sizeof(stats)))
+		return -EFAULT;
+	return 0;
+}
+
 #ifdef CONFIG_COMPAT
 static int compat_put_ulong(compat_ulong_t val, unsigned long arg)
 {
@@ -270,6 +283,8 @@ long lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd,
 	case RING_BUFFER_FLUSH:
 		lib_ring_buffer_switch_remote(buf);
 		return 0;
+	case RING_BUFFER_GET_PAGE_POOL_STATS:
+		return get_page_pool_stats(buf, arg);
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -415,6 +430,9 @@ long lib_ring_buffer_compat_ioctl(struct file *filp, unsigned int cmd,
 	case RING_BUFFER_COMPAT_FLUSH:
 		lib_ring_buffer_switch_remote(buf);
 		return 0;
+	case RING_BUFFER_COMPAT_GET_PAGE_POOL_STATS:
+		return get_page_pool_stats(buf,
+				(unsigned long) compat_ptr(arg));
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -68,6 +68,16 @@ ssize_t vfs_lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
 		struct pipe_inode_info *pipe, size_t len,
 		unsigned int flags);
 
+/* Splice replacement page pool counters. */
+struct lib_ring_buffer_page_pool_stats {
+	uint64_t hits;		/* Replacement pages taken from the pool */
+	uint64_t misses;	/* Replacement pages allocated */
+	uint64_t recycled;	/* Released pages kept in the pool */
+	uint64_t released;	/* Released pages freed */
+	uint64_t count;		/* Pages currently in the pool */
+	uint64_t max;		/* Pool size limit */
+};
+
 /*
  * Use RING_BUFFER_GET_NEXT_SUBBUF / RING_BUFFER_PUT_NEXT_SUBBUF to read and
  * consume sub-buffers sequentially.
@@ -115,6 +125,9 @@ ssize_t vfs_lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
 #define RING_BUFFER_FLUSH			_IO(0xF6, 0x0C)
 /* Get the current version of the metadata cache (after a get_next). */
 #define RING_BUFFER_GET_METADATA_VERSION	_IOR(0xF6, 0x0D, uint64_t)
+/* Get the splice page pool counters (splice output only). */
+#define RING_BUFFER_GET_PAGE_POOL_STATS		\
+	_IOR(0xF6, 0x0E, struct lib_ring_buffer_page_pool_stats)
 
 #ifdef CONFIG_COMPAT
 /* Get a snapshot of the current ring buffer producer and consumer positions */
@@ -149,6 +162,7 @@ ssize_t vfs_lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
 #define RING_BUFFER_COMPAT_FLUSH		RING_BUFFER_FLUSH
 /* Get the current version of the metadata cache (after a get_next). */
 #define RING_BUFFER_COMPAT_GET_METADATA_VERSION	RING_BUFFER_GET_METADATA_VERSION
+#define RING_BUFFER_COMPAT_GET_PAGE_POOL_STATS	RING_BUFFER_GET_PAGE_POOL_STATS
 #endif /* CONFIG_COMPAT */
 
 #endif /* _LIB_RING_BUFFER_VFS_H */
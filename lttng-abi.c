@@ -44,12 +44,16 @@
 #include <linux/uaccess.h>
 #include <linux/slab.h>
 #include <linux/err.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
 #include "wrapper/vmalloc.h"	/* for wrapper_vmalloc_sync_all() */
 #include "wrapper/ringbuffer/vfs.h"
 #include "wrapper/ringbuffer/backend.h"
 #include "wrapper/ringbuffer/frontend.h"
 #include "wrapper/poll.h"
 #include "wrapper/file.h"
+#include "wrapper/trace-clock.h"
 #include "lttng-abi.h"
 #include "lttng-abi-old.h"
 #include "lttng-events.h"
@@ -142,6 +146,112 @@ fd_error:
 	return ret;
 }
 
+#ifdef CONFIG_HAVE_TRACE_CLOCK
+static inline
+int lttng_abi_clock(void)
+{
+	return -ENOSYS;
+}
+#else /* CONFIG_HAVE_TRACE_CLOCK */
+/*
+ * Clock page shared by all clock file descriptors, allocated on first
+ * use. The epoch offset is refreshed each time a clock file descriptor
+ * is created.
+ */
+static struct page *lttng_clock_page;
+static DEFINE_MUTEX(lttng_clock_page_mutex);
+
+static
+int lttng_clock_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+	return vm_insert_page(vma, vma->vm_start, lttng_clock_page);
+}
+
+static const struct file_operations lttng_clock_fops = {
+	.owner = THIS_MODULE,
+	.mmap = lttng_clock_mmap,
+};
+
+/* Called with lttng_clock_page_mutex held. */
+static
+void lttng_clock_page_update(struct lttng_kernel_clock_page *clock_page)
+{
+	uint64_t freq, offset_s, offset;
+
+	freq = trace_clock_freq();
+	lttng_measure_clock_offset(freq, &offset_s, &offset);
+	ACCESS_ONCE(clock_page->seq)++;
+	smp_wmb();
+#ifdef LTTNG_TRACE_CLOCK_TSC
+	clock_page->source = lttng_trace_clock_tsc ?
+		LTTNG_KERNEL_CLOCK_TSC : LTTNG_KERNEL_CLOCK_MONOTONIC;
+#else
+	clock_page->source = LTTNG_KERNEL_CLOCK_MONOTONIC;
+#endif
+	clock_page->freq = freq;
+	clock_page->offset_s = offset_s;
+	clock_page->offset = offset;
+	if (trace_clock_uuid(clock_page->uuid))
+		clock_page->uuid[0] = '\0';
+	smp_wmb();
+	ACCESS_ONCE(clock_page->seq)++;
+}
+
+static
+int lttng_abi_clock(void)
+{
+	struct file *clock_file;
+	int clock_fd, ret;
+
+	mutex_lock(&lttng_clock_page_mutex);
+	if (!lttng_clock_page) {
+		lttng_clock_page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (!lttng_clock_page) {
+			ret = -ENOMEM;
+			goto page_error;
+		}
+	}
+	lttng_clock_page_update(page_address(lttng_clock_page));
+	mutex_unlock(&lttng_clock_page_mutex);
+
+	clock_fd = lttng_get_unused_fd();
+	if (clock_fd < 0) {
+		ret = clock_fd;
+		goto fd_error;
+	}
+	clock_file = anon_inode_getfile("[lttng_clock]",
+					&lttng_clock_fops,
+					NULL, O_RDONLY);
+	if (IS_ERR(clock_file)) {
+		ret = PTR_ERR(clock_file);
+		goto file_error;
+	}
+	fd_install(clock_fd, clock_file);
+	return clock_fd;
+
+file_error:
+	put_unused_fd(clock_fd);
+fd_error:
+	return ret;
+
+page_error:
+	mutex_unlock(&lttng_clock_page_mutex);
+	return ret;
+}
+
+static
+void lttng_abi_clock_exit(void)
+{
+	if (lttng_clock_page)
+		__free_page(lttng_clock_page);
+}
+#endif /* CONFIG_HAVE_TRACE_CLOCK */
+
 #ifndef CONFIG_HAVE_SYSCALL_TRACEPOINTS
 static inline
 int lttng_abi_syscall_list(void)
@@ -198,6 +308,37 @@ void lttng_abi_tracer_abi_version(struct lttng_kernel_tracer_abi_version *v)
 	v->minor = LTTNG_MODULES_ABI_MINOR_VERSION;
 }
 
+static
+long lttng_abi_add_perf_counter_group(
+		struct lttng_kernel_perf_counter_group_ctx *param,
+		struct lttng_ctx **ctx)
+{
+	struct lttng_kernel_perf_counter_ctx *counters;
+	unsigned int i;
+	size_t len;
+	long ret;
+
+	if (!param->nr_counters
+			|| param->nr_counters > LTTNG_KERNEL_PERF_COUNTER_GROUP_MAX)
+		return -EINVAL;
+	len = param->nr_counters * sizeof(*counters);
+	counters = kmalloc(len, GFP_KERNEL);
+	if (!counters)
+		return -ENOMEM;
+	if (copy_from_user(counters,
+			(void __user *) (unsigned long) param->counters, len)) {
+		ret = -EFAULT;
+		goto end;
+	}
+	for (i = 0; i < param->nr_counters; i++)
+		counters[i].name[LTTNG_KERNEL_SYM_NAME_LEN - 1] = '\0';
+	ret = lttng_add_perf_counter_group_to_ctx(counters,
+			param->nr_counters, ctx);
+end:
+	kfree(counters);
+	return ret;
+}
+
 static
 long lttng_abi_add_context(struct file *file,
 	struct lttng_kernel_context *context_param,
@@ -230,6 +371,9 @@ long lttng_abi_add_context(struct file *file,
 				context_param->u.perf_counter.config,
 				context_param->u.perf_counter.name,
 				ctx);
+	case LTTNG_KERNEL_CONTEXT_PERF_COUNTER_GROUP:
+		return lttng_abi_add_perf_counter_group(
+				&context_param->u.perf_counter_group, ctx);
 	case LTTNG_KERNEL_CONTEXT_PROCNAME:
 		return lttng_add_procname_to_ctx(ctx);
 	case LTTNG_KERNEL_CONTEXT_HOSTNAME:
@@ -259,6 +403,9 @@ long lttng_abi_add_context(struct file *file,
  *		Returns after all previously running probes have completed
  *	LTTNG_KERNEL_TRACER_ABI_VERSION
  *		Returns the LTTng kernel tracer ABI version
+ *	LTTNG_KERNEL_CLOCK
+ *		Returns a LTTng clock file descriptor, which can be mapped
+ *		to read the trace clock parameters
  *
  * The returned session will be deleted when its file descriptor is closed.
  */
@@ -314,6 +461,8 @@ long lttng_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		return lttng_abi_tracepoint_list();
 	case LTTNG_KERNEL_SYSCALL_LIST:
 		return lttng_abi_syscall_list();
+	case LTTNG_KERNEL_CLOCK:
+		return lttng_abi_clock();
 	case LTTNG_KERNEL_OLD_WAIT_QUIESCENT:
 	case LTTNG_KERNEL_WAIT_QUIESCENT:
 		synchronize_trace();
@@ -397,13 +546,55 @@ int lttng_abi_create_channel(struct file *session_file,
 	}
 	switch (channel_type) {
 	case PER_CPU_CHANNEL:
-		if (chan_param->output == LTTNG_KERNEL_SPLICE) {
-			transport_name = chan_param->overwrite ?
-				"relay-overwrite" : "relay-discard";
-		} else if (chan_param->output == LTTNG_KERNEL_MMAP) {
-			transport_name = chan_param->overwrite ?
-				"relay-overwrite-mmap" : "relay-discard-mmap";
-		} else {
+		switch (chan_param->alloc) {
+		case LTTNG_KERNEL_BUFFER_ALLOC_PER_CPU:
+			break;
+		case LTTNG_KERNEL_BUFFER_ALLOC_PER_NODE:
+			if (chan_param->backend != LTTNG_KERNEL_BUFFER_PAGE
+			    || chan_param->output != LTTNG_KERNEL_SPLICE)
+				return -EINVAL;
+			break;
+		default:
+			return -EINVAL;
+		}
+		switch (chan_param->backend) {
+		case LTTNG_KERNEL_BUFFER_PAGE:
+			if (chan_param->alloc == LTTNG_KERNEL_BUFFER_ALLOC_PER_NODE) {
+				transport_name = chan_param->overwrite ?
+					"relay-overwrite-pernode" : "relay-discard-pernode";
+			} else if (chan_param->output == LTTNG_KERNEL_SPLICE) {
+				transport_name = chan_param->overwrite ?
+					"relay-overwrite" : "relay-discard";
+			} else if (chan_param->output == LTTNG_KERNEL_MMAP) {
+				transport_name = chan_param->overwrite ?
+					"relay-overwrite-mmap" : "relay-discard-mmap";
+			} else {
+				return -EINVAL;
+			}
+			break;
+		case LTTNG_KERNEL_BUFFER_VMAP:
+			if (chan_param->output == LTTNG_KERNEL_SPLICE) {
+				transport_name = chan_param->overwrite ?
+					"relay-overwrite-vmap" : "relay-discard-vmap";
+			} else if (chan_param->output == LTTNG_KERNEL_MMAP) {
+				transport_name = chan_param->overwrite ?
+					"relay-overwrite-mmap-vmap" : "relay-discard-mmap-vmap";
+			} else {
+				return -EINVAL;
+			}
+			break;
+		case LTTNG_KERNEL_BUFFER_PAGE_CONTIG:
+			if (chan_param->output == LTTNG_KERNEL_SPLICE) {
+				transport_name = chan_param->overwrite ?
+					"relay-overwrite-contig" : "relay-discard-contig";
+			} else if (chan_param->output == LTTNG_KERNEL_MMAP) {
+				transport_name = chan_param->overwrite ?
+					"relay-overwrite-mmap-contig" : "relay-discard-mmap-contig";
+			} else {
+				return -EINVAL;
+			}
+			break;
+		default:
 			return -EINVAL;
 		}
 		break;
@@ -448,6 +639,39 @@ fd_error:
 	return ret;
 }
 
+static
+long lttng_abi_session_tracker_ids(struct lttng_session *session,
+		struct lttng_kernel_tracker_ids __user *uparam, int track)
+{
+	struct lttng_kernel_tracker_ids param;
+	uint64_t *ids;
+	size_t len;
+	long ret;
+
+	if (copy_from_user(&param, uparam, sizeof(param)))
+		return -EFAULT;
+	if (!param.nr_ids || param.nr_ids > LTTNG_KERNEL_TRACKER_IDS_MAX)
+		return -EINVAL;
+	len = param.nr_ids * sizeof(uint64_t);
+	ids = vmalloc(len);
+	if (!ids)
+		return -ENOMEM;
+	if (copy_from_user(ids, (void __user *) (unsigned long) param.ids,
+			len)) {
+		ret = -EFAULT;
+		goto end;
+	}
+	if (track)
+		ret = lttng_session_track_ids(session, param.type,
+				ids, param.nr_ids);
+	else
+		ret = lttng_session_untrack_ids(session, param.type,
+				ids, param.nr_ids);
+end:
+	vfree(ids);
+	return ret;
+}
+
 /**
  *	lttng_session_ioctl - lttng session fd ioctl
  *
@@ -468,6 +692,16 @@ fd_error:
  *		Add PID to session tracker
  *	LTTNG_KERNEL_SESSION_UNTRACK_PID
  *		Remove PID from session tracker
+ *	LTTNG_KERNEL_SESSION_TRACK_IDS
+ *		Add an array of PIDs, TGIDs or cgroups to session tracker
+ *	LTTNG_KERNEL_SESSION_UNTRACK_IDS
+ *		Remove an array of ids from session tracker
+ *	LTTNG_KERNEL_SESSION_STATEDUMP_WAIT
+ *		Wait for the statedump started with the session to complete,
+ *		returns its result
+ *	LTTNG_KERNEL_SESSION_STATEDUMP_VM_MAPS
+ *		Enable (arg != 0) or disable process memory maps in the
+ *		session statedump
  *
  * The returned channel will be deleted when its file descriptor is closed.
  */
@@ -492,6 +726,8 @@ long lttng_session_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		chan_param.switch_timer_interval = old_chan_param.switch_timer_interval;
 		chan_param.read_timer_interval = old_chan_param.read_timer_interval;
 		chan_param.output = old_chan_param.output;
+		chan_param.backend = LTTNG_KERNEL_BUFFER_PAGE;
+		chan_param.alloc = LTTNG_KERNEL_BUFFER_ALLOC_PER_CPU;
 
 		return lttng_abi_create_channel(file, &chan_param,
 				PER_CPU_CHANNEL);
@@ -532,6 +768,8 @@ long lttng_session_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		chan_param.switch_timer_interval = old_chan_param.switch_timer_interval;
 		chan_param.read_timer_interval = old_chan_param.read_timer_interval;
 		chan_param.output = old_chan_param.output;
+		chan_param.backend = LTTNG_KERNEL_BUFFER_PAGE;
+		chan_param.alloc = LTTNG_KERNEL_BUFFER_ALLOC_PER_CPU;
 
 		return lttng_abi_create_channel(file, &chan_param,
 				METADATA_CHANNEL);
@@ -555,6 +793,16 @@ long lttng_session_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		return lttng_session_list_tracker_pids(session);
 	case LTTNG_KERNEL_SESSION_METADATA_REGEN:
 		return lttng_session_metadata_regenerate(session);
+	case LTTNG_KERNEL_SESSION_STATEDUMP_WAIT:
+		return lttng_statedump_wait(session);
+	case LTTNG_KERNEL_SESSION_STATEDUMP_VM_MAPS:
+		return lttng_session_statedump_vm_maps(session, (int) arg);
+	case LTTNG_KERNEL_SESSION_TRACK_IDS:
+		return lttng_abi_session_tracker_ids(session,
+			(struct lttng_kernel_tracker_ids __user *) arg, 1);
+	case LTTNG_KERNEL_SESSION_UNTRACK_IDS:
+		return lttng_abi_session_tracker_ids(session,
+			(struct lttng_kernel_tracker_ids __user *) arg, 0);
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -578,9 +826,25 @@ int lttng_session_release(struct inode *inode, struct file *file)
 	return 0;
 }
 
+/*
+ * The session file is readable when no statedump is in progress.
+ */
+static
+unsigned int lttng_session_poll(struct file *file, poll_table *wait)
+{
+	struct lttng_session *session = file->private_data;
+	unsigned int mask = 0;
+
+	poll_wait(file, &session->statedump.wait, wait);
+	if (!ACCESS_ONCE(session->statedump.running))
+		mask |= POLLIN | POLLRDNORM;
+	return mask;
+}
+
 static const struct file_operations lttng_session_fops = {
 	.owner = THIS_MODULE,
 	.release = lttng_session_release,
+	.poll = lttng_session_poll,
 	.unlocked_ioctl = lttng_session_ioctl,
 #ifdef CONFIG_COMPAT
 	.compat_ioctl = lttng_session_ioctl,
@@ -618,11 +882,9 @@ unsigned int lttng_metadata_ring_buffer_poll(struct file *filp,
 		if (finalized)
 			mask |= POLLHUP;
 
-		mutex_lock(&stream->metadata_cache->lock);
-		if (stream->metadata_cache->metadata_written >
+		if (ACCESS_ONCE(stream->metadata_cache->metadata_written) >
 				stream->metadata_out)
 			mask |= POLLIN;
-		mutex_unlock(&stream->metadata_cache->lock);
 	}
 
 	return mask;
@@ -985,6 +1247,9 @@ int lttng_abi_create_event(struct file *channel_file,
 	default:
 		break;
 	}
+	ret = lttng_sampling_validate(event_param);
+	if (ret)
+		goto fd_error;
 	event_fd = lttng_get_unused_fd();
 	if (event_fd < 0) {
 		ret = event_fd;
@@ -1040,6 +1305,45 @@ fd_error:
 	return ret;
 }
 
+/*
+ * Open the return event of a kretprobe event. It shares the probe of its
+ * entry event, but has its own filters and counters.
+ */
+static
+int lttng_abi_open_kretprobe_return(struct lttng_event *event)
+{
+	struct lttng_event *event_return;
+	int event_fd, ret;
+	struct file *event_file;
+
+	if (event->instrumentation != LTTNG_KERNEL_KRETPROBE)
+		return -EINVAL;
+	event_return = lttng_kretprobes_return_event(event);
+	if (!event_return || event_return == event)
+		return -EINVAL;
+	event_fd = lttng_get_unused_fd();
+	if (event_fd < 0) {
+		ret = event_fd;
+		goto fd_error;
+	}
+	event_file = anon_inode_getfile("[lttng_event]",
+					&lttng_event_fops,
+					event_return, O_RDWR);
+	if (IS_ERR(event_file)) {
+		ret = PTR_ERR(event_file);
+		goto file_error;
+	}
+	fd_install(event_fd, event_file);
+	/* The event holds a reference on the channel */
+	atomic_long_inc(&event_return->chan->file->f_count);
+	return event_fd;
+
+file_error:
+	put_unused_fd(event_fd);
+fd_error:
+	return ret;
+}
+
 /**
  *	lttng_channel_ioctl - lttng syscall through ioctl
  *
@@ -1101,6 +1405,8 @@ long lttng_channel_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 				sizeof(uevent_param->name));
 		uevent_param->instrumentation =
 			old_uevent_param->instrumentation;
+		memset(&uevent_param->sampling, 0,
+			sizeof(uevent_param->sampling));
 
 		switch (old_uevent_param->instrumentation) {
 		case LTTNG_KERNEL_KPROBE:
@@ -1111,6 +1417,8 @@ long lttng_channel_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			memcpy(uevent_param->u.kprobe.symbol_name,
 				old_uevent_param->u.kprobe.symbol_name,
 				sizeof(uevent_param->u.kprobe.symbol_name));
+			uevent_param->u.kprobe.fetch = 0;
+			uevent_param->u.kprobe.nr_fetch = 0;
 			break;
 		case LTTNG_KERNEL_KRETPROBE:
 			uevent_param->u.kretprobe.addr =
@@ -1120,6 +1428,7 @@ long lttng_channel_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			memcpy(uevent_param->u.kretprobe.symbol_name,
 				old_uevent_param->u.kretprobe.symbol_name,
 				sizeof(uevent_param->u.kretprobe.symbol_name));
+			uevent_param->u.kretprobe.maxactive = 0;
 			break;
 		case LTTNG_KERNEL_FUNCTION:
 			memcpy(uevent_param->u.ftrace.symbol_name,
@@ -1334,6 +1643,16 @@ static const struct file_operations lttng_metadata_fops = {
  *		Enable recording for this event (weak enable)
  *	LTTNG_KERNEL_DISABLE
  *		Disable recording for this event (strong disable)
+ *	LTTNG_KERNEL_FILTER
+ *		Attach a filter bytecode to this event
+ *	LTTNG_KERNEL_EVENT_GET_NMISSED
+ *		Get the number of probe hits missed by this kprobe or
+ *		kretprobe event
+ *	LTTNG_KERNEL_EVENT_GET_STATS
+ *		Get the hit, filtered and discarded counters of this event
+ *	LTTNG_KERNEL_KRETPROBE_RETURN
+ *		Returns the return event file descriptor of this kretprobe
+ *		event, or failure.
  */
 static
 long lttng_event_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
@@ -1382,15 +1701,50 @@ long lttng_event_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case LTTNG_KERNEL_FILTER:
 		switch (*evtype) {
 		case LTTNG_TYPE_EVENT:
-			return -EINVAL;
+			event = file->private_data;
+			return lttng_event_attach_bytecode(event,
+				(struct lttng_kernel_filter_bytecode __user *) arg);
 		case LTTNG_TYPE_ENABLER:
 		{
 			enabler = file->private_data;
 			return lttng_enabler_attach_bytecode(enabler,
 				(struct lttng_kernel_filter_bytecode __user *) arg);
 		}
-
+		default:
+			WARN_ON_ONCE(1);
+			return -ENOSYS;
 		}
+	case LTTNG_KERNEL_EVENT_GET_NMISSED:
+	{
+		uint64_t nmissed;
+		int ret;
+
+		if (*evtype != LTTNG_TYPE_EVENT)
+			return -EINVAL;
+		event = file->private_data;
+		ret = lttng_event_get_nmissed(event, &nmissed);
+		if (ret)
+			return ret;
+		return put_user(nmissed, (uint64_t __user *) arg);
+	}
+	case LTTNG_KERNEL_EVENT_GET_STATS:
+	{
+		struct lttng_kernel_event_stats stats;
+
+		if (*evtype != LTTNG_TYPE_EVENT)
+			return -EINVAL;
+		event = file->private_data;
+		lttng_event_get_stats(event, &stats);
+		if (copy_to_user((struct lttng_kernel_event_stats __user *) arg,
+				&stats, sizeof(stats)))
+			return -EFAULT;
+		return 0;
+	}
+	case LTTNG_KERNEL_KRETPROBE_RETURN:
+		if (*evtype != LTTNG_TYPE_EVENT)
+			return -EINVAL;
+		event = file->private_data;
+		return lttng_abi_open_kretprobe_return(event);
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -1695,4 +2049,7 @@ void lttng_abi_exit(void)
 {
 	if (lttng_proc_dentry)
 		remove_proc_entry("lttng", NULL);
+#ifndef CONFIG_HAVE_TRACE_CLOCK
+	lttng_abi_clock_exit();
+#endif
 }
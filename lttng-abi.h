@@ -51,10 +51,26 @@ enum lttng_kernel_output {
 	LTTNG_KERNEL_MMAP	= 1,
 };
 
+enum lttng_kernel_buffer_backend {
+	LTTNG_KERNEL_BUFFER_PAGE	= 0,
+	LTTNG_KERNEL_BUFFER_VMAP	= 1,
+	LTTNG_KERNEL_BUFFER_PAGE_CONTIG	= 2,
+};
+
+/*
+ * Per-node channels have one stream per NUMA node, whose packets carry the
+ * cpu_id of the first CPU of the node. Add the cpu_id context to know which
+ * CPU recorded each event.
+ */
+enum lttng_kernel_buffer_alloc {
+	LTTNG_KERNEL_BUFFER_ALLOC_PER_CPU	= 0,
+	LTTNG_KERNEL_BUFFER_ALLOC_PER_NODE	= 1,	/* page backend, splice */
+};
+
 /*
  * LTTng DebugFS ABI structures.
  */
-#define LTTNG_KERNEL_CHANNEL_PADDING	LTTNG_KERNEL_SYM_NAME_LEN + 32
+#define LTTNG_KERNEL_CHANNEL_PADDING	LTTNG_KERNEL_SYM_NAME_LEN + 24
 struct lttng_kernel_channel {
 	uint64_t subbuf_size;			/* in bytes */
 	uint64_t num_subbuf;
@@ -62,24 +78,61 @@ struct lttng_kernel_channel {
 	unsigned int read_timer_interval;	/* usecs */
 	enum lttng_kernel_output output;	/* splice, mmap */
 	int overwrite;				/* 1: overwrite, 0: discard */
+	enum lttng_kernel_buffer_backend backend;	/* page, vmap, page-contig */
+	enum lttng_kernel_buffer_alloc alloc;	/* per-cpu, per-node */
 	char padding[LTTNG_KERNEL_CHANNEL_PADDING];
 } __attribute__((packed));
 
+/*
+ * maxactive is the number of return instances allocated: 0 selects a
+ * default scaled on the number of online CPUs.
+ */
 struct lttng_kernel_kretprobe {
 	uint64_t addr;
 
 	uint64_t offset;
 	char symbol_name[LTTNG_KERNEL_SYM_NAME_LEN];
+	uint32_t maxactive;
+} __attribute__((packed));
+
+enum lttng_kernel_kprobe_fetch_type {
+	LTTNG_KERNEL_KPROBE_FETCH_REGISTER	= 0,	/* argument register */
+	LTTNG_KERNEL_KPROBE_FETCH_STACK		= 1,	/* kernel stack slot */
+	LTTNG_KERNEL_KPROBE_FETCH_DEREF		= 2,	/* *(argument + offset) */
+	LTTNG_KERNEL_KPROBE_FETCH_USER_STRING	= 3,	/* user string at argument + offset */
+};
+
+#define LTTNG_KERNEL_KPROBE_FETCH_NAME_LEN	32
+#define LTTNG_KERNEL_KPROBE_FETCH_MAX		16
+
+/*
+ * Kprobe argument capture. index is the function argument number, or
+ * the stack slot for LTTNG_KERNEL_KPROBE_FETCH_STACK. size (1, 2, 4 or 8
+ * bytes) and is_signed describe integers. Each fetch becomes a field of
+ * the event payload, after ip. The names ip and arg0 to arg7 are taken
+ * by the filter fields.
+ */
+struct lttng_kernel_kprobe_fetch {
+	char name[LTTNG_KERNEL_KPROBE_FETCH_NAME_LEN];	/* field name */
+	enum lttng_kernel_kprobe_fetch_type type;
+	uint32_t index;
+	int64_t offset;
+	uint32_t size;
+	uint32_t is_signed;
 } __attribute__((packed));
 
 /*
  * Either addr is used, or symbol_name and offset.
+ * fetch is a user-space pointer to an array of nr_fetch
+ * struct lttng_kernel_kprobe_fetch, or 0.
  */
 struct lttng_kernel_kprobe {
 	uint64_t addr;
 
 	uint64_t offset;
 	char symbol_name[LTTNG_KERNEL_SYM_NAME_LEN];
+	uint64_t fetch;
+	uint32_t nr_fetch;
 } __attribute__((packed));
 
 struct lttng_kernel_function_tracer {
@@ -89,11 +142,27 @@ struct lttng_kernel_function_tracer {
 /*
  * For syscall tracing, name = "*" means "enable all".
  */
-#define LTTNG_KERNEL_EVENT_PADDING1	16
+enum lttng_kernel_sampling_type {
+	LTTNG_KERNEL_SAMPLING_NONE		= 0,
+	LTTNG_KERNEL_SAMPLING_PERIOD		= 1,	/* Record 1 in value hits */
+	LTTNG_KERNEL_SAMPLING_RATE		= 2,	/* At most value hits/s */
+};
+
+/*
+ * Sampling is applied per CPU, for tracepoint, kprobe, kretprobe and
+ * function tracer events.
+ */
+struct lttng_kernel_event_sampling {
+	enum lttng_kernel_sampling_type type;
+	uint64_t value;
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_EVENT_PADDING1	4
 #define LTTNG_KERNEL_EVENT_PADDING2	LTTNG_KERNEL_SYM_NAME_LEN + 32
 struct lttng_kernel_event {
 	char name[LTTNG_KERNEL_SYM_NAME_LEN];	/* event name */
 	enum lttng_kernel_instrumentation instrumentation;
+	struct lttng_kernel_event_sampling sampling;
 	char padding[LTTNG_KERNEL_EVENT_PADDING1];
 
 	/* Per instrumentation type configuration */
@@ -142,6 +211,7 @@ enum lttng_kernel_context_type {
 	LTTNG_KERNEL_CONTEXT_VPPID		= 9,
 	LTTNG_KERNEL_CONTEXT_HOSTNAME		= 10,
 	LTTNG_KERNEL_CONTEXT_CPU_ID		= 11,
+	LTTNG_KERNEL_CONTEXT_PERF_COUNTER_GROUP	= 12,
 };
 
 struct lttng_kernel_perf_counter_ctx {
@@ -150,6 +220,17 @@ struct lttng_kernel_perf_counter_ctx {
 	char name[LTTNG_KERNEL_SYM_NAME_LEN];
 } __attribute__((packed));
 
+/*
+ * Counters read together on each event, and recorded as consecutive
+ * uint64_t context fields. counters points to an array of nr_counters
+ * struct lttng_kernel_perf_counter_ctx.
+ */
+#define LTTNG_KERNEL_PERF_COUNTER_GROUP_MAX	8
+struct lttng_kernel_perf_counter_group_ctx {
+	uint64_t counters;			/* User-space pointer */
+	uint32_t nr_counters;
+} __attribute__((packed));
+
 #define LTTNG_KERNEL_CONTEXT_PADDING1	16
 #define LTTNG_KERNEL_CONTEXT_PADDING2	LTTNG_KERNEL_SYM_NAME_LEN + 32
 struct lttng_kernel_context {
@@ -158,10 +239,43 @@ struct lttng_kernel_context {
 
 	union {
 		struct lttng_kernel_perf_counter_ctx perf_counter;
+		struct lttng_kernel_perf_counter_group_ctx perf_counter_group;
 		char padding[LTTNG_KERNEL_CONTEXT_PADDING2];
 	} u;
 } __attribute__((packed));
 
+/*
+ * Event counters summed over all CPUs. Events recorded are hit minus
+ * pid_filtered, sampled_out, filtered and discarded.
+ */
+#define LTTNG_KERNEL_EVENT_STATS_PADDING	24
+struct lttng_kernel_event_stats {
+	uint64_t hit;
+	uint64_t pid_filtered;
+	uint64_t filtered;
+	uint64_t discarded;
+	uint64_t sampled_out;
+	char padding[LTTNG_KERNEL_EVENT_STATS_PADDING];
+} __attribute__((packed));
+
+enum lttng_kernel_tracker_type {
+	LTTNG_KERNEL_TRACKER_PID		= 0,	/* Thread ID */
+	LTTNG_KERNEL_TRACKER_TGID		= 1,	/* Process ID */
+	LTTNG_KERNEL_TRACKER_CGROUP		= 2,	/* cgroup v2 inode number */
+};
+
+/*
+ * Bulk update of the session tracker: ids points to an array of nr_ids
+ * uint64_t. All ids of a tracker have the same type, which can only be
+ * changed while it is empty.
+ */
+#define LTTNG_KERNEL_TRACKER_IDS_MAX		65536
+struct lttng_kernel_tracker_ids {
+	uint64_t ids;				/* User-space pointer */
+	uint32_t nr_ids;
+	enum lttng_kernel_tracker_type type;
+} __attribute__((packed));
+
 #define LTTNG_KERNEL_FILTER_BYTECODE_MAX_LEN		65536
 struct lttng_kernel_filter_bytecode {
 	uint32_t len;
@@ -170,6 +284,29 @@ struct lttng_kernel_filter_bytecode {
 	char data[0];
 } __attribute__((packed));
 
+enum lttng_kernel_clock_source {
+	LTTNG_KERNEL_CLOCK_MONOTONIC		= 0,	/* clock_gettime(CLOCK_MONOTONIC) */
+	LTTNG_KERNEL_CLOCK_TSC			= 1,	/* rdtsc */
+};
+
+/*
+ * Read-only page mapped from the file descriptor returned by
+ * LTTNG_KERNEL_CLOCK, describing the kernel trace clock. Values read
+ * from the clock source are directly comparable with kernel event
+ * timestamps. It is read like a seqlock: retry while seq is odd, or if
+ * it changed across the read.
+ */
+#define LTTNG_KERNEL_CLOCK_UUID_LEN		37
+struct lttng_kernel_clock_page {
+	uint32_t seq;
+	uint32_t source;			/* enum lttng_kernel_clock_source */
+	uint64_t freq;				/* Hz */
+	/* Offset from Epoch: offset_s + offset * (1 / freq) */
+	uint64_t offset_s;
+	uint64_t offset;
+	char uuid[LTTNG_KERNEL_CLOCK_UUID_LEN];	/* Clock uuid, or empty */
+} __attribute__((packed));
+
 /* LTTng file descriptor ioctl */
 #define LTTNG_KERNEL_SESSION			_IO(0xF6, 0x45)
 #define LTTNG_KERNEL_TRACER_VERSION		\
@@ -181,6 +318,7 @@ struct lttng_kernel_filter_bytecode {
 #define LTTNG_KERNEL_SYSCALL_LIST		_IO(0xF6, 0x4A)
 #define LTTNG_KERNEL_TRACER_ABI_VERSION		\
 	_IOR(0xF6, 0x4B, struct lttng_kernel_tracer_abi_version)
+#define LTTNG_KERNEL_CLOCK			_IO(0xF6, 0x4C)
 
 /* Session FD ioctl */
 #define LTTNG_KERNEL_METADATA			\
@@ -195,6 +333,13 @@ struct lttng_kernel_filter_bytecode {
 	_IOR(0xF6, 0x59, int32_t)
 #define LTTNG_KERNEL_SESSION_LIST_TRACKER_PIDS	_IO(0xF6, 0x58)
 #define LTTNG_KERNEL_SESSION_METADATA_REGEN	_IO(0xF6, 0x59)
+#define LTTNG_KERNEL_SESSION_STATEDUMP_WAIT	_IO(0xF6, 0x5A)
+#define LTTNG_KERNEL_SESSION_STATEDUMP_VM_MAPS	\
+	_IOR(0xF6, 0x5B, int32_t)
+#define LTTNG_KERNEL_SESSION_TRACK_IDS		\
+	_IOW(0xF6, 0x5C, struct lttng_kernel_tracker_ids)
+#define LTTNG_KERNEL_SESSION_UNTRACK_IDS	\
+	_IOW(0xF6, 0x5D, struct lttng_kernel_tracker_ids)
 
 /* Channel FD ioctl */
 #define LTTNG_KERNEL_STREAM			_IO(0xF6, 0x62)
@@ -213,6 +358,12 @@ struct lttng_kernel_filter_bytecode {
 
 /* Event FD ioctl */
 #define LTTNG_KERNEL_FILTER			_IO(0xF6, 0x90)
+/* Number of probe hits missed by a kprobe or kretprobe event */
+#define LTTNG_KERNEL_EVENT_GET_NMISSED		_IOR(0xF6, 0x91, uint64_t)
+#define LTTNG_KERNEL_EVENT_GET_STATS		\
+	_IOR(0xF6, 0x92, struct lttng_kernel_event_stats)
+/* Return event of a kretprobe event, with its own filters and counters */
+#define LTTNG_KERNEL_KRETPROBE_RETURN		_IO(0xF6, 0x93)
 
 /* LTTng-specific ioctls for the lib ringbuffer */
 /* returns the timestamp begin of the current sub-buffer */
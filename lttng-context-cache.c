@@ -0,0 +1,81 @@
+/*
+ * lttng-context-cache.c
+ *
+ * LTTng per-CPU cache of the current task context values.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; only
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/percpu.h>
+#include <linux/rcupdate.h>
+#include "lttng-events.h"
+
+/*
+ * The cache of each CPU holds the values of the last task which recorded
+ * them on this CPU. The vpid, vtid, ppid and vppid of a task only change:
+ * - on exec by a thread other than the group leader, which takes over
+ *   the leader pid: the tid of the task changes,
+ * - when it is reparented, after its parent exits: its real_parent
+ *   changes, to a task other than the exiting parent.
+ * An entry is thus keyed on the task, its tid and its real_parent, all
+ * read from current without shared state. A task_struct reused by a new
+ * task only matches with the same tid and parent, after a pid wrap
+ * around, without any other task recording on this CPU meanwhile.
+ */
+DEFINE_PER_CPU(struct lttng_ctx_cache, lttng_ctx_cache);
+EXPORT_PER_CPU_SYMBOL_GPL(lttng_ctx_cache);
+
+/*
+ * Slow path of lttng_ctx_cache_get(). Called with preemption disabled,
+ * possibly nested over another fill on the same CPU (interrupt or NMI):
+ * the task is cleared first so the nested lookup misses, and both
+ * store the values of the same task.
+ */
+struct lttng_ctx_cache *lttng_ctx_cache_fill(struct lttng_ctx_cache *cache)
+{
+	struct task_struct *parent;
+
+	cache->task = NULL;
+	barrier();
+	/*
+	 * current nsproxy can be NULL when scheduled out of exit. pid_vnr
+	 * uses the current thread nsproxy to perform the lookup.
+	 */
+	if (!current->nsproxy) {
+		cache->vpid = 0;
+		cache->vtid = 0;
+	} else {
+		cache->vpid = task_tgid_vnr(current);
+		cache->vtid = task_pid_vnr(current);
+	}
+	rcu_read_lock();
+	parent = rcu_dereference(current->real_parent);
+	cache->ppid = task_tgid_nr(parent);
+	if (!current->nsproxy)
+		cache->vppid = 0;
+	else
+		cache->vppid = task_tgid_vnr(parent);
+	rcu_read_unlock();
+	cache->real_parent = parent;
+	cache->pid = current->pid;
+	barrier();
+	cache->task = current;
+	return cache;
+}
+EXPORT_SYMBOL_GPL(lttng_ctx_cache_fill);
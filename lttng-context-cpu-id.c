@@ -78,6 +78,7 @@ int lttng_add_cpu_id_to_ctx(struct lttng_ctx **ctx)
 	field->event_field.type.u.basic.integer.encoding = lttng_encode_none;
 	field->get_size = cpu_id_get_size;
 	field->record = cpu_id_record;
+	field->record_type = LTTNG_CTX_RECORD_CPU_ID;
 	field->get_value = cpu_id_get_value;
 	lttng_context_update(*ctx);
 	wrapper_vmalloc_sync_all();
@@ -78,6 +78,7 @@ int lttng_add_nice_to_ctx(struct lttng_ctx **ctx)
 	field->event_field.type.u.basic.integer.encoding = lttng_encode_none;
 	field->get_size = nice_get_size;
 	field->record = nice_record;
+	field->record_type = LTTNG_CTX_RECORD_NICE;
 	field->get_value = nice_get_value;
 	lttng_context_update(*ctx);
 	wrapper_vmalloc_sync_all();
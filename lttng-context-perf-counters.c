@@ -42,34 +42,52 @@ size_t perf_counter_get_size(size_t offset)
 	return size;
 }
 
+/*
+ * The counters of a group are read in a single pass, and written
+ * contiguously by the first field of the group. The following fields
+ * of the group record nothing: their values are already at the offsets
+ * they would be written to, since all counters are uint64_t.
+ */
 static
 void perf_counter_record(struct lttng_ctx_field *field,
 			 struct lib_ring_buffer_ctx *ctx,
 			 struct lttng_channel *chan)
 {
-	struct perf_event *event;
-	uint64_t value;
+	struct lttng_perf_counter_field *perf_field = field->u.perf_counter;
+	unsigned int i, nr_counters = perf_field->nr_counters;
+	struct perf_event **events = &perf_field->e[ctx->cpu * nr_counters];
+	uint64_t values[LTTNG_KERNEL_PERF_COUNTER_GROUP_MAX];
+
+	for (i = 0; i < nr_counters; i++) {
+		struct perf_event *event = events[i];
 
-	event = field->u.perf_counter->e[ctx->cpu];
-	if (likely(event)) {
-		if (unlikely(event->state == PERF_EVENT_STATE_ERROR)) {
-			value = 0;
+		if (likely(event)) {
+			if (unlikely(event->state == PERF_EVENT_STATE_ERROR)) {
+				values[i] = 0;
+			} else {
+				event->pmu->read(event);
+				values[i] = local64_read(&event->count);
+			}
 		} else {
-			event->pmu->read(event);
-			value = local64_read(&event->count);
+			/*
+			 * Perf chooses not to be clever and not to support
+			 * enabling a perf counter before the cpu is brought
+			 * up. Therefore, we need to support having events
+			 * coming (e.g. scheduler events) before the counter
+			 * is setup. Write an arbitrary 0 in this case.
+			 */
+			values[i] = 0;
 		}
-	} else {
-		/*
-		 * Perf chooses not to be clever and not to support enabling a
-		 * perf counter before the cpu is brought up. Therefore, we need
-		 * to support having events coming (e.g. scheduler events)
-		 * before the counter is setup. Write an arbitrary 0 in this
-		 * case.
-		 */
-		value = 0;
 	}
-	lib_ring_buffer_align_ctx(ctx, lttng_alignof(value));
-	chan->ops->event_write(ctx, &value, sizeof(value));
+	lib_ring_buffer_align_ctx(ctx, lttng_alignof(uint64_t));
+	chan->ops->event_write(ctx, values, nr_counters * sizeof(uint64_t));
+}
+
+static
+void perf_counter_group_member_record(struct lttng_ctx_field *field,
+			 struct lib_ring_buffer_ctx *ctx,
+			 struct lttng_channel *chan)
+{
 }
 
 #if defined(CONFIG_PERF_EVENTS) && (LINUX_VERSION_CODE >= KERNEL_VERSION(3,0,99))
@@ -88,23 +106,79 @@ void overflow_callback(struct perf_event *event, int nmi,
 }
 #endif
 
+static
+void lttng_perf_counter_release_cpu(struct lttng_perf_counter_field *perf_field,
+		int cpu)
+{
+	unsigned int i, nr_counters = perf_field->nr_counters;
+	struct perf_event **events = &perf_field->e[cpu * nr_counters];
+	struct perf_event *pevent;
+
+	for (i = 0; i < nr_counters; i++) {
+		pevent = events[i];
+		if (!pevent)
+			continue;
+		events[i] = NULL;
+		barrier();	/* NULLify event before perf counter teardown */
+		perf_event_release_kernel(pevent);
+	}
+}
+
+static
+int lttng_perf_counter_create_cpu(struct lttng_perf_counter_field *perf_field,
+		int cpu)
+{
+	unsigned int i, nr_counters = perf_field->nr_counters;
+	struct perf_event **events = &perf_field->e[cpu * nr_counters];
+	struct perf_event *pevent;
+	int ret;
+
+	for (i = 0; i < nr_counters; i++) {
+		pevent = wrapper_perf_event_create_kernel_counter(
+				&perf_field->attr[i], cpu, NULL,
+				overflow_callback);
+		if (!pevent || IS_ERR(pevent)) {
+			ret = -EINVAL;
+			goto error;
+		}
+		if (pevent->state == PERF_EVENT_STATE_ERROR) {
+			perf_event_release_kernel(pevent);
+			ret = -EBUSY;
+			goto error;
+		}
+		barrier();	/* Create perf counter before setting event */
+		events[i] = pevent;
+	}
+	return 0;
+
+error:
+	lttng_perf_counter_release_cpu(perf_field, cpu);
+	return ret;
+}
+
 static
 void lttng_destroy_perf_counter_field(struct lttng_ctx_field *field)
 {
-	struct perf_event **events = field->u.perf_counter->e;
+	struct lttng_perf_counter_field *perf_field = field->u.perf_counter;
 	int cpu;
 
 	get_online_cpus();
 	for_each_online_cpu(cpu)
-		perf_event_release_kernel(events[cpu]);
+		lttng_perf_counter_release_cpu(perf_field, cpu);
 	put_online_cpus();
 #ifdef CONFIG_HOTPLUG_CPU
-	unregister_cpu_notifier(&field->u.perf_counter->nb);
+	unregister_cpu_notifier(&perf_field->nb);
 #endif
 	kfree(field->event_field.name);
-	kfree(field->u.perf_counter->attr);
-	kfree(events);
-	kfree(field->u.perf_counter);
+	kfree(perf_field->attr);
+	kfree(perf_field->e);
+	kfree(perf_field);
+}
+
+static
+void lttng_destroy_perf_counter_group_member_field(struct lttng_ctx_field *field)
+{
+	kfree(field->event_field.name);
 }
 
 #ifdef CONFIG_HOTPLUG_CPU
@@ -128,9 +202,6 @@ int lttng_perf_counter_cpu_hp_callback(struct notifier_block *nb,
 	unsigned int cpu = (unsigned long) hcpu;
 	struct lttng_perf_counter_field *perf_field =
 		container_of(nb, struct lttng_perf_counter_field, nb);
-	struct perf_event **events = perf_field->e;
-	struct perf_event_attr *attr = perf_field->attr;
-	struct perf_event *pevent;
 
 	if (!perf_field->hp_enable)
 		return NOTIFY_OK;
@@ -138,25 +209,14 @@ int lttng_perf_counter_cpu_hp_callback(struct notifier_block *nb,
 	switch (action) {
 	case CPU_ONLINE:
 	case CPU_ONLINE_FROZEN:
-		pevent = wrapper_perf_event_create_kernel_counter(attr,
-				cpu, NULL, overflow_callback);
-		if (!pevent || IS_ERR(pevent))
-			return NOTIFY_BAD;
-		if (pevent->state == PERF_EVENT_STATE_ERROR) {
-			perf_event_release_kernel(pevent);
+		if (lttng_perf_counter_create_cpu(perf_field, cpu))
 			return NOTIFY_BAD;
-		}
-		barrier();	/* Create perf counter before setting event */
-		events[cpu] = pevent;
 		break;
 	case CPU_UP_CANCELED:
 	case CPU_UP_CANCELED_FROZEN:
 	case CPU_DEAD:
 	case CPU_DEAD_FROZEN:
-		pevent = events[cpu];
-		events[cpu] = NULL;
-		barrier();	/* NULLify event before perf counter teardown */
-		perf_event_release_kernel(pevent);
+		lttng_perf_counter_release_cpu(perf_field, cpu);
 		break;
 	}
 	return NOTIFY_OK;
@@ -164,34 +224,46 @@ int lttng_perf_counter_cpu_hp_callback(struct notifier_block *nb,
 
 #endif
 
-int lttng_add_perf_counter_to_ctx(uint32_t type,
-				  uint64_t config,
-				  const char *name,
-				  struct lttng_ctx **ctx)
+/*
+ * Add a group of perf counters, recorded as consecutive uint64_t context
+ * fields named after each counter. The in-kernel perf API cannot create
+ * event groups, so each counter is a pinned kernel counter of its own,
+ * but they are all read and written by a single record callback.
+ */
+int lttng_add_perf_counter_group_to_ctx(
+		const struct lttng_kernel_perf_counter_ctx *counters,
+		unsigned int nr_counters,
+		struct lttng_ctx **ctx)
 {
 	struct lttng_ctx_field *field;
 	struct lttng_perf_counter_field *perf_field;
 	struct perf_event **events;
 	struct perf_event_attr *attr;
+	unsigned int i, first, nr_fields = 0;
 	int ret;
 	int cpu;
-	char *name_alloc;
 
-	events = kzalloc(num_possible_cpus() * sizeof(*events), GFP_KERNEL);
+	if (!nr_counters || nr_counters > LTTNG_KERNEL_PERF_COUNTER_GROUP_MAX)
+		return -EINVAL;
+
+	events = kzalloc(num_possible_cpus() * nr_counters * sizeof(*events),
+			GFP_KERNEL);
 	if (!events)
 		return -ENOMEM;
 
-	attr = kzalloc(sizeof(struct perf_event_attr), GFP_KERNEL);
+	attr = kzalloc(nr_counters * sizeof(struct perf_event_attr), GFP_KERNEL);
 	if (!attr) {
 		ret = -ENOMEM;
 		goto error_attr;
 	}
 
-	attr->type = type;
-	attr->config = config;
-	attr->size = sizeof(struct perf_event_attr);
-	attr->pinned = 1;
-	attr->disabled = 0;
+	for (i = 0; i < nr_counters; i++) {
+		attr[i].type = counters[i].type;
+		attr[i].config = counters[i].config;
+		attr[i].size = sizeof(struct perf_event_attr);
+		attr[i].pinned = 1;
+		attr[i].disabled = 0;
+	}
 
 	perf_field = kzalloc(sizeof(struct lttng_perf_counter_field), GFP_KERNEL);
 	if (!perf_field) {
@@ -200,21 +272,24 @@ int lttng_add_perf_counter_to_ctx(uint32_t type,
 	}
 	perf_field->e = events;
 	perf_field->attr = attr;
+	perf_field->nr_counters = nr_counters;
 
-	name_alloc = kstrdup(name, GFP_KERNEL);
-	if (!name_alloc) {
-		ret = -ENOMEM;
-		goto name_alloc_error;
-	}
-
-	field = lttng_append_context(ctx);
-	if (!field) {
-		ret = -ENOMEM;
-		goto append_context_error;
-	}
-	if (lttng_find_context(*ctx, name_alloc)) {
-		ret = -EEXIST;
-		goto find_error;
+	for (i = 0; i < nr_counters; i++) {
+		field = lttng_append_context(ctx);
+		if (!field) {
+			ret = -ENOMEM;
+			goto field_error;
+		}
+		nr_fields++;
+		if (lttng_find_context(*ctx, counters[i].name)) {
+			ret = -EEXIST;
+			goto field_error;
+		}
+		field->event_field.name = kstrdup(counters[i].name, GFP_KERNEL);
+		if (!field->event_field.name) {
+			ret = -ENOMEM;
+			goto field_error;
+		}
 	}
 
 #ifdef CONFIG_HOTPLUG_CPU
@@ -226,53 +301,53 @@ int lttng_add_perf_counter_to_ctx(uint32_t type,
 
 	get_online_cpus();
 	for_each_online_cpu(cpu) {
-		events[cpu] = wrapper_perf_event_create_kernel_counter(attr,
-					cpu, NULL, overflow_callback);
-		if (!events[cpu] || IS_ERR(events[cpu])) {
-			ret = -EINVAL;
+		ret = lttng_perf_counter_create_cpu(perf_field, cpu);
+		if (ret)
 			goto counter_error;
-		}
-		if (events[cpu]->state == PERF_EVENT_STATE_ERROR) {
-			ret = -EBUSY;
-			goto counter_busy;
-		}
 	}
 	put_online_cpus();
 
-	field->destroy = lttng_destroy_perf_counter_field;
-
-	field->event_field.name = name_alloc;
-	field->event_field.type.atype = atype_integer;
-	field->event_field.type.u.basic.integer.size = sizeof(uint64_t) * CHAR_BIT;
-	field->event_field.type.u.basic.integer.alignment = lttng_alignof(uint64_t) * CHAR_BIT;
-	field->event_field.type.u.basic.integer.signedness = lttng_is_signed_type(uint64_t);
-	field->event_field.type.u.basic.integer.reverse_byte_order = 0;
-	field->event_field.type.u.basic.integer.base = 10;
-	field->event_field.type.u.basic.integer.encoding = lttng_encode_none;
-	field->get_size = perf_counter_get_size;
-	field->record = perf_counter_record;
-	field->u.perf_counter = perf_field;
+	/* The context fields array is stable from here on. */
+	first = (*ctx)->nr_fields - nr_counters;
+	for (i = 0; i < nr_counters; i++) {
+		field = &(*ctx)->fields[first + i];
+		field->event_field.type.atype = atype_integer;
+		field->event_field.type.u.basic.integer.size = sizeof(uint64_t) * CHAR_BIT;
+		field->event_field.type.u.basic.integer.alignment = lttng_alignof(uint64_t) * CHAR_BIT;
+		field->event_field.type.u.basic.integer.signedness = lttng_is_signed_type(uint64_t);
+		field->event_field.type.u.basic.integer.reverse_byte_order = 0;
+		field->event_field.type.u.basic.integer.base = 10;
+		field->event_field.type.u.basic.integer.encoding = lttng_encode_none;
+		field->get_size = perf_counter_get_size;
+		if (!i) {
+			field->record = perf_counter_record;
+			field->u.perf_counter = perf_field;
+			field->destroy = lttng_destroy_perf_counter_field;
+		} else {
+			field->record = perf_counter_group_member_record;
+			field->record_type = LTTNG_CTX_RECORD_NONE;
+			field->destroy = lttng_destroy_perf_counter_group_member_field;
+		}
+	}
 	perf_field->hp_enable = 1;
 	lttng_context_update(*ctx);
 
 	wrapper_vmalloc_sync_all();
 	return 0;
 
-counter_busy:
 counter_error:
-	for_each_online_cpu(cpu) {
-		if (events[cpu] && !IS_ERR(events[cpu]))
-			perf_event_release_kernel(events[cpu]);
-	}
+	for_each_online_cpu(cpu)
+		lttng_perf_counter_release_cpu(perf_field, cpu);
 	put_online_cpus();
 #ifdef CONFIG_HOTPLUG_CPU
 	unregister_cpu_notifier(&perf_field->nb);
 #endif
-find_error:
-	lttng_remove_context_field(ctx, field);
-append_context_error:
-	kfree(name_alloc);
-name_alloc_error:
+field_error:
+	while (nr_fields--) {
+		field = &(*ctx)->fields[(*ctx)->nr_fields - 1];
+		kfree(field->event_field.name);
+		lttng_remove_context_field(ctx, field);
+	}
 	kfree(perf_field);
 error_alloc_perf_field:
 	kfree(attr);
@@ -281,6 +356,19 @@ error_attr:
 	return ret;
 }
 
+int lttng_add_perf_counter_to_ctx(uint32_t type,
+				  uint64_t config,
+				  const char *name,
+				  struct lttng_ctx **ctx)
+{
+	struct lttng_kernel_perf_counter_ctx counter;
+
+	counter.type = type;
+	counter.config = config;
+	strlcpy(counter.name, name, sizeof(counter.name));
+	return lttng_add_perf_counter_group_to_ctx(&counter, 1, ctx);
+}
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Mathieu Desnoyers");
 MODULE_DESCRIPTION("Linux Trace Toolkit Perf Support");
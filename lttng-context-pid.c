@@ -78,6 +78,7 @@ int lttng_add_pid_to_ctx(struct lttng_ctx **ctx)
 	field->event_field.type.u.basic.integer.encoding = lttng_encode_none;
 	field->get_size = pid_get_size;
 	field->record = pid_record;
+	field->record_type = LTTNG_CTX_RECORD_PID;
 	field->get_value = pid_get_value;
 	lttng_context_update(*ctx);
 	wrapper_vmalloc_sync_all();
@@ -99,6 +99,7 @@ int lttng_add_prio_to_ctx(struct lttng_ctx **ctx)
 	field->event_field.type.u.basic.integer.encoding = lttng_encode_none;
 	field->get_size = prio_get_size;
 	field->record = prio_record;
+	field->record_type = LTTNG_CTX_RECORD_PRIO;
 	field->get_value = prio_get_value;
 	lttng_context_update(*ctx);
 	wrapper_vmalloc_sync_all();
@@ -81,6 +81,7 @@ int lttng_add_tid_to_ctx(struct lttng_ctx **ctx)
 	field->event_field.type.u.basic.integer.encoding = lttng_encode_none;
 	field->get_size = tid_get_size;
 	field->record = tid_record;
+	field->record_type = LTTNG_CTX_RECORD_TID;
 	field->get_value = tid_get_value;
 	lttng_context_update(*ctx);
 	wrapper_vmalloc_sync_all();
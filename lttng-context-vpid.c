@@ -93,6 +93,7 @@ int lttng_add_vpid_to_ctx(struct lttng_ctx **ctx)
 	field->event_field.type.u.basic.integer.encoding = lttng_encode_none;
 	field->get_size = vpid_get_size;
 	field->record = vpid_record;
+	field->record_type = LTTNG_CTX_RECORD_VPID;
 	field->get_value = vpid_get_value;
 	lttng_context_update(*ctx);
 	wrapper_vmalloc_sync_all();
@@ -122,6 +122,7 @@ int lttng_add_vppid_to_ctx(struct lttng_ctx **ctx)
 	field->event_field.type.u.basic.integer.encoding = lttng_encode_none;
 	field->get_size = vppid_get_size;
 	field->record = vppid_record;
+	field->record_type = LTTNG_CTX_RECORD_VPPID;
 	field->get_value = vppid_get_value;
 	lttng_context_update(*ctx);
 	wrapper_vmalloc_sync_all();
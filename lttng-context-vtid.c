@@ -93,6 +93,7 @@ int lttng_add_vtid_to_ctx(struct lttng_ctx **ctx)
 	field->event_field.type.u.basic.integer.encoding = lttng_encode_none;
 	field->get_size = vtid_get_size;
 	field->record = vtid_record;
+	field->record_type = LTTNG_CTX_RECORD_VTID;
 	field->get_value = vtid_get_value;
 	lttng_context_update(*ctx);
 	wrapper_vmalloc_sync_all();
@@ -111,15 +111,19 @@ void lttng_context_update(struct lttng_ctx *ctx)
 {
 	int i;
 	size_t largest_align = 8;	/* in bits */
+	size_t fixed_size = 0;		/* in bytes */
+	bool fixed = true;
 
 	for (i = 0; i < ctx->nr_fields; i++) {
 		struct lttng_type *type;
-		size_t field_align = 8;
+		size_t field_align = 8;	/* in bits */
+		size_t field_size = 0;	/* in bytes */
 
 		type = &ctx->fields[i].event_field.type;
 		switch (type->atype) {
 		case atype_integer:
 			field_align = type->u.basic.integer.alignment;
+			field_size = type->u.basic.integer.size >> 3;
 			break;
 		case atype_array:
 		{
@@ -129,14 +133,18 @@ void lttng_context_update(struct lttng_ctx *ctx)
 			switch (btype->atype) {
 			case atype_integer:
 				field_align = btype->u.basic.integer.alignment;
+				field_size = type->u.array.length
+					* (btype->u.basic.integer.size >> 3);
 				break;
 			case atype_string:
+				fixed = false;
 				break;
 
 			case atype_array:
 			case atype_sequence:
 			default:
 				WARN_ON_ONCE(1);
+				fixed = false;
 				break;
 			}
 			break;
@@ -145,6 +153,7 @@ void lttng_context_update(struct lttng_ctx *ctx)
 		{
 			struct lttng_basic_type *btype;
 
+			fixed = false;
 			btype = &type->u.sequence.length_type;
 			switch (btype->atype) {
 			case atype_integer:
@@ -179,16 +188,26 @@ void lttng_context_update(struct lttng_ctx *ctx)
 			break;
 		}
 		case atype_string:
+			fixed = false;
 			break;
 
 		case atype_enum:
 		default:
 			WARN_ON_ONCE(1);
+			fixed = false;
 			break;
 		}
 		largest_align = max_t(size_t, largest_align, field_align);
+		/*
+		 * The fields are recorded from an offset aligned on
+		 * largest_align, so their padding does not depend on
+		 * where the context starts in the buffer.
+		 */
+		fixed_size += lib_ring_buffer_align(fixed_size, field_align >> 3);
+		fixed_size += field_size;
 	}
 	ctx->largest_align = largest_align >> 3;	/* bits to bytes */
+	ctx->fixed_size = fixed ? fixed_size : 0;
 }
 
 /*
@@ -40,6 +40,7 @@
 #include <linux/jhash.h>
 #include <linux/uaccess.h>
 #include <linux/vmalloc.h>
+#include <linux/math64.h>
 
 #include "wrapper/uuid.h"
 #include "wrapper/vmalloc.h"	/* for wrapper_vmalloc_sync_all() */
@@ -52,7 +53,7 @@
 #include "lttng-abi-old.h"
 #include "wrapper/vzalloc.h"
 
-#define METADATA_CACHE_DEFAULT_SIZE 4096
+#define METADATA_CACHE_CHUNK_SIZE	(16384 - sizeof(struct lttng_metadata_cache_chunk))
 
 static LIST_HEAD(sessions);
 static LIST_HEAD(lttng_transport_list);
@@ -66,7 +67,6 @@ static void lttng_session_lazy_sync_enablers(struct lttng_session *session);
 static void lttng_session_sync_enablers(struct lttng_session *session);
 static void lttng_enabler_destroy(struct lttng_enabler *enabler);
 
-static void _lttng_event_destroy(struct lttng_event *event);
 static void _lttng_channel_destroy(struct lttng_channel *chan);
 static int _lttng_event_unregister(struct lttng_event *event);
 static
@@ -116,6 +116,29 @@ int lttng_session_active(void)
 	return 0;
 }
 
+static
+struct lttng_metadata_cache_chunk *metadata_cache_chunk_alloc(size_t alloc)
+{
+	struct lttng_metadata_cache_chunk *chunk;
+
+	chunk = lttng_vzalloc(sizeof(*chunk) + alloc);
+	if (!chunk)
+		return NULL;
+	chunk->alloc = alloc;
+	return chunk;
+}
+
+static
+void metadata_cache_chunks_free(struct lttng_metadata_cache_chunk *chunk)
+{
+	struct lttng_metadata_cache_chunk *next;
+
+	for (; chunk; chunk = next) {
+		next = chunk->next;
+		vfree(chunk);
+	}
+}
+
 struct lttng_session *lttng_session_create(void)
 {
 	struct lttng_session *session;
@@ -134,10 +157,11 @@ struct lttng_session *lttng_session_create(void)
 			GFP_KERNEL);
 	if (!metadata_cache)
 		goto err_free_session;
-	metadata_cache->data = lttng_vzalloc(METADATA_CACHE_DEFAULT_SIZE);
-	if (!metadata_cache->data)
+	metadata_cache->head = metadata_cache_chunk_alloc(
+			METADATA_CACHE_CHUNK_SIZE);
+	if (!metadata_cache->head)
 		goto err_free_cache;
-	metadata_cache->cache_alloc = METADATA_CACHE_DEFAULT_SIZE;
+	metadata_cache->tail = metadata_cache->head;
 	kref_init(&metadata_cache->refcount);
 	mutex_init(&metadata_cache->lock);
 	session->metadata_cache = metadata_cache;
@@ -147,6 +171,7 @@ struct lttng_session *lttng_session_create(void)
 	INIT_LIST_HEAD(&session->enablers_head);
 	for (i = 0; i < LTTNG_EVENT_HT_SIZE; i++)
 		INIT_HLIST_HEAD(&session->events_ht.table[i]);
+	lttng_statedump_session_init(session);
 	list_add(&session->list, &sessions);
 	mutex_unlock(&sessions_mutex);
 	return session;
@@ -164,7 +189,7 @@ void metadata_cache_destroy(struct kref *kref)
 {
 	struct lttng_metadata_cache *cache =
 		container_of(kref, struct lttng_metadata_cache, refcount);
-	vfree(cache->data);
+	metadata_cache_chunks_free(cache->head);
 	kfree(cache);
 }
 
@@ -178,6 +203,7 @@ void lttng_session_destroy(struct lttng_session *session)
 
 	mutex_lock(&sessions_mutex);
 	ACCESS_ONCE(session->active) = 0;
+	lttng_statedump_cancel(session);
 	list_for_each_entry(chan, &session->chan, list) {
 		ret = lttng_syscalls_unregister(chan);
 		WARN_ON(ret);
@@ -185,6 +211,7 @@ void lttng_session_destroy(struct lttng_session *session)
 	list_for_each_entry(event, &session->events, list) {
 		ret = _lttng_event_unregister(event);
 		WARN_ON(ret);
+		lttng_sampling_stop(event);
 	}
 	synchronize_trace();	/* Wait for in-flight events to complete */
 	list_for_each_entry_safe(enabler, tmpenabler,
@@ -261,6 +288,8 @@ int lttng_session_disable(struct lttng_session *session)
 		goto end;
 	}
 	ACCESS_ONCE(session->active) = 0;
+	/* Events of a statedump still in progress would be discarded. */
+	lttng_statedump_cancel(session);
 
 	/* Set transient enabler state to "disabled" */
 	session->tstate = 0;
@@ -270,6 +299,18 @@ end:
 	return ret;
 }
 
+/*
+ * Applies to the statedumps of the following session starts.
+ */
+int lttng_session_statedump_vm_maps(struct lttng_session *session,
+		int enable)
+{
+	mutex_lock(&sessions_mutex);
+	session->statedump.vm_maps = !!enable;
+	mutex_unlock(&sessions_mutex);
+	return 0;
+}
+
 int lttng_session_metadata_regenerate(struct lttng_session *session)
 {
 	int ret = 0;
@@ -284,13 +325,22 @@ int lttng_session_metadata_regenerate(struct lttng_session *session)
 		goto end;
 	}
 
+	/*
+	 * Readers hold the cache lock while walking the chunks, so they
+	 * cannot observe the chunks being freed. The writer is excluded
+	 * by the sessions mutex.
+	 */
 	mutex_lock(&cache->lock);
-	memset(cache->data, 0, cache->cache_alloc);
+	metadata_cache_chunks_free(cache->head->next);
+	cache->head->next = NULL;
+	cache->head->len = 0;
+	cache->tail = cache->head;
 	cache->metadata_written = 0;
 	cache->version++;
 	list_for_each_entry(stream, &session->metadata_cache->metadata_stream, list) {
 		stream->metadata_out = 0;
 		stream->metadata_in = 0;
+		stream->chunk = NULL;
 	}
 	mutex_unlock(&cache->lock);
 
@@ -528,7 +578,7 @@ static
 void _lttng_metadata_channel_hangup(struct lttng_metadata_stream *stream)
 {
 	stream->finalized = 1;
-	wake_up_interruptible(&stream->read_wait);
+	wake_up_interruptible_all(&stream->read_wait);
 }
 
 /*
@@ -595,6 +645,18 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 	event->evtype = LTTNG_TYPE_EVENT;
 	INIT_LIST_HEAD(&event->bytecode_runtime_head);
 	INIT_LIST_HEAD(&event->enablers_ref_head);
+	INIT_LIST_HEAD(&event->filter_bytecode_head);
+	event->counters = alloc_percpu(struct lttng_event_counters);
+	if (!event->counters) {
+		ret = -ENOMEM;
+		goto counters_error;
+	}
+	wrapper_vmalloc_sync_all();
+	if (event_param) {
+		ret = lttng_sampling_init(event, &event_param->sampling);
+		if (ret)
+			goto register_error;
+	}
 
 	switch (itype) {
 	case LTTNG_KERNEL_TRACEPOINT:
@@ -625,6 +687,8 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 				event_param->u.kprobe.symbol_name,
 				event_param->u.kprobe.offset,
 				event_param->u.kprobe.addr,
+				event_param->u.kprobe.fetch,
+				event_param->u.kprobe.nr_fetch,
 				event);
 		if (ret) {
 			ret = -EINVAL;
@@ -650,12 +714,23 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 			ret = -ENOMEM;
 			goto register_error;
 		}
+		event_return->counters =
+			alloc_percpu(struct lttng_event_counters);
+		if (!event_return->counters) {
+			kmem_cache_free(event_cache, event_return);
+			ret = -ENOMEM;
+			goto register_error;
+		}
+		wrapper_vmalloc_sync_all();
 		event_return->chan = chan;
 		event_return->filter = filter;
 		event_return->id = chan->free_event_id++;
 		event_return->enabled = 0;
 		event_return->registered = 1;
 		event_return->instrumentation = itype;
+		INIT_LIST_HEAD(&event_return->bytecode_runtime_head);
+		INIT_LIST_HEAD(&event_return->enablers_ref_head);
+		INIT_LIST_HEAD(&event_return->filter_bytecode_head);
 		/*
 		 * Populate lttng_event structure before kretprobe registration.
 		 */
@@ -664,8 +739,10 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 				event_param->u.kretprobe.symbol_name,
 				event_param->u.kretprobe.offset,
 				event_param->u.kretprobe.addr,
+				event_param->u.kretprobe.maxactive,
 				event, event_return);
 		if (ret) {
+			free_percpu(event_return->counters);
 			kmem_cache_free(event_cache, event_return);
 			ret = -EINVAL;
 			goto register_error;
@@ -679,6 +756,7 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 						    event_return);
 		WARN_ON_ONCE(ret > 0);
 		if (ret) {
+			free_percpu(event_return->counters);
 			kmem_cache_free(event_cache, event_return);
 			module_put(event->desc->owner);
 			module_put(event->desc->owner);
@@ -734,11 +812,15 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 	}
 	hlist_add_head(&event->hlist, head);
 	list_add(&event->list, &chan->session->events);
+	lttng_sampling_start(event);
 	return event;
 
 statedump_error:
 	/* If a statedump error occurs, events will not be readable. */
 register_error:
+	lttng_sampling_destroy(event);
+	free_percpu(event->counters);
+counters_error:
 	kmem_cache_free(event_cache, event);
 cache_error:
 exist:
@@ -842,11 +924,17 @@ int _lttng_event_unregister(struct lttng_event *event)
 }
 
 /*
- * Only used internally at session destruction.
+ * Only used internally at session destruction, and to undo the creation
+ * of the sampling report event.
  */
-static
 void _lttng_event_destroy(struct lttng_event *event)
 {
+	struct lttng_filter_bytecode_node *filter_node, *tmp_filter_node;
+
+	lttng_free_event_filter_runtime(event);
+	list_for_each_entry_safe(filter_node, tmp_filter_node,
+			&event->filter_bytecode_head, node)
+		kfree(filter_node);
 	switch (event->instrumentation) {
 	case LTTNG_KERNEL_TRACEPOINT:
 		lttng_event_put(event->desc);
@@ -871,9 +959,87 @@ void _lttng_event_destroy(struct lttng_event *event)
 	}
 	list_del(&event->list);
 	lttng_destroy_context(event->ctx);
+	lttng_sampling_destroy(event);
+	free_percpu(event->counters);
 	kmem_cache_free(event_cache, event);
 }
 
+void lttng_event_get_stats(struct lttng_event *event,
+		struct lttng_kernel_event_stats *stats)
+{
+	int cpu;
+
+	memset(stats, 0, sizeof(*stats));
+	for_each_possible_cpu(cpu) {
+		struct lttng_event_counters *counters =
+			per_cpu_ptr(event->counters, cpu);
+
+		stats->hit += ACCESS_ONCE(counters->hit);
+		stats->pid_filtered += ACCESS_ONCE(counters->pid_filtered);
+		stats->filtered += ACCESS_ONCE(counters->filtered);
+		stats->discarded += ACCESS_ONCE(counters->discarded);
+		stats->sampled_out += ACCESS_ONCE(counters->sampled_out);
+	}
+}
+
+int lttng_event_get_nmissed(struct lttng_event *event, uint64_t *nmissed)
+{
+	switch (event->instrumentation) {
+	case LTTNG_KERNEL_KPROBE:
+		*nmissed = lttng_kprobes_nmissed(event);
+		return 0;
+	case LTTNG_KERNEL_KRETPROBE:
+		*nmissed = lttng_kretprobes_nmissed(event);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Get the session tracker to update with ids of the given type. When
+ * the session has none, a new tracker is returned, published by
+ * lttng_session_put_tracker() if the update succeeds. Called with
+ * sessions_mutex held.
+ */
+static
+int lttng_session_get_tracker(struct lttng_session *session,
+		enum lttng_kernel_tracker_type type,
+		struct lttng_pid_tracker **lpfp)
+{
+	struct lttng_pid_tracker *lpf = session->pid_tracker;
+	int ret;
+
+	if (!lpf) {
+		lpf = lttng_pid_tracker_create();
+		if (!lpf)
+			return -ENOMEM;
+		ret = lttng_pid_tracker_set_type(lpf, type);
+		if (ret) {
+			lttng_pid_tracker_destroy(lpf);
+			return ret;
+		}
+	} else {
+		ret = lttng_pid_tracker_set_type(lpf, type);
+		if (ret)
+			return ret;
+	}
+	*lpfp = lpf;
+	return 0;
+}
+
+static
+void lttng_session_put_tracker(struct lttng_session *session,
+		struct lttng_pid_tracker *lpf, int ret)
+{
+	if (lpf == session->pid_tracker)
+		return;
+	if (ret)
+		lttng_pid_tracker_destroy(lpf);
+	else
+		rcu_assign_pointer(session->pid_tracker, lpf);
+}
+
 int lttng_session_track_pid(struct lttng_session *session, int pid)
 {
 	int ret;
@@ -893,19 +1059,14 @@ int lttng_session_track_pid(struct lttng_session *session, int pid)
 		}
 		ret = 0;
 	} else {
-		if (!session->pid_tracker) {
-			struct lttng_pid_tracker *lpf;
+		struct lttng_pid_tracker *lpf;
 
-			lpf = lttng_pid_tracker_create();
-			if (!lpf) {
-				ret = -ENOMEM;
-				goto unlock;
-			}
-			ret = lttng_pid_tracker_add(lpf, pid);
-			rcu_assign_pointer(session->pid_tracker, lpf);
-		} else {
-			ret = lttng_pid_tracker_add(session->pid_tracker, pid);
-		}
+		ret = lttng_session_get_tracker(session,
+				LTTNG_KERNEL_TRACKER_PID, &lpf);
+		if (ret)
+			goto unlock;
+		ret = lttng_pid_tracker_add(lpf, pid);
+		lttng_session_put_tracker(session, lpf, ret);
 	}
 unlock:
 	mutex_unlock(&sessions_mutex);
@@ -920,7 +1081,7 @@ int lttng_session_untrack_pid(struct lttng_session *session, int pid)
 		return -EINVAL;
 	mutex_lock(&sessions_mutex);
 	if (pid == -1) {
-		/* untrack all pids: replace by empty tracker. */
+		/* untrack all ids: replace by empty tracker of same type. */
 		struct lttng_pid_tracker *old_lpf = session->pid_tracker;
 		struct lttng_pid_tracker *lpf;
 
@@ -929,6 +1090,9 @@ int lttng_session_untrack_pid(struct lttng_session *session, int pid)
 			ret = -ENOMEM;
 			goto unlock;
 		}
+		if (old_lpf)
+			WARN_ON_ONCE(lttng_pid_tracker_set_type(lpf,
+					old_lpf->type));
 		rcu_assign_pointer(session->pid_tracker, lpf);
 		synchronize_trace();
 		if (old_lpf)
@@ -939,6 +1103,10 @@ int lttng_session_untrack_pid(struct lttng_session *session, int pid)
 			ret = -ENOENT;
 			goto unlock;
 		}
+		if (session->pid_tracker->type != LTTNG_KERNEL_TRACKER_PID) {
+			ret = -EINVAL;
+			goto unlock;
+		}
 		ret = lttng_pid_tracker_del(session->pid_tracker, pid);
 	}
 unlock:
@@ -946,65 +1114,102 @@ unlock:
 	return ret;
 }
 
+/*
+ * Bulk tracker updates. Ids already tracked, or not tracked on removal,
+ * are skipped.
+ */
+int lttng_session_track_ids(struct lttng_session *session,
+		enum lttng_kernel_tracker_type type,
+		const uint64_t *ids, size_t nr_ids)
+{
+	struct lttng_pid_tracker *lpf;
+	int ret;
+
+	mutex_lock(&sessions_mutex);
+	ret = lttng_session_get_tracker(session, type, &lpf);
+	if (ret)
+		goto unlock;
+	ret = lttng_pid_tracker_add_ids(lpf, ids, nr_ids);
+	lttng_session_put_tracker(session, lpf, ret);
+unlock:
+	mutex_unlock(&sessions_mutex);
+	return ret;
+}
+
+int lttng_session_untrack_ids(struct lttng_session *session,
+		enum lttng_kernel_tracker_type type,
+		const uint64_t *ids, size_t nr_ids)
+{
+	int ret = 0;
+
+	mutex_lock(&sessions_mutex);
+	if (!session->pid_tracker) {
+		ret = -ENOENT;
+		goto unlock;
+	}
+	if (session->pid_tracker->type != type) {
+		ret = -EINVAL;
+		goto unlock;
+	}
+	lttng_pid_tracker_del_ids(session->pid_tracker, ids, nr_ids);
+unlock:
+	mutex_unlock(&sessions_mutex);
+	return ret;
+}
+
+/*
+ * Tracker list iterator, private data of the seq_file. The listing is
+ * restarted from the first id at each start.
+ */
+struct lttng_pid_list_iter {
+	struct lttng_session *session;
+	unsigned long pos;		/* Tracker iteration position */
+	uint64_t id;			/* Current id */
+	int all;			/* Tracker disabled */
+};
+
+static
+void *pid_list_advance(struct lttng_pid_list_iter *iter, loff_t count)
+{
+	struct lttng_pid_tracker *lpf = iter->session->pid_tracker;
+
+	for (; count > 0; count--) {
+		if (lttng_pid_tracker_next(lpf, &iter->pos, &iter->id))
+			return NULL;	/* End of list */
+	}
+	return iter;
+}
+
 static
 void *pid_list_start(struct seq_file *m, loff_t *pos)
 {
-	struct lttng_session *session = m->private;
-	struct lttng_pid_tracker *lpf;
-	struct lttng_pid_hash_node *e;
-	int iter = 0, i;
+	struct lttng_pid_list_iter *iter = m->private;
 
 	mutex_lock(&sessions_mutex);
-	lpf = session->pid_tracker;
-	if (lpf) {
-		for (i = 0; i < LTTNG_PID_TABLE_SIZE; i++) {
-			struct hlist_head *head = &lpf->pid_hash[i];
-
-			lttng_hlist_for_each_entry(e, head, hlist) {
-				if (iter++ >= *pos)
-					return e;
-			}
-		}
-	} else {
+	iter->pos = 0;
+	iter->all = 0;
+	if (!iter->session->pid_tracker) {
 		/* PID tracker disabled. */
-		if (iter >= *pos && iter == 0) {
-			return session;	/* empty tracker */
+		if (*pos == 0) {
+			iter->all = 1;
+			return iter;	/* empty tracker */
 		}
-		iter++;
+		/* End of list */
+		return NULL;
 	}
-	/* End of list */
-	return NULL;
+	return pid_list_advance(iter, *pos + 1);
 }
 
 /* Called with sessions_mutex held. */
 static
 void *pid_list_next(struct seq_file *m, void *p, loff_t *ppos)
 {
-	struct lttng_session *session = m->private;
-	struct lttng_pid_tracker *lpf;
-	struct lttng_pid_hash_node *e;
-	int iter = 0, i;
+	struct lttng_pid_list_iter *iter = m->private;
 
 	(*ppos)++;
-	lpf = session->pid_tracker;
-	if (lpf) {
-		for (i = 0; i < LTTNG_PID_TABLE_SIZE; i++) {
-			struct hlist_head *head = &lpf->pid_hash[i];
-
-			lttng_hlist_for_each_entry(e, head, hlist) {
-				if (iter++ >= *ppos)
-					return e;
-			}
-		}
-	} else {
-		/* PID tracker disabled. */
-		if (iter >= *ppos && iter == 0)
-			return session;	/* empty tracker */
-		iter++;
-	}
-
-	/* End of list */
-	return NULL;
+	if (iter->all)
+		return NULL;	/* End of list */
+	return pid_list_advance(iter, 1);
 }
 
 static
@@ -1016,17 +1221,25 @@ void pid_list_stop(struct seq_file *m, void *p)
 static
 int pid_list_show(struct seq_file *m, void *p)
 {
-	int pid;
+	struct lttng_pid_list_iter *iter = p;
 
-	if (p == m->private) {
+	if (iter->all) {
 		/* Tracker disabled. */
-		pid = -1;
-	} else {
-		const struct lttng_pid_hash_node *e = p;
-
-		pid = lttng_pid_tracker_get_node_pid(e);
+		seq_printf(m,	"process { pid = %d; };\n", -1);
+		return 0;
+	}
+	switch (iter->session->pid_tracker->type) {
+	case LTTNG_KERNEL_TRACKER_PID:
+		seq_printf(m,	"process { pid = %d; };\n", (int) iter->id);
+		break;
+	case LTTNG_KERNEL_TRACKER_TGID:
+		seq_printf(m,	"process { tgid = %d; };\n", (int) iter->id);
+		break;
+	case LTTNG_KERNEL_TRACKER_CGROUP:
+		seq_printf(m,	"cgroup { id = %llu; };\n",
+			(unsigned long long) iter->id);
+		break;
 	}
-	seq_printf(m,	"process { pid = %d; };\n", pid);
 	return 0;
 }
 
@@ -1041,18 +1254,20 @@ const struct seq_operations lttng_tracker_pids_list_seq_ops = {
 static
 int lttng_tracker_pids_list_open(struct inode *inode, struct file *file)
 {
-	return seq_open(file, &lttng_tracker_pids_list_seq_ops);
+	return seq_open_private(file, &lttng_tracker_pids_list_seq_ops,
+			sizeof(struct lttng_pid_list_iter));
 }
 
 static
 int lttng_tracker_pids_list_release(struct inode *inode, struct file *file)
 {
 	struct seq_file *m = file->private_data;
-	struct lttng_session *session = m->private;
+	struct lttng_pid_list_iter *iter = m->private;
+	struct lttng_session *session = iter->session;
 	int ret;
 
 	WARN_ON_ONCE(!session);
-	ret = seq_release(inode, file);
+	ret = seq_release_private(inode, file);
 	if (!ret && session)
 		fput(session->file);
 	return ret;
@@ -1089,7 +1304,7 @@ int lttng_session_list_tracker_pids(struct lttng_session *session)
 	if (ret < 0)
 		goto open_error;
 	m = tracker_pids_list_file->private_data;
-	m->private = session;
+	((struct lttng_pid_list_iter *) m->private)->session = session;
 	fd_install(file_fd, tracker_pids_list_file);
 	atomic_long_inc(&session->file->f_count);
 
@@ -1240,7 +1455,7 @@ void lttng_create_tracepoint_if_missing(struct lttng_enabler *enabler)
 			 * event probe.
 			 */
 			event = _lttng_event_create(enabler->chan,
-					NULL, NULL, desc,
+					&enabler->event_param, NULL, desc,
 					LTTNG_KERNEL_TRACEPOINT);
 			if (!event) {
 				printk(KERN_INFO "Unable to create event %s\n",
@@ -1410,6 +1625,47 @@ error_free:
 	return ret;
 }
 
+/*
+ * Dynamic probe events (kprobe, kretprobe, function) are not created
+ * from enablers: their filters are attached to the event directly.
+ */
+int lttng_event_attach_bytecode(struct lttng_event *event,
+		struct lttng_kernel_filter_bytecode __user *bytecode)
+{
+	struct lttng_filter_bytecode_node *bytecode_node;
+	uint32_t bytecode_len;
+	int ret;
+
+	switch (event->instrumentation) {
+	case LTTNG_KERNEL_KPROBE:
+	case LTTNG_KERNEL_KRETPROBE:
+	case LTTNG_KERNEL_FUNCTION:
+		break;
+	default:
+		return -EINVAL;
+	}
+	ret = get_user(bytecode_len, &bytecode->len);
+	if (ret)
+		return ret;
+	bytecode_node = kzalloc(sizeof(*bytecode_node) + bytecode_len,
+			GFP_KERNEL);
+	if (!bytecode_node)
+		return -ENOMEM;
+	ret = copy_from_user(&bytecode_node->bc, bytecode,
+		sizeof(*bytecode) + bytecode_len);
+	if (ret) {
+		kfree(bytecode_node);
+		return -EFAULT;
+	}
+	/* Enforce length based on allocated size */
+	bytecode_node->bc.len = bytecode_len;
+	mutex_lock(&sessions_mutex);
+	list_add_tail(&bytecode_node->node, &event->filter_bytecode_head);
+	ret = lttng_event_link_bytecode(event, bytecode_node);
+	mutex_unlock(&sessions_mutex);
+	return ret;
+}
+
 int lttng_enabler_attach_context(struct lttng_enabler *enabler,
 		struct lttng_kernel_context *context_param)
 {
@@ -1500,6 +1756,19 @@ void lttng_session_sync_enablers(struct lttng_session *session)
 				break;
 			}
 		}
+		/*
+		 * An enabled bytecode folded to true records the event
+		 * regardless of the other filters, as an enabler without
+		 * bytecode does.
+		 */
+		list_for_each_entry(runtime,
+				&event->bytecode_runtime_head, node) {
+			if (runtime->always_record && !runtime->link_failed
+					&& runtime->bc->enabler->enabled) {
+				has_enablers_without_bytecode = 1;
+				break;
+			}
+		}
 		event->has_enablers_without_bytecode =
 			has_enablers_without_bytecode;
 
@@ -1530,43 +1799,49 @@ void lttng_session_lazy_sync_enablers(struct lttng_session *session)
  * Serialize at most one packet worth of metadata into a metadata
  * channel.
  * We grab the metadata cache mutex to get exclusive access to our metadata
- * buffer and to the metadata cache. Exclusive access to the metadata buffer
- * allows us to do racy operations such as looking for remaining space left in
- * packet and write, since mutual exclusion protects us from concurrent writes.
- * Mutual exclusion on the metadata cache allow us to read the cache content
- * without racing against reallocation of the cache by updates.
+ * buffer. Exclusive access to the metadata buffer allows us to do racy
+ * operations such as looking for remaining space left in packet and write,
+ * since mutual exclusion protects us from concurrent writes. The mutex
+ * also keeps the chunk list stable against metadata regeneration. It is
+ * not taken by the cache writer: bytes below the published
+ * metadata_written are never moved nor modified, so they can be read
+ * while new metadata is being appended.
  * Returns the number of bytes written in the channel, 0 if no data
  * was written and a negative value on error.
  */
 int lttng_metadata_output_channel(struct lttng_metadata_stream *stream,
 		struct channel *chan)
 {
+	struct lttng_metadata_cache *cache = stream->metadata_cache;
+	struct lttng_metadata_cache_chunk *chunk;
 	struct lib_ring_buffer_ctx ctx;
 	int ret = 0;
-	size_t len, reserve_len;
+	size_t len, reserve_len, pos, left;
 
 	/*
 	 * Ensure we support mutiple get_next / put sequences followed by
-	 * put_next. The metadata cache lock protects reading the metadata
-	 * cache. It can indeed be read concurrently by "get_next_subbuf" and
-	 * "flush" operations on the buffer invoked by different processes.
-	 * Moreover, since the metadata cache memory can be reallocated, we
-	 * need to have exclusive access against updates even though we only
-	 * read it.
+	 * put_next. The metadata cache lock protects the stream read
+	 * position. It can indeed be modified concurrently by
+	 * "get_next_subbuf" and "flush" operations on the buffer invoked
+	 * by different processes.
 	 */
-	mutex_lock(&stream->metadata_cache->lock);
+	mutex_lock(&cache->lock);
 	WARN_ON(stream->metadata_in < stream->metadata_out);
 	if (stream->metadata_in != stream->metadata_out)
 		goto end;
 
 	/* Metadata regenerated, change the version. */
-	if (stream->metadata_cache->version != stream->version)
-		stream->version = stream->metadata_cache->version;
+	if (cache->version != stream->version)
+		stream->version = cache->version;
 
-	len = stream->metadata_cache->metadata_written -
-		stream->metadata_in;
+	len = ACCESS_ONCE(cache->metadata_written) - stream->metadata_in;
 	if (!len)
 		goto end;
+	/*
+	 * Order the metadata_written load before the chunk loads. Pairs
+	 * with the smp_wmb() in metadata_cache_publish().
+	 */
+	smp_rmb();
 	reserve_len = min_t(size_t,
 			stream->transport->ops.packet_avail_size(chan),
 			len);
@@ -1580,93 +1855,210 @@ int lttng_metadata_output_channel(struct lttng_metadata_stream *stream,
 		printk(KERN_WARNING "LTTng: Metadata event reservation failed\n");
 		goto end;
 	}
-	stream->transport->ops.event_write(&ctx,
-			stream->metadata_cache->data + stream->metadata_in,
-			reserve_len);
+	chunk = stream->chunk ? : cache->head;
+	pos = stream->metadata_in;
+	left = reserve_len;
+	while (left) {
+		size_t chunk_end, copy;
+
+		chunk_end = chunk->offset + ACCESS_ONCE(chunk->len);
+		if (pos == chunk_end) {
+			/*
+			 * All bytes up to metadata_written are published,
+			 * hence the next chunk exists.
+			 */
+			chunk = ACCESS_ONCE(chunk->next);
+			continue;
+		}
+		copy = min_t(size_t, left, chunk_end - pos);
+		stream->transport->ops.event_write(&ctx,
+				chunk->data + (pos - chunk->offset), copy);
+		pos += copy;
+		left -= copy;
+	}
 	stream->transport->ops.event_commit(&ctx);
+	stream->chunk = chunk;
 	stream->metadata_in += reserve_len;
 	ret = reserve_len;
 
 end:
-	mutex_unlock(&stream->metadata_cache->lock);
+	mutex_unlock(&cache->lock);
 	return ret;
 }
 
 /*
- * Write the metadata to the metadata cache.
+ * Link a new chunk of at least alloc bytes after the cache tail and
+ * return it. Its content and length must be set by the caller before
+ * publication with metadata_cache_publish().
+ */
+static
+struct lttng_metadata_cache_chunk *
+	metadata_cache_chunk_append(struct lttng_metadata_cache *cache,
+		size_t alloc)
+{
+	struct lttng_metadata_cache_chunk *tail = cache->tail, *chunk;
+
+	chunk = metadata_cache_chunk_alloc(max_t(size_t,
+			METADATA_CACHE_CHUNK_SIZE, alloc));
+	if (!chunk)
+		return NULL;
+	chunk->offset = tail->offset + tail->len;
+	return chunk;
+}
+
+/*
+ * Publish tail_len bytes appended to the tail chunk, followed by the
+ * content of a new chunk (if non-NULL), and wake up the metadata streams.
+ */
+static
+void metadata_cache_publish(struct lttng_metadata_cache *cache,
+		size_t tail_len, struct lttng_metadata_cache_chunk *chunk)
+{
+	struct lttng_metadata_cache_chunk *tail = cache->tail;
+	struct lttng_metadata_stream *stream;
+	size_t len = tail_len;
+
+	if (tail_len) {
+		/* Publish the appended bytes before the new length. */
+		smp_wmb();
+		ACCESS_ONCE(tail->len) = tail->len + tail_len;
+	}
+	if (chunk) {
+		/* Publish the chunk content before linking it. */
+		smp_wmb();
+		ACCESS_ONCE(tail->next) = chunk;
+		cache->tail = chunk;
+		len += chunk->len;
+	}
+	/*
+	 * Publish the chunk updates before metadata_written. Pairs with
+	 * the smp_rmb() in lttng_metadata_output_channel().
+	 */
+	smp_wmb();
+	ACCESS_ONCE(cache->metadata_written) = cache->metadata_written + len;
+
+	list_for_each_entry(stream, &cache->metadata_stream, list)
+		wake_up_interruptible(&stream->read_wait);
+}
+
+/*
+ * Write raw metadata text to the metadata cache. The text may be split
+ * across the end of the tail chunk and a new chunk. The new chunk is
+ * allocated before anything is published, so the text is either
+ * published whole or not at all.
  * Must be called with sessions_mutex held.
- * The metadata cache lock protects us from concurrent read access from
- * thread outputting metadata content to ring buffer.
+ */
+int lttng_metadata_write(struct lttng_session *session,
+			 const char *data, size_t len)
+{
+	struct lttng_metadata_cache *cache = session->metadata_cache;
+	struct lttng_metadata_cache_chunk *tail = cache->tail, *chunk = NULL;
+	size_t copy;
+
+	WARN_ON_ONCE(!ACCESS_ONCE(session->active));
+
+	copy = min_t(size_t, len, tail->alloc - tail->len);
+	if (copy < len) {
+		chunk = metadata_cache_chunk_append(cache, len - copy);
+		if (!chunk)
+			return -ENOMEM;
+		memcpy(chunk->data, data + copy, len - copy);
+		chunk->len = len - copy;
+	}
+	memcpy(tail->data + tail->len, data, copy);
+	metadata_cache_publish(cache, copy, chunk);
+	return 0;
+}
+
+/*
+ * Write the metadata to the metadata cache.
+ * Must be called with sessions_mutex held, which serializes writers.
+ * The text is formatted in place at the end of the tail chunk. If it
+ * does not fit, it is formatted again in a newly appended chunk, large
+ * enough to hold it, and the unused end of the previous tail is left
+ * unpublished. Readers are not excluded: they only consume bytes below
+ * the published metadata_written.
  */
 int lttng_metadata_printf(struct lttng_session *session,
 			  const char *fmt, ...)
 {
-	char *str;
+	struct lttng_metadata_cache *cache = session->metadata_cache;
+	struct lttng_metadata_cache_chunk *tail = cache->tail, *chunk = NULL;
 	size_t len;
 	va_list ap;
-	struct lttng_metadata_stream *stream;
 
 	WARN_ON_ONCE(!ACCESS_ONCE(session->active));
 
 	va_start(ap, fmt);
-	str = kvasprintf(GFP_KERNEL, fmt, ap);
+	len = vsnprintf(tail->data + tail->len, tail->alloc - tail->len,
+			fmt, ap);
 	va_end(ap);
-	if (!str)
-		return -ENOMEM;
-
-	len = strlen(str);
-	mutex_lock(&session->metadata_cache->lock);
-	if (session->metadata_cache->metadata_written + len >
-			session->metadata_cache->cache_alloc) {
-		char *tmp_cache_realloc;
-		unsigned int tmp_cache_alloc_size;
-
-		tmp_cache_alloc_size = max_t(unsigned int,
-				session->metadata_cache->cache_alloc + len,
-				session->metadata_cache->cache_alloc << 1);
-		tmp_cache_realloc = lttng_vzalloc(tmp_cache_alloc_size);
-		if (!tmp_cache_realloc)
-			goto err;
-		if (session->metadata_cache->data) {
-			memcpy(tmp_cache_realloc,
-				session->metadata_cache->data,
-				session->metadata_cache->cache_alloc);
-			vfree(session->metadata_cache->data);
-		}
-
-		session->metadata_cache->cache_alloc = tmp_cache_alloc_size;
-		session->metadata_cache->data = tmp_cache_realloc;
+	if (len >= tail->alloc - tail->len) {
+		chunk = metadata_cache_chunk_append(cache, len + 1);
+		if (!chunk)
+			return -ENOMEM;
+		va_start(ap, fmt);
+		vsnprintf(chunk->data, chunk->alloc, fmt, ap);
+		va_end(ap);
+		chunk->len = len;
+		metadata_cache_publish(cache, 0, chunk);
+	} else {
+		metadata_cache_publish(cache, len, NULL);
 	}
-	memcpy(session->metadata_cache->data +
-			session->metadata_cache->metadata_written,
-			str, len);
-	session->metadata_cache->metadata_written += len;
-	mutex_unlock(&session->metadata_cache->lock);
-	kfree(str);
-
-	list_for_each_entry(stream, &session->metadata_cache->metadata_stream, list)
-		wake_up_interruptible(&stream->read_wait);
-
 	return 0;
-
-err:
-	mutex_unlock(&session->metadata_cache->lock);
-	kfree(str);
-	return -ENOMEM;
 }
 
 /*
- * Must be called with sessions_mutex held.
+ * Metadata text rendered into a growing buffer, used to pre-render field
+ * declarations independently of any session.
  */
+struct lttng_metadata_render {
+	char *data;
+	size_t len;
+	size_t alloc;
+	int error;
+};
+
 static
-int _lttng_field_statedump(struct lttng_session *session,
-			 const struct lttng_event_field *field)
+void metadata_render_printf(struct lttng_metadata_render *r,
+		const char *fmt, ...)
 {
-	int ret = 0;
+	va_list ap;
+	size_t len;
+
+	if (r->error)
+		return;
+	va_start(ap, fmt);
+	len = vsnprintf(r->data + r->len, r->alloc - r->len, fmt, ap);
+	va_end(ap);
+	if (len >= r->alloc - r->len) {
+		size_t alloc = max_t(size_t, r->alloc << 1, r->len + len + 1);
+		char *data;
+
+		data = krealloc(r->data, alloc, GFP_KERNEL);
+		if (!data) {
+			r->error = -ENOMEM;
+			return;
+		}
+		r->data = data;
+		r->alloc = alloc;
+		va_start(ap, fmt);
+		vsnprintf(r->data + r->len, r->alloc - r->len, fmt, ap);
+		va_end(ap);
+	}
+	r->len += len;
+}
 
+static
+int _lttng_field_render(struct lttng_metadata_render *r,
+			const struct lttng_event_field *field)
+{
+	/* Filter-only fields are not part of the payload. */
+	if (field->nowrite)
+		return 0;
 	switch (field->type.atype) {
 	case atype_integer:
-		ret = lttng_metadata_printf(session,
+		metadata_render_printf(r,
 			"		integer { size = %u; align = %u; signed = %u; encoding = %s; base = %u;%s } _%s;\n",
 			field->type.u.basic.integer.size,
 			field->type.u.basic.integer.alignment,
@@ -1685,7 +2077,7 @@ int _lttng_field_statedump(struct lttng_session *session,
 			field->name);
 		break;
 	case atype_enum:
-		ret = lttng_metadata_printf(session,
+		metadata_render_printf(r,
 			"		%s _%s;\n",
 			field->type.u.basic.enumeration.name,
 			field->name);
@@ -1695,7 +2087,7 @@ int _lttng_field_statedump(struct lttng_session *session,
 		const struct lttng_basic_type *elem_type;
 
 		elem_type = &field->type.u.array.elem_type;
-		ret = lttng_metadata_printf(session,
+		metadata_render_printf(r,
 			"		integer { size = %u; align = %u; signed = %u; encoding = %s; base = %u;%s } _%s[%u];\n",
 			elem_type->u.basic.integer.size,
 			elem_type->u.basic.integer.alignment,
@@ -1721,7 +2113,7 @@ int _lttng_field_statedump(struct lttng_session *session,
 
 		elem_type = &field->type.u.sequence.elem_type;
 		length_type = &field->type.u.sequence.length_type;
-		ret = lttng_metadata_printf(session,
+		metadata_render_printf(r,
 			"		integer { size = %u; align = %u; signed = %u; encoding = %s; base = %u;%s } __%s_length;\n",
 			length_type->u.basic.integer.size,
 			(unsigned int) length_type->u.basic.integer.alignment,
@@ -1738,10 +2130,7 @@ int _lttng_field_statedump(struct lttng_session *session,
 			length_type->u.basic.integer.reverse_byte_order ? " byte_order = be;" : "",
 #endif
 			field->name);
-		if (ret)
-			return ret;
-
-		ret = lttng_metadata_printf(session,
+		metadata_render_printf(r,
 			"		integer { size = %u; align = %u; signed = %u; encoding = %s; base = %u;%s } _%s[ __%s_length ];\n",
 			elem_type->u.basic.integer.size,
 			(unsigned int) elem_type->u.basic.integer.alignment,
@@ -1764,7 +2153,7 @@ int _lttng_field_statedump(struct lttng_session *session,
 
 	case atype_string:
 		/* Default encoding is UTF8 */
-		ret = lttng_metadata_printf(session,
+		metadata_render_printf(r,
 			"		string%s _%s;\n",
 			field->type.u.basic.string.encoding == lttng_encode_ASCII ?
 				" { encoding = ASCII; }" : "",
@@ -1774,13 +2163,47 @@ int _lttng_field_statedump(struct lttng_session *session,
 		WARN_ON_ONCE(1);
 		return -EINVAL;
 	}
+	return r->error;
+}
+
+/*
+ * Render the TSDL declarations of an array of event fields. On success,
+ * returns 0 and sets str to a kmalloc'd string (to be freed with
+ * kfree()) and len to its length. Returns a negative error otherwise.
+ */
+int lttng_metadata_fields_render(const struct lttng_event_field *fields,
+		unsigned int nr_fields, char **str, size_t *len)
+{
+	struct lttng_metadata_render r = { 0 };
+	int i, ret;
+
+	for (i = 0; i < nr_fields; i++) {
+		ret = _lttng_field_render(&r, &fields[i]);
+		if (ret)
+			goto error;
+	}
+	/* Events without payload fields still get a non-NULL string. */
+	metadata_render_printf(&r, "%s", "");
+	ret = r.error;
+	if (ret)
+		goto error;
+	*str = r.data;
+	*len = r.len;
+	return 0;
+
+error:
+	kfree(r.data);
 	return ret;
 }
 
+/*
+ * Must be called with sessions_mutex held.
+ */
 static
 int _lttng_context_metadata_statedump(struct lttng_session *session,
 				    struct lttng_ctx *ctx)
 {
+	struct lttng_metadata_render r = { 0 };
 	int ret = 0;
 	int i;
 
@@ -1789,28 +2212,41 @@ int _lttng_context_metadata_statedump(struct lttng_session *session,
 	for (i = 0; i < ctx->nr_fields; i++) {
 		const struct lttng_ctx_field *field = &ctx->fields[i];
 
-		ret = _lttng_field_statedump(session, &field->event_field);
+		ret = _lttng_field_render(&r, &field->event_field);
 		if (ret)
-			return ret;
+			goto end;
 	}
+	ret = lttng_metadata_write(session, r.data, r.len);
+end:
+	kfree(r.data);
 	return ret;
 }
 
+/*
+ * Events of registered probes splice in the field declarations rendered
+ * when the probe was registered. Other events (kprobes, kretprobes,
+ * function tracing) are rendered on the fly.
+ * Must be called with sessions_mutex held.
+ */
 static
 int _lttng_fields_metadata_statedump(struct lttng_session *session,
 				   struct lttng_event *event)
 {
 	const struct lttng_event_desc *desc = event->desc;
-	int ret = 0;
-	int i;
-
-	for (i = 0; i < desc->nr_fields; i++) {
-		const struct lttng_event_field *field = &desc->fields[i];
+	const struct lttng_event_metadata_cache *cache;
+	char *str;
+	size_t len;
+	int ret;
 
-		ret = _lttng_field_statedump(session, field);
-		if (ret)
-			return ret;
-	}
+	cache = lttng_event_metadata_cache_get(desc);
+	if (cache)
+		return lttng_metadata_write(session, cache->fields, cache->len);
+	ret = lttng_metadata_fields_render(desc->fields, desc->nr_fields,
+			&str, &len);
+	if (ret)
+		return ret;
+	ret = lttng_metadata_write(session, str, len);
+	kfree(str);
 	return ret;
 }
 
@@ -1840,6 +2276,24 @@ int _lttng_event_metadata_statedump(struct lttng_session *session,
 	if (ret)
 		goto end;
 
+	/* Sampling is not part of TSDL: describe it in a comment. */
+	switch (event->sampling.type) {
+	case LTTNG_KERNEL_SAMPLING_PERIOD:
+		ret = lttng_metadata_printf(session,
+			"	/* sampling: 1 in %llu hits per CPU */\n",
+			(unsigned long long) event->sampling.value);
+		break;
+	case LTTNG_KERNEL_SAMPLING_RATE:
+		ret = lttng_metadata_printf(session,
+			"	/* sampling: at most %llu hits/s per CPU */\n",
+			(unsigned long long) event->sampling.value);
+		break;
+	default:
+		break;
+	}
+	if (ret)
+		goto end;
+
 	if (event->ctx) {
 		ret = lttng_metadata_printf(session,
 			"	context := struct {\n");
@@ -2003,10 +2457,10 @@ int _lttng_event_header_declare(struct lttng_session *session)
  * Yes, this is only an approximation. Yes, we can (and will) do better
  * in future versions.
  */
-static
-uint64_t measure_clock_offset(void)
+void lttng_measure_clock_offset(uint64_t freq, uint64_t *offset_s,
+		uint64_t *offset)
 {
-	uint64_t offset, monotonic[2], realtime;
+	uint64_t monotonic[2], now, now_s;
 	struct timespec rts = { 0, 0 };
 	unsigned long flags;
 
@@ -2017,11 +2471,20 @@ uint64_t measure_clock_offset(void)
 	monotonic[1] = trace_clock_read64();
 	local_irq_restore(flags);
 
-	offset = (monotonic[0] + monotonic[1]) >> 1;
-	realtime = (uint64_t) rts.tv_sec * NSEC_PER_SEC;
-	realtime += rts.tv_nsec;
-	offset = realtime - offset;
-	return offset;
+	/*
+	 * Computed in seconds and clock cycles, as the clock frequency
+	 * is not necessarily 1 GHz.
+	 */
+	now = (monotonic[0] + monotonic[1]) >> 1;
+	now_s = div64_u64(now, freq);
+	now -= now_s * freq;
+	*offset_s = (uint64_t) rts.tv_sec - now_s;
+	*offset = div_u64((uint64_t) rts.tv_nsec * freq, NSEC_PER_SEC);
+	if (*offset < now) {
+		*offset += freq;
+		(*offset_s)--;
+	}
+	*offset -= now;
 }
 
 /*
@@ -2035,6 +2498,7 @@ int _lttng_session_metadata_statedump(struct lttng_session *session)
 	unsigned char uuid_s[37], clock_uuid_s[BOOT_ID_LEN];
 	struct lttng_channel *chan;
 	struct lttng_event *event;
+	uint64_t freq, offset_s, offset;
 	int ret = 0;
 
 	if (!ACCESS_ONCE(session->active))
@@ -2128,14 +2592,24 @@ int _lttng_session_metadata_statedump(struct lttng_session *session)
 			goto end;
 	}
 
+	/*
+	 * The clock keeps the "monotonic" name whatever its source, for
+	 * the typealiases below: its uuid tells a TSC clock apart. The
+	 * offset is measured in units of the declared frequency.
+	 */
+	freq = trace_clock_freq();
+	lttng_measure_clock_offset(freq, &offset_s, &offset);
 	ret = lttng_metadata_printf(session,
-		"	description = \"Monotonic Clock\";\n"
+		"	description = \"%s\";\n"
 		"	freq = %llu; /* Frequency, in Hz */\n"
-		"	/* clock value offset from Epoch is: offset * (1/freq) */\n"
+		"	/* clock value offset from Epoch is: offset_s + offset * (1/freq) */\n"
+		"	offset_s = %llu;\n"
 		"	offset = %llu;\n"
 		"};\n\n",
-		(unsigned long long) trace_clock_freq(),
-		(unsigned long long) measure_clock_offset()
+		trace_clock_description(),
+		(unsigned long long) freq,
+		(unsigned long long) offset_s,
+		(unsigned long long) offset
 		);
 	if (ret)
 		goto end;
@@ -2235,9 +2709,12 @@ static int __init lttng_events_init(void)
 	ret = wrapper_get_pfnblock_flags_mask_init();
 	if (ret)
 		return ret;
-	ret = lttng_context_init();
+	ret = get_trace_clock();
 	if (ret)
 		return ret;
+	ret = lttng_context_init();
+	if (ret)
+		goto error_context;
 	ret = lttng_tracepoint_init();
 	if (ret)
 		goto error_tp;
@@ -2262,6 +2739,8 @@ error_kmem:
 	lttng_tracepoint_exit();
 error_tp:
 	lttng_context_exit();
+error_context:
+	put_trace_clock();
 	return ret;
 }
 
@@ -2275,9 +2754,11 @@ static void __exit lttng_events_exit(void)
 	lttng_abi_exit();
 	list_for_each_entry_safe(session, tmpsession, &sessions, list)
 		lttng_session_destroy(session);
+	lttng_syscalls_exit();
 	kmem_cache_destroy(event_cache);
 	lttng_tracepoint_exit();
 	lttng_context_exit();
+	put_trace_clock();
 }
 
 module_exit(lttng_events_exit);
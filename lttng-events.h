@@ -27,7 +27,13 @@
 #include <linux/list.h>
 #include <linux/kprobes.h>
 #include <linux/kref.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/percpu.h>
 #include "wrapper/uuid.h"
+#include "wrapper/rcu.h"
+#include "wrapper/percpu-defs.h"
 #include "lttng-abi.h"
 #include "lttng-abi-old.h"
 
@@ -155,12 +161,33 @@ union lttng_ctx_value {
 struct lttng_perf_counter_field {
 	struct notifier_block nb;
 	int hp_enable;
-	struct perf_event_attr *attr;
-	struct perf_event **e;	/* per-cpu array */
+	unsigned int nr_counters;
+	struct perf_event_attr *attr;	/* nr_counters entries */
+	struct perf_event **e;	/* per-cpu array of nr_counters entries */
+};
+
+/*
+ * Contexts recorded inline by the ring buffer clients. Other contexts
+ * are recorded by their record() callback.
+ */
+enum lttng_ctx_record_type {
+	LTTNG_CTX_RECORD_CALLBACK = 0,
+	LTTNG_CTX_RECORD_NONE,		/* Recorded by a previous field */
+	LTTNG_CTX_RECORD_PID,
+	LTTNG_CTX_RECORD_TID,
+	LTTNG_CTX_RECORD_VPID,
+	LTTNG_CTX_RECORD_VTID,
+	LTTNG_CTX_RECORD_PPID,
+	LTTNG_CTX_RECORD_VPPID,
+	LTTNG_CTX_RECORD_CPU_ID,
+	LTTNG_CTX_RECORD_PRIO,
+	LTTNG_CTX_RECORD_NICE,
+	LTTNG_CTX_RECORD_PROCNAME,
 };
 
 struct lttng_ctx_field {
 	struct lttng_event_field event_field;
+	enum lttng_ctx_record_type record_type;
 	size_t (*get_size)(size_t offset);
 	void (*record)(struct lttng_ctx_field *field,
 		       struct lib_ring_buffer_ctx *ctx,
@@ -178,6 +205,11 @@ struct lttng_ctx {
 	unsigned int nr_fields;
 	unsigned int allocated_fields;
 	size_t largest_align;	/* in bytes */
+	/*
+	 * Size of the fields, starting from largest_align, when they all
+	 * have a fixed size. 0 if get_size() must be called.
+	 */
+	size_t fixed_size;	/* in bytes */
 };
 
 struct lttng_event_desc {
@@ -190,6 +222,17 @@ struct lttng_event_desc {
 	struct module *owner;
 };
 
+/*
+ * TSDL field declarations of an event, rendered once when its probe is
+ * registered, and spliced into the metadata of every session.
+ */
+struct lttng_event_metadata_cache {
+	struct hlist_node hlist;		/* lookup by event descriptor */
+	const struct lttng_event_desc *desc;
+	char *fields;				/* rendered field declarations */
+	size_t len;				/* length of fields (bytes) */
+};
+
 struct lttng_probe_desc {
 	const char *provider;
 	const struct lttng_event_desc **event_desc;
@@ -197,6 +240,7 @@ struct lttng_probe_desc {
 	struct list_head head;			/* chain registered probes */
 	struct list_head lazy_init_head;
 	int lazy;				/* lazy registration */
+	struct lttng_event_metadata_cache *metadata_cache;	/* per event */
 };
 
 struct lttng_krp;				/* Kretprobe handling */
@@ -208,7 +252,7 @@ enum lttng_event_type {
 
 struct lttng_filter_bytecode_node {
 	struct list_head node;
-	struct lttng_enabler *enabler;
+	struct lttng_enabler *enabler;	/* NULL if attached to an event */
 	/*
 	 * struct lttng_kernel_filter_bytecode has var. sized array, must be
 	 * last field.
@@ -230,6 +274,7 @@ struct lttng_bytecode_runtime {
 	struct lttng_filter_bytecode_node *bc;
 	uint64_t (*filter)(void *filter_data, const char *filter_stack_data);
 	int link_failed;
+	int always_record;	/* Filter folded to true */
 	struct list_head node;	/* list of bytecode runtime in event */
 };
 
@@ -245,6 +290,36 @@ struct lttng_enabler_ref {
  * lttng_event structure is referred to by the tracing fast path. It must be
  * kept small.
  */
+struct lttng_kprobe_fetch;
+
+/*
+ * Per-CPU event counters, summed on read. Probe hits are counted once
+ * the session, channel and event are enabled.
+ */
+struct lttng_event_counters {
+	uint64_t hit;			/* Probe hits */
+	uint64_t pid_filtered;		/* Rejected by the PID tracker */
+	uint64_t filtered;		/* Rejected by the filters */
+	uint64_t discarded;		/* No space in the ring buffer */
+	uint64_t sampled_out;		/* Skipped by the sampling policy */
+};
+
+struct lttng_sampler;
+
+struct lttng_event_sampling {
+	enum lttng_kernel_sampling_type type;
+	uint64_t value;			/* Period, or rate in hits/s */
+	uint64_t interval;		/* Rate: clock cycles between records */
+	struct lttng_sampler __percpu *state;
+	uint64_t reported;		/* Sampled out hits already reported */
+	struct timer_list timer;	/* Sampled out hits report */
+	struct lttng_event *new_report;	/* Report event created with this one */
+	unsigned int timer_enabled:1;
+};
+
+#define lttng_event_count(event, counter)	\
+	this_cpu_inc((event)->counters->counter)
+
 struct lttng_event {
 	enum lttng_event_type evtype;	/* First field. */
 	unsigned int id;
@@ -258,6 +333,8 @@ struct lttng_event {
 		struct {
 			struct kprobe kp;
 			char *symbol_name;
+			struct lttng_kprobe_fetch *fetch;
+			unsigned int nr_fetch;
 		} kprobe;
 		struct {
 			struct lttng_krp *lttng_krp;
@@ -277,6 +354,10 @@ struct lttng_event {
 	/* list of struct lttng_bytecode_runtime, sorted by seqnum */
 	struct list_head bytecode_runtime_head;
 	int has_enablers_without_bytecode;
+	/* Bytecode attached to the event itself (dynamic probes) */
+	struct list_head filter_bytecode_head;
+	struct lttng_event_counters __percpu *counters;
+	struct lttng_event_sampling sampling;
 };
 
 enum lttng_enabler_type {
@@ -403,6 +484,7 @@ struct lttng_channel {
 	struct lttng_event *sc_exit_unknown;
 	struct lttng_event *compat_sc_exit_unknown;
 	struct lttng_syscall_filter *sc_filter;
+	struct lttng_event *sampling_event;	/* lttng_sampled_out records */
 	int header_type;		/* 0: unset, 1: compact, 2: large */
 	enum channel_type channel_type;
 	unsigned int metadata_dumped:1,
@@ -417,6 +499,7 @@ struct lttng_metadata_stream {
 	struct lttng_metadata_cache *metadata_cache;
 	unsigned int metadata_in;	/* Bytes read from the cache */
 	unsigned int metadata_out;	/* Bytes consumed from stream */
+	struct lttng_metadata_cache_chunk *chunk;	/* Chunk holding metadata_in, NULL: head */
 	int finalized;			/* Has channel been finalized */
 	wait_queue_head_t read_wait;	/* Reader buffer-level wait queue */
 	struct list_head list;		/* Stream list */
@@ -429,16 +512,31 @@ struct lttng_metadata_stream {
  * struct lttng_pid_tracker declared in header due to deferencing of *v
  * in RCU_INITIALIZER(v).
  */
-#define LTTNG_PID_HASH_BITS	6
-#define LTTNG_PID_TABLE_SIZE	(1 << LTTNG_PID_HASH_BITS)
+struct lttng_pid_table {
+	unsigned int bitmap:1;		/* Bitmap of ids, else hash table */
+	unsigned int order;		/* Hash table: log2 of size */
+	unsigned long size;		/* Number of bits or hash slots */
+	unsigned long used;		/* Hash slots ever filled */
+	unsigned long data[];
+};
 
 struct lttng_pid_tracker {
-	struct hlist_head pid_hash[LTTNG_PID_TABLE_SIZE];
+	struct lttng_pid_table *table;
+	enum lttng_kernel_tracker_type type;	/* Id matched against */
+	unsigned long nr_ids;		/* Number of ids tracked */
 };
 
-struct lttng_pid_hash_node {
-	struct hlist_node hlist;
-	int pid;
+/*
+ * Asynchronous statedump of a session, run by the statedump module after
+ * the session is started.
+ */
+struct lttng_statedump {
+	struct work_struct work;
+	wait_queue_head_t wait;		/* Woken up on completion */
+	int running;			/* Statedump queued or running */
+	int cancel;			/* Cancellation requested */
+	int ret;			/* Result of the last statedump */
+	unsigned int vm_maps:1;		/* Dump process memory maps (opt-in) */
 };
 
 struct lttng_session {
@@ -458,16 +556,31 @@ struct lttng_session {
 	struct list_head enablers_head;
 	/* Hash table of events */
 	struct lttng_event_ht events_ht;
+	struct lttng_statedump statedump;
+};
+
+/*
+ * The metadata cache is an append-only list of chunks. The writer
+ * (serialized by the sessions mutex) formats directly into the tail
+ * chunk and publishes the new length; bytes never move once written, so
+ * readers only need to observe the published lengths.
+ */
+struct lttng_metadata_cache_chunk {
+	struct lttng_metadata_cache_chunk *next;	/* Next chunk, NULL if tail */
+	unsigned int offset;		/* Cache offset of the first byte */
+	unsigned int len;		/* Published bytes in this chunk */
+	unsigned int alloc;		/* Allocated data size (bytes) */
+	char data[];
 };
 
 struct lttng_metadata_cache {
-	char *data;			/* Metadata cache */
-	unsigned int cache_alloc;	/* Metadata allocated size (bytes) */
-	unsigned int metadata_written;	/* Number of bytes written in metadata cache */
+	struct lttng_metadata_cache_chunk *head;	/* First chunk */
+	struct lttng_metadata_cache_chunk *tail;	/* Chunk being appended to */
+	unsigned int metadata_written;	/* Number of bytes published in metadata cache */
 	struct kref refcount;		/* Metadata cache usage */
 	struct list_head metadata_stream;	/* Metadata stream list */
 	uuid_le uuid;			/* Trace session unique ID (copy) */
-	struct mutex lock;		/* Produce/consume lock */
+	struct mutex lock;		/* Consume/regenerate lock */
 	uint64_t version;		/* Current version of the metadata */
 };
 
@@ -490,6 +603,8 @@ int lttng_session_enable(struct lttng_session *session);
 int lttng_session_disable(struct lttng_session *session);
 void lttng_session_destroy(struct lttng_session *session);
 int lttng_session_metadata_regenerate(struct lttng_session *session);
+int lttng_session_statedump_vm_maps(struct lttng_session *session,
+		int enable);
 void metadata_cache_destroy(struct kref *kref);
 
 struct lttng_channel *lttng_channel_create(struct lttng_session *session,
@@ -516,6 +631,7 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 				void *filter,
 				const struct lttng_event_desc *event_desc,
 				enum lttng_kernel_instrumentation itype);
+void _lttng_event_destroy(struct lttng_event *event);
 struct lttng_event *lttng_event_compat_old_create(struct lttng_channel *chan,
 		struct lttng_kernel_old_event *old_event_param,
 		void *filter,
@@ -537,29 +653,119 @@ void lttng_abi_compat_old_exit(void);
 
 int lttng_probe_register(struct lttng_probe_desc *desc);
 void lttng_probe_unregister(struct lttng_probe_desc *desc);
+int lttng_probe_metadata_cache_register(struct lttng_probe_desc *desc);
+void lttng_probe_metadata_cache_unregister(struct lttng_probe_desc *desc);
+const struct lttng_event_metadata_cache *
+	lttng_event_metadata_cache_get(const struct lttng_event_desc *desc);
+int lttng_metadata_fields_render(const struct lttng_event_field *fields,
+		unsigned int nr_fields, char **str, size_t *len);
 const struct lttng_event_desc *lttng_event_get(const char *name);
 void lttng_event_put(const struct lttng_event_desc *desc);
 int lttng_probes_init(void);
 void lttng_probes_exit(void);
 
+int lttng_metadata_write(struct lttng_session *session,
+		const char *data, size_t len);
 int lttng_metadata_output_channel(struct lttng_metadata_stream *stream,
 		struct channel *chan);
+void lttng_measure_clock_offset(uint64_t freq, uint64_t *offset_s,
+		uint64_t *offset);
 
-int lttng_pid_tracker_get_node_pid(const struct lttng_pid_hash_node *node);
 struct lttng_pid_tracker *lttng_pid_tracker_create(void);
 void lttng_pid_tracker_destroy(struct lttng_pid_tracker *lpf);
-bool lttng_pid_tracker_lookup(struct lttng_pid_tracker *lpf, int pid);
-int lttng_pid_tracker_add(struct lttng_pid_tracker *lpf, int pid);
-int lttng_pid_tracker_del(struct lttng_pid_tracker *lpf, int pid);
-
+bool lttng_pid_tracker_lookup(struct lttng_pid_tracker *lpf,
+		struct task_struct *p);
+int lttng_pid_tracker_add(struct lttng_pid_tracker *lpf, uint64_t id);
+int lttng_pid_tracker_del(struct lttng_pid_tracker *lpf, uint64_t id);
+int lttng_pid_tracker_add_ids(struct lttng_pid_tracker *lpf,
+		const uint64_t *ids, size_t nr_ids);
+int lttng_pid_tracker_del_ids(struct lttng_pid_tracker *lpf,
+		const uint64_t *ids, size_t nr_ids);
+int lttng_pid_tracker_next(struct lttng_pid_tracker *lpf,
+		unsigned long *pos, uint64_t *id);
+int lttng_pid_tracker_set_type(struct lttng_pid_tracker *lpf,
+		enum lttng_kernel_tracker_type type);
+
+int lttng_event_get_nmissed(struct lttng_event *event, uint64_t *nmissed);
+void lttng_event_get_stats(struct lttng_event *event,
+		struct lttng_kernel_event_stats *stats);
 int lttng_session_track_pid(struct lttng_session *session, int pid);
 int lttng_session_untrack_pid(struct lttng_session *session, int pid);
+int lttng_session_track_ids(struct lttng_session *session,
+		enum lttng_kernel_tracker_type type,
+		const uint64_t *ids, size_t nr_ids);
+int lttng_session_untrack_ids(struct lttng_session *session,
+		enum lttng_kernel_tracker_type type,
+		const uint64_t *ids, size_t nr_ids);
 
 int lttng_session_list_tracker_pids(struct lttng_session *session);
 
+/*
+ * PID tracker and filter checks for probes not generated from
+ * LTTNG_TRACEPOINT_EVENT (kprobes, kretprobes, function tracer). Like
+ * the tracepoint probes, they must be applied before reserving space
+ * in the ring buffer.
+ */
+static inline
+bool lttng_event_pid_tracked(struct lttng_session *session)
+{
+	struct lttng_pid_tracker *lpf;
+
+	lpf = lttng_rcu_dereference(session->pid_tracker);
+	return !lpf || lttng_pid_tracker_lookup(lpf, current);
+}
+
+int lttng_sampling_validate(const struct lttng_kernel_event *event_param);
+int lttng_sampling_init(struct lttng_event *event,
+		const struct lttng_kernel_event_sampling *param);
+void lttng_sampling_destroy(struct lttng_event *event);
+void lttng_sampling_start(struct lttng_event *event);
+void lttng_sampling_stop(struct lttng_event *event);
+bool lttng_sampling_record(struct lttng_event *event);
+
+/*
+ * Sampling policy of the event, applied after the PID tracker and
+ * before the filters. Return false if the hit is sampled out.
+ */
+static inline
+bool lttng_event_sampling_record(struct lttng_event *event)
+{
+	if (likely(event->sampling.type == LTTNG_KERNEL_SAMPLING_NONE))
+		return true;
+	return lttng_sampling_record(event);
+}
+
+static inline
+bool lttng_event_has_filter(struct lttng_event *event)
+{
+	return !list_empty(&event->bytecode_runtime_head)
+		&& !ACCESS_ONCE(event->has_enablers_without_bytecode);
+}
+
+/*
+ * Union of the event filters. filter_stack_data is laid out as for
+ * tracepoint probes: one int64_t per integer field of the event
+ * description, in order.
+ */
+static inline
+bool lttng_event_filter_record(struct lttng_event *event,
+		const char *filter_stack_data)
+{
+	struct lttng_bytecode_runtime *bc_runtime;
+
+	lttng_list_for_each_entry_rcu(bc_runtime,
+			&event->bytecode_runtime_head, node) {
+		if (unlikely(bc_runtime->filter(bc_runtime,
+				filter_stack_data) & LTTNG_FILTER_RECORD_FLAG))
+			return true;
+	}
+	return false;
+}
+
 #if defined(CONFIG_HAVE_SYSCALL_TRACEPOINTS)
 int lttng_syscalls_register(struct lttng_channel *chan, void *filter);
 int lttng_syscalls_unregister(struct lttng_channel *chan);
+void lttng_syscalls_exit(void);
 int lttng_syscall_filter_enable(struct lttng_channel *chan,
 		const char *name);
 int lttng_syscall_filter_disable(struct lttng_channel *chan,
@@ -577,6 +783,10 @@ static inline int lttng_syscalls_unregister(struct lttng_channel *chan)
 	return 0;
 }
 
+static inline void lttng_syscalls_exit(void)
+{
+}
+
 static inline int lttng_syscall_filter_enable(struct lttng_channel *chan,
 		const char *name)
 {
@@ -601,6 +811,43 @@ int lttng_enabler_attach_bytecode(struct lttng_enabler *enabler,
 		struct lttng_kernel_filter_bytecode __user *bytecode);
 void lttng_enabler_event_link_bytecode(struct lttng_event *event,
 		struct lttng_enabler *enabler);
+int lttng_event_link_bytecode(struct lttng_event *event,
+		struct lttng_filter_bytecode_node *bc);
+int lttng_event_attach_bytecode(struct lttng_event *event,
+		struct lttng_kernel_filter_bytecode __user *bytecode);
+void lttng_free_event_filter_runtime(struct lttng_event *event);
+
+/*
+ * Context values of the current task, cached per CPU. See
+ * lttng-context-cache.c.
+ */
+struct lttng_ctx_cache {
+	struct task_struct *task;
+	struct task_struct *real_parent;	/* Parent of task when cached */
+	pid_t pid;				/* tid of task when cached */
+	pid_t vpid, vtid;
+	pid_t ppid, vppid;
+};
+
+DECLARE_PER_CPU(struct lttng_ctx_cache, lttng_ctx_cache);
+
+struct lttng_ctx_cache *lttng_ctx_cache_fill(struct lttng_ctx_cache *cache);
+
+/*
+ * Must be called with preemption disabled.
+ */
+static inline
+struct lttng_ctx_cache *lttng_ctx_cache_get(void)
+{
+	struct lttng_ctx_cache *cache = lttng_this_cpu_ptr(&lttng_ctx_cache);
+
+	if (likely(cache->task == current
+			&& cache->pid == current->pid
+			&& cache->real_parent
+				== rcu_access_pointer(current->real_parent)))
+		return cache;
+	return lttng_ctx_cache_fill(cache);
+}
 
 extern struct lttng_ctx *lttng_static_ctx;
 
@@ -629,6 +876,10 @@ int lttng_add_perf_counter_to_ctx(uint32_t type,
 				  uint64_t config,
 				  const char *name,
 				  struct lttng_ctx **ctx);
+int lttng_add_perf_counter_group_to_ctx(
+		const struct lttng_kernel_perf_counter_ctx *counters,
+		unsigned int nr_counters,
+		struct lttng_ctx **ctx);
 #else
 static inline
 int lttng_add_perf_counter_to_ctx(uint32_t type,
@@ -638,27 +889,43 @@ int lttng_add_perf_counter_to_ctx(uint32_t type,
 {
 	return -ENOSYS;
 }
+static inline
+int lttng_add_perf_counter_group_to_ctx(
+		const struct lttng_kernel_perf_counter_ctx *counters,
+		unsigned int nr_counters,
+		struct lttng_ctx **ctx)
+{
+	return -ENOSYS;
+}
 #endif
 
 int lttng_logger_init(void);
 void lttng_logger_exit(void);
 
+extern void lttng_statedump_session_init(struct lttng_session *session);
 extern int lttng_statedump_start(struct lttng_session *session);
+extern void lttng_statedump_cancel(struct lttng_session *session);
+extern int lttng_statedump_wait(struct lttng_session *session);
 
 #ifdef CONFIG_KPROBES
 int lttng_kprobes_register(const char *name,
 		const char *symbol_name,
 		uint64_t offset,
 		uint64_t addr,
+		uint64_t fetch,
+		uint32_t nr_fetch,
 		struct lttng_event *event);
 void lttng_kprobes_unregister(struct lttng_event *event);
 void lttng_kprobes_destroy_private(struct lttng_event *event);
+uint64_t lttng_kprobes_nmissed(struct lttng_event *event);
 #else
 static inline
 int lttng_kprobes_register(const char *name,
 		const char *symbol_name,
 		uint64_t offset,
 		uint64_t addr,
+		uint64_t fetch,
+		uint32_t nr_fetch,
 		struct lttng_event *event)
 {
 	return -ENOSYS;
@@ -673,6 +940,12 @@ static inline
 void lttng_kprobes_destroy_private(struct lttng_event *event)
 {
 }
+
+static inline
+uint64_t lttng_kprobes_nmissed(struct lttng_event *event)
+{
+	return 0;
+}
 #endif
 
 #ifdef CONFIG_KRETPROBES
@@ -680,10 +953,13 @@ int lttng_kretprobes_register(const char *name,
 		const char *symbol_name,
 		uint64_t offset,
 		uint64_t addr,
+		uint32_t maxactive,
 		struct lttng_event *event_entry,
 		struct lttng_event *event_exit);
 void lttng_kretprobes_unregister(struct lttng_event *event);
 void lttng_kretprobes_destroy_private(struct lttng_event *event);
+uint64_t lttng_kretprobes_nmissed(struct lttng_event *event);
+struct lttng_event *lttng_kretprobes_return_event(struct lttng_event *event);
 int lttng_kretprobes_event_enable_state(struct lttng_event *event,
 	int enable);
 #else
@@ -692,12 +968,25 @@ int lttng_kretprobes_register(const char *name,
 		const char *symbol_name,
 		uint64_t offset,
 		uint64_t addr,
+		uint32_t maxactive,
 		struct lttng_event *event_entry,
 		struct lttng_event *event_exit)
 {
 	return -ENOSYS;
 }
 
+static inline
+uint64_t lttng_kretprobes_nmissed(struct lttng_event *event)
+{
+	return 0;
+}
+
+static inline
+struct lttng_event *lttng_kretprobes_return_event(struct lttng_event *event)
+{
+	return NULL;
+}
+
 static inline
 void lttng_kretprobes_unregister(struct lttng_event *event)
 {
@@ -0,0 +1,588 @@
+/*
+ * lttng-filter-compile.c
+ *
+ * LTTng modules filter bytecode compiler.
+ *
+ * Translates validated and specialized bytecode into an array of
+ * pre-decoded instructions (struct filter_insn), executed by
+ * lttng_filter_interpret_compiled().
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; only
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <linux/slab.h>
+#include <linux/bitmap.h>
+
+#include "lttng-filter.h"
+
+/*
+ * Return the length of the bytecode instruction at pc, or -EINVAL if
+ * it cannot be compiled. Instructions which are not supported by the
+ * compiled executor leave the bytecode to the interpreter.
+ */
+static
+int bytecode_op_len(char *pc)
+{
+	switch (*(filter_opcode_t *) pc) {
+	case FILTER_OP_RETURN:
+		return sizeof(struct return_op);
+
+	case FILTER_OP_EQ_STRING:
+	case FILTER_OP_NE_STRING:
+	case FILTER_OP_GT_STRING:
+	case FILTER_OP_LT_STRING:
+	case FILTER_OP_GE_STRING:
+	case FILTER_OP_LE_STRING:
+	case FILTER_OP_EQ_S64:
+	case FILTER_OP_NE_S64:
+	case FILTER_OP_GT_S64:
+	case FILTER_OP_LT_S64:
+	case FILTER_OP_GE_S64:
+	case FILTER_OP_LE_S64:
+		return sizeof(struct binary_op);
+
+	case FILTER_OP_UNARY_PLUS_S64:
+	case FILTER_OP_UNARY_MINUS_S64:
+	case FILTER_OP_UNARY_NOT_S64:
+		return sizeof(struct unary_op);
+
+	case FILTER_OP_AND:
+	case FILTER_OP_OR:
+		return sizeof(struct logical_op);
+
+	case FILTER_OP_LOAD_FIELD_REF_STRING:
+	case FILTER_OP_LOAD_FIELD_REF_SEQUENCE:
+	case FILTER_OP_LOAD_FIELD_REF_S64:
+	case FILTER_OP_LOAD_FIELD_REF_USER_STRING:
+	case FILTER_OP_LOAD_FIELD_REF_USER_SEQUENCE:
+	case FILTER_OP_GET_CONTEXT_REF_STRING:
+	case FILTER_OP_GET_CONTEXT_REF_S64:
+		return sizeof(struct load_op) + sizeof(struct field_ref);
+
+	case FILTER_OP_LOAD_STRING:
+	{
+		struct load_op *insn = (struct load_op *) pc;
+
+		return sizeof(struct load_op) + strlen(insn->data) + 1;
+	}
+	case FILTER_OP_LOAD_S64:
+		return sizeof(struct load_op) + sizeof(struct literal_numeric);
+
+	case FILTER_OP_CAST_NOP:
+		return sizeof(struct cast_op);
+
+	default:
+		dbg_printk("Cannot compile bytecode op %s (%u)\n",
+			lttng_filter_print_op((unsigned int) *(filter_opcode_t *) pc),
+			(unsigned int) *(filter_opcode_t *) pc);
+		return -EINVAL;
+	}
+}
+
+static
+int is_s64_comparator(filter_opcode_t op)
+{
+	return op >= FILTER_OP_EQ_S64 && op <= FILTER_OP_LE_S64;
+}
+
+/*
+ * Emit the compiled instruction for the bytecode instruction at pc.
+ * Returns 1 if an instruction was emitted, 0 if the bytecode
+ * instruction is a no-op.
+ */
+static
+int compile_op(char *pc, struct filter_insn *insn)
+{
+	filter_opcode_t op = *(filter_opcode_t *) pc;
+	struct load_op *load = (struct load_op *) pc;
+	struct field_ref *ref = (struct field_ref *) load->data;
+
+	switch (op) {
+	case FILTER_OP_RETURN:
+		insn->op = FILTER_INSN_RETURN;
+		break;
+
+	case FILTER_OP_EQ_S64:
+	case FILTER_OP_NE_S64:
+	case FILTER_OP_GT_S64:
+	case FILTER_OP_LT_S64:
+	case FILTER_OP_GE_S64:
+	case FILTER_OP_LE_S64:
+		insn->op = FILTER_INSN_EQ_S64 + (op - FILTER_OP_EQ_S64);
+		break;
+
+	case FILTER_OP_EQ_STRING:
+	case FILTER_OP_NE_STRING:
+	case FILTER_OP_GT_STRING:
+	case FILTER_OP_LT_STRING:
+	case FILTER_OP_GE_STRING:
+	case FILTER_OP_LE_STRING:
+		insn->op = FILTER_INSN_EQ_STRING + (op - FILTER_OP_EQ_STRING);
+		break;
+
+	case FILTER_OP_UNARY_PLUS_S64:
+	case FILTER_OP_CAST_NOP:
+		return 0;
+	case FILTER_OP_UNARY_MINUS_S64:
+		insn->op = FILTER_INSN_UNARY_MINUS_S64;
+		break;
+	case FILTER_OP_UNARY_NOT_S64:
+		insn->op = FILTER_INSN_UNARY_NOT_S64;
+		break;
+
+	case FILTER_OP_AND:
+	case FILTER_OP_OR:
+		insn->op = (op == FILTER_OP_AND) ?
+			FILTER_INSN_AND : FILTER_INSN_OR;
+		/* Bytecode offset, resolved once all offsets are known. */
+		insn->u.v = ((struct logical_op *) pc)->skip_offset;
+		break;
+
+	case FILTER_OP_LOAD_FIELD_REF_STRING:
+		insn->op = FILTER_INSN_LOAD_FIELD_STRING;
+		insn->u.offset = ref->offset;
+		break;
+	case FILTER_OP_LOAD_FIELD_REF_SEQUENCE:
+		insn->op = FILTER_INSN_LOAD_FIELD_SEQUENCE;
+		insn->u.offset = ref->offset;
+		break;
+	case FILTER_OP_LOAD_FIELD_REF_S64:
+		insn->op = FILTER_INSN_LOAD_FIELD_S64;
+		insn->u.offset = ref->offset;
+		break;
+	case FILTER_OP_LOAD_FIELD_REF_USER_STRING:
+		insn->op = FILTER_INSN_LOAD_FIELD_USER_STRING;
+		insn->u.offset = ref->offset;
+		break;
+	case FILTER_OP_LOAD_FIELD_REF_USER_SEQUENCE:
+		insn->op = FILTER_INSN_LOAD_FIELD_USER_SEQUENCE;
+		insn->u.offset = ref->offset;
+		break;
+
+	case FILTER_OP_LOAD_STRING:
+		insn->op = FILTER_INSN_LOAD_STRING;
+		insn->u.str = load->data;
+		break;
+	case FILTER_OP_LOAD_S64:
+		insn->op = FILTER_INSN_LOAD_S64;
+		insn->u.v = ((struct literal_numeric *) load->data)->v;
+		break;
+
+	case FILTER_OP_GET_CONTEXT_REF_STRING:
+		insn->op = FILTER_INSN_GET_CONTEXT_STRING;
+		insn->u.ctx_field = &lttng_static_ctx->fields[ref->offset];
+		break;
+	case FILTER_OP_GET_CONTEXT_REF_S64:
+		insn->op = FILTER_INSN_GET_CONTEXT_S64;
+		insn->u.ctx_field = &lttng_static_ctx->fields[ref->offset];
+		break;
+
+	default:
+		WARN_ON_ONCE(1);
+		return -EINVAL;
+	}
+	return 1;
+}
+
+static
+int filter_insn_is_branch(const struct filter_insn *insn)
+{
+	switch (insn->op) {
+	case FILTER_INSN_AND:
+	case FILTER_INSN_OR:
+	case FILTER_INSN_JUMP:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Evaluate a s64 comparator on constant operands. cmp is the offset of
+ * the comparator from the EQ comparator of its family.
+ */
+static
+int64_t fold_s64_cmp(unsigned int cmp, int64_t bx, int64_t ax)
+{
+	switch (cmp) {
+	case FILTER_INSN_EQ_S64 - FILTER_INSN_EQ_S64:
+		return bx == ax;
+	case FILTER_INSN_NE_S64 - FILTER_INSN_EQ_S64:
+		return bx != ax;
+	case FILTER_INSN_GT_S64 - FILTER_INSN_EQ_S64:
+		return bx > ax;
+	case FILTER_INSN_LT_S64 - FILTER_INSN_EQ_S64:
+		return bx < ax;
+	case FILTER_INSN_GE_S64 - FILTER_INSN_EQ_S64:
+		return bx >= ax;
+	case FILTER_INSN_LE_S64 - FILTER_INSN_EQ_S64:
+		return bx <= ax;
+	default:
+		WARN_ON_ONCE(1);
+		return 0;
+	}
+}
+
+static
+int64_t fold_string_cmp(unsigned int cmp, const char *bx, const char *ax)
+{
+	int diff = lttng_filter_strcmp_literals(bx, ax);
+
+	switch (cmp) {
+	case FILTER_INSN_EQ_STRING - FILTER_INSN_EQ_STRING:
+		return diff == 0;
+	case FILTER_INSN_NE_STRING - FILTER_INSN_EQ_STRING:
+		return diff != 0;
+	case FILTER_INSN_GT_STRING - FILTER_INSN_EQ_STRING:
+		return diff > 0;
+	case FILTER_INSN_LT_STRING - FILTER_INSN_EQ_STRING:
+		return diff < 0;
+	case FILTER_INSN_GE_STRING - FILTER_INSN_EQ_STRING:
+		return diff >= 0;
+	case FILTER_INSN_LE_STRING - FILTER_INSN_EQ_STRING:
+		return diff <= 0;
+	default:
+		WARN_ON_ONCE(1);
+		return 0;
+	}
+}
+
+static
+int is_insn_s64_cmp(const struct filter_insn *insn)
+{
+	return insn->op >= FILTER_INSN_EQ_S64 && insn->op <= FILTER_INSN_LE_S64;
+}
+
+static
+int is_insn_s64_cmp_imm(const struct filter_insn *insn)
+{
+	return insn->op >= FILTER_INSN_EQ_S64_IMM
+		&& insn->op <= FILTER_INSN_LE_S64_IMM;
+}
+
+static
+int is_insn_string_cmp(const struct filter_insn *insn)
+{
+	return insn->op >= FILTER_INSN_EQ_STRING
+		&& insn->op <= FILTER_INSN_LE_STRING;
+}
+
+/*
+ * Fold one constant pattern starting at instruction i. Patterns never
+ * span a branch target past their first instruction, so that code
+ * reached by a branch keeps its semantic. Returns 1 if the code changed.
+ */
+static
+int fold_at(struct filter_insn *insns, int nr_insns, int i,
+		const char *is_target, char *removed)
+{
+	struct filter_insn *insn = &insns[i], *next, *next2 = NULL;
+
+	/* Code following a return or unconditional jump is unreachable. */
+	if ((insn->op == FILTER_INSN_RETURN || insn->op == FILTER_INSN_JUMP)
+			&& i + 1 < nr_insns && !is_target[i + 1]) {
+		removed[i + 1] = 1;
+		return 1;
+	}
+	if (insn->op == FILTER_INSN_JUMP) {
+		if (insn->u.v == i + 1) {
+			removed[i] = 1;
+			return 1;
+		}
+		/* Jumping to a return is returning. */
+		if (insns[insn->u.v].op == FILTER_INSN_RETURN) {
+			insn->op = FILTER_INSN_RETURN;
+			return 1;
+		}
+		return 0;
+	}
+	if (i + 1 >= nr_insns || is_target[i + 1] || removed[i + 1])
+		return 0;
+	next = &insns[i + 1];
+	if (i + 2 < nr_insns && !is_target[i + 2] && !removed[i + 2])
+		next2 = &insns[i + 2];
+
+	switch (insn->op) {
+	case FILTER_INSN_LOAD_S64:
+		if (is_insn_s64_cmp_imm(next)) {
+			insn->u.v = fold_s64_cmp(next->op - FILTER_INSN_EQ_S64_IMM,
+					insn->u.v, next->u.v);
+			removed[i + 1] = 1;
+			return 1;
+		}
+		switch (next->op) {
+		case FILTER_INSN_UNARY_MINUS_S64:
+			insn->u.v = -insn->u.v;
+			removed[i + 1] = 1;
+			return 1;
+		case FILTER_INSN_UNARY_NOT_S64:
+			insn->u.v = !insn->u.v;
+			removed[i + 1] = 1;
+			return 1;
+		case FILTER_INSN_AND:
+			if (insn->u.v) {
+				/* Not taken: evaluates to the right operand. */
+				removed[i] = removed[i + 1] = 1;
+			} else {
+				next->op = FILTER_INSN_JUMP;
+			}
+			return 1;
+		case FILTER_INSN_OR:
+			if (insn->u.v) {
+				insn->u.v = 1;
+				next->op = FILTER_INSN_JUMP;
+			} else {
+				/* Not taken: evaluates to the right operand. */
+				removed[i] = removed[i + 1] = 1;
+			}
+			return 1;
+		case FILTER_INSN_LOAD_S64:
+			if (!next2 || !is_insn_s64_cmp(next2))
+				return 0;
+			insn->u.v = fold_s64_cmp(next2->op - FILTER_INSN_EQ_S64,
+					insn->u.v, next->u.v);
+			removed[i + 1] = removed[i + 2] = 1;
+			return 1;
+		default:
+			return 0;
+		}
+	case FILTER_INSN_LOAD_STRING:
+		if (next->op != FILTER_INSN_LOAD_STRING
+				|| !next2 || !is_insn_string_cmp(next2))
+			return 0;
+		insn->u.v = fold_string_cmp(next2->op - FILTER_INSN_EQ_STRING,
+				insn->u.str, next->u.str);
+		insn->op = FILTER_INSN_LOAD_S64;
+		removed[i + 1] = removed[i + 2] = 1;
+		return 1;
+	case FILTER_INSN_UNARY_NOT_S64:
+		if (next->op != FILTER_INSN_UNARY_NOT_S64)
+			return 0;
+		/* Double negation normalizes to a boolean. */
+		insn->op = FILTER_INSN_NE_S64_IMM;
+		insn->u.v = 0;
+		removed[i + 1] = 1;
+		return 1;
+	case FILTER_INSN_UNARY_MINUS_S64:
+		if (next->op != FILTER_INSN_UNARY_MINUS_S64)
+			return 0;
+		removed[i] = removed[i + 1] = 1;
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Constant folding and dead branch elimination. Branch targets are
+ * instruction indexes while folding. Folding is best effort: it is
+ * skipped if scratch memory cannot be allocated.
+ */
+static
+void filter_insns_fold(struct filter_insn *insns, int *nr_insns)
+{
+	char *is_target, *removed;
+	int *new_index;
+	int n = *nr_insns, i, j, changed;
+
+	is_target = kcalloc(n + 1, sizeof(*is_target), GFP_KERNEL);
+	removed = kcalloc(n + 1, sizeof(*removed), GFP_KERNEL);
+	new_index = kcalloc(n + 1, sizeof(*new_index), GFP_KERNEL);
+	if (!is_target || !removed || !new_index)
+		goto end;
+
+	do {
+		changed = 0;
+		memset(is_target, 0, n + 1);
+		memset(removed, 0, n + 1);
+		for (i = 0; i < n; i++) {
+			if (filter_insn_is_branch(&insns[i]))
+				is_target[insns[i].u.v] = 1;
+		}
+		for (i = 0; i < n; i++) {
+			if (removed[i])
+				continue;
+			changed |= fold_at(insns, n, i, is_target, removed);
+		}
+		if (!changed)
+			break;
+		/*
+		 * Compact. A branch to a removed instruction lands on the
+		 * next instruction kept, which has the same effect.
+		 */
+		for (i = 0, j = 0; i <= n; i++) {
+			new_index[i] = j;
+			if (i < n && !removed[i])
+				j++;
+		}
+		for (i = 0, j = 0; i < n; i++) {
+			if (removed[i])
+				continue;
+			insns[j] = insns[i];
+			if (filter_insn_is_branch(&insns[j]))
+				insns[j].u.v = new_index[insns[j].u.v];
+			j++;
+		}
+		n = j;
+	} while (changed);
+	*nr_insns = n;
+end:
+	kfree(new_index);
+	kfree(removed);
+	kfree(is_target);
+}
+
+/*
+ * Compile specialized bytecode. Must be called after validation and
+ * specialization. Loading an immediate s64 directly followed by a s64
+ * comparator is fused into a single comparison against an immediate
+ * operand, unless the comparator is a branch target. Constant
+ * subexpressions are then folded, and statically known branches
+ * removed.
+ *
+ * On error, bytecode->insns is left NULL and the bytecode stays
+ * interpreted.
+ */
+int lttng_filter_compile_bytecode(struct bytecode_runtime *bytecode)
+{
+	const void * const *dispatch = lttng_filter_compiled_dispatch();
+	char *start_pc = &bytecode->data[0], *pc;
+	unsigned long *targets;
+	int *insn_index = NULL;
+	struct filter_insn *insns = NULL;
+	int nr_ops = 0, nr_insns = 0, len, ret, i;
+
+	targets = kcalloc(BITS_TO_LONGS(bytecode->len + 1),
+			sizeof(unsigned long), GFP_KERNEL);
+	if (!targets)
+		return -ENOMEM;
+
+	/* Count instructions and gather branch targets. */
+	for (pc = start_pc; pc - start_pc < bytecode->len; pc += len) {
+		filter_opcode_t op = *(filter_opcode_t *) pc;
+
+		len = bytecode_op_len(pc);
+		if (len < 0) {
+			ret = len;
+			goto end;
+		}
+		if (op == FILTER_OP_AND || op == FILTER_OP_OR) {
+			uint16_t skip_offset =
+				((struct logical_op *) pc)->skip_offset;
+
+			if (skip_offset >= bytecode->len) {
+				ret = -EINVAL;
+				goto end;
+			}
+			__set_bit(skip_offset, targets);
+		}
+		nr_ops++;
+	}
+
+	insns = kcalloc(nr_ops, sizeof(*insns), GFP_KERNEL);
+	insn_index = kcalloc(bytecode->len, sizeof(*insn_index), GFP_KERNEL);
+	if (!insns || !insn_index) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	for (i = 0; i < bytecode->len; i++)
+		insn_index[i] = -1;
+
+	/* Emit instructions. */
+	for (pc = start_pc; pc - start_pc < bytecode->len; pc += len) {
+		struct filter_insn *insn = &insns[nr_insns];
+		char *next_pc;
+
+		len = bytecode_op_len(pc);
+		insn_index[pc - start_pc] = nr_insns;
+		next_pc = pc + len;
+		if (*(filter_opcode_t *) pc == FILTER_OP_LOAD_S64
+				&& next_pc - start_pc < bytecode->len
+				&& is_s64_comparator(*(filter_opcode_t *) next_pc)
+				&& !test_bit(next_pc - start_pc, targets)) {
+			filter_opcode_t cmp = *(filter_opcode_t *) next_pc;
+
+			insn->op = FILTER_INSN_EQ_S64_IMM + (cmp - FILTER_OP_EQ_S64);
+			insn->u.v = ((struct literal_numeric *)
+				((struct load_op *) pc)->data)->v;
+			insn_index[next_pc - start_pc] = nr_insns;
+			len += sizeof(struct binary_op);
+			nr_insns++;
+			continue;
+		}
+		ret = compile_op(pc, insn);
+		if (ret < 0)
+			goto end;
+		nr_insns += ret;
+	}
+
+	if (!nr_insns || insns[nr_insns - 1].op != FILTER_INSN_RETURN) {
+		ret = -EINVAL;
+		goto end;
+	}
+
+	/*
+	 * Turn branch targets into instruction indexes. A branch to a
+	 * no-op lands on the next emitted instruction.
+	 */
+	for (i = 0; i < nr_insns; i++) {
+		struct filter_insn *insn = &insns[i];
+
+		if (filter_insn_is_branch(insn)) {
+			int target = insn_index[(uint16_t) insn->u.v];
+
+			if (target < 0 || target >= nr_insns) {
+				ret = -EINVAL;
+				goto end;
+			}
+			insn->u.v = target;
+		}
+	}
+
+	filter_insns_fold(insns, &nr_insns);
+
+	/* Resolve branch targets and handlers. */
+	for (i = 0; i < nr_insns; i++) {
+		struct filter_insn *insn = &insns[i];
+
+		if (filter_insn_is_branch(insn))
+			insn->u.target = &insns[insn->u.v];
+		if (dispatch)
+			insn->handler = dispatch[insn->op];
+	}
+
+	/* Filters folded to a constant skip execution entirely. */
+	if (insns[0].op == FILTER_INSN_LOAD_S64
+			&& insns[1].op == FILTER_INSN_RETURN) {
+		if (insns[0].u.v)
+			bytecode->p.always_record = 1;
+		else
+			bytecode->always_discard = 1;
+		dbg_printk("Filter folded to constant %d\n",
+			!!insns[0].u.v);
+	}
+	bytecode->insns = insns;
+	insns = NULL;
+	ret = 0;
+	dbg_printk("Compiled %d bytecode ops into %d insns\n",
+		nr_ops, nr_insns);
+end:
+	kfree(insns);
+	kfree(insn_index);
+	kfree(targets);
+	return ret;
+}
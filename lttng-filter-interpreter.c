@@ -182,6 +182,27 @@ int stack_strcmp(struct estack *stack, int top, const char *cmp_type)
 	return diff;
 }
 
+/*
+ * Compare two string literals with the filter semantic (wildcards and
+ * escapes), for constant folding.
+ */
+int lttng_filter_strcmp_literals(const char *bx, const char *ax)
+{
+	struct estack _stack;
+	struct estack *stack = &_stack;
+	int top = FILTER_STACK_EMPTY + 2;
+
+	estack_bx(stack, top)->u.s.str = bx;
+	estack_ax(stack, top)->u.s.str = ax;
+	estack_bx(stack, top)->u.s.seq_len = UINT_MAX;
+	estack_ax(stack, top)->u.s.seq_len = UINT_MAX;
+	estack_bx(stack, top)->u.s.literal = 1;
+	estack_ax(stack, top)->u.s.literal = 1;
+	estack_bx(stack, top)->u.s.user = 0;
+	estack_ax(stack, top)->u.s.user = 0;
+	return stack_strcmp(stack, top, "fold");
+}
+
 uint64_t lttng_filter_false(void *filter_data,
 		const char *filter_stack_data)
 {
@@ -867,3 +888,423 @@ end:
 #undef OP
 #undef PO
 #undef END_OP
+
+#ifdef INTERPRETER_USE_SWITCH
+
+#define START_INSN							\
+	for (;;) {							\
+		dbg_printk("Executing compiled insn %u\n",		\
+			(unsigned int) insn->op);			\
+		switch (insn->op) {
+
+#define INSN(name)	case name
+
+#define NEXT_INSN	break
+
+#define END_INSN	}						\
+	}
+
+#else
+
+/*
+ * Threaded code: each instruction holds the address of its handler.
+ */
+
+#define START_INSN							\
+	goto *insn->handler;
+
+#define INSN(name)							\
+LABEL_##name
+
+#define NEXT_INSN							\
+		goto *insn->handler;
+
+#define END_INSN
+
+#endif
+
+/*
+ * Execute bytecode compiled by lttng_filter_compile_bytecode().
+ * Operands are pre-decoded, so this is a tight loop over instructions.
+ * When called with a NULL filter_data, store the handler addresses in
+ * the table pointed to by filter_stack_data instead, which allows the
+ * compile stage to resolve the handler of each instruction.
+ *
+ * Return 0 (discard), or raise the 0x1 flag (log event).
+ */
+uint64_t lttng_filter_interpret_compiled(void *filter_data,
+		const char *filter_stack_data)
+{
+	struct bytecode_runtime *bytecode = filter_data;
+	const struct filter_insn *insn;
+	int ret = -EINVAL;
+	uint64_t retval = 0;
+	struct estack _stack;
+	struct estack *stack = &_stack;
+	register int64_t ax = 0, bx = 0;
+	register int top = FILTER_STACK_EMPTY;
+#ifndef INTERPRETER_USE_SWITCH
+	static const void *dispatch[NR_FILTER_INSN_OPS] = {
+		[ FILTER_INSN_RETURN ] = &&LABEL_FILTER_INSN_RETURN,
+
+		[ FILTER_INSN_EQ_S64 ] = &&LABEL_FILTER_INSN_EQ_S64,
+		[ FILTER_INSN_NE_S64 ] = &&LABEL_FILTER_INSN_NE_S64,
+		[ FILTER_INSN_GT_S64 ] = &&LABEL_FILTER_INSN_GT_S64,
+		[ FILTER_INSN_LT_S64 ] = &&LABEL_FILTER_INSN_LT_S64,
+		[ FILTER_INSN_GE_S64 ] = &&LABEL_FILTER_INSN_GE_S64,
+		[ FILTER_INSN_LE_S64 ] = &&LABEL_FILTER_INSN_LE_S64,
+
+		[ FILTER_INSN_EQ_S64_IMM ] = &&LABEL_FILTER_INSN_EQ_S64_IMM,
+		[ FILTER_INSN_NE_S64_IMM ] = &&LABEL_FILTER_INSN_NE_S64_IMM,
+		[ FILTER_INSN_GT_S64_IMM ] = &&LABEL_FILTER_INSN_GT_S64_IMM,
+		[ FILTER_INSN_LT_S64_IMM ] = &&LABEL_FILTER_INSN_LT_S64_IMM,
+		[ FILTER_INSN_GE_S64_IMM ] = &&LABEL_FILTER_INSN_GE_S64_IMM,
+		[ FILTER_INSN_LE_S64_IMM ] = &&LABEL_FILTER_INSN_LE_S64_IMM,
+
+		[ FILTER_INSN_EQ_STRING ] = &&LABEL_FILTER_INSN_EQ_STRING,
+		[ FILTER_INSN_NE_STRING ] = &&LABEL_FILTER_INSN_NE_STRING,
+		[ FILTER_INSN_GT_STRING ] = &&LABEL_FILTER_INSN_GT_STRING,
+		[ FILTER_INSN_LT_STRING ] = &&LABEL_FILTER_INSN_LT_STRING,
+		[ FILTER_INSN_GE_STRING ] = &&LABEL_FILTER_INSN_GE_STRING,
+		[ FILTER_INSN_LE_STRING ] = &&LABEL_FILTER_INSN_LE_STRING,
+
+		[ FILTER_INSN_UNARY_MINUS_S64 ] = &&LABEL_FILTER_INSN_UNARY_MINUS_S64,
+		[ FILTER_INSN_UNARY_NOT_S64 ] = &&LABEL_FILTER_INSN_UNARY_NOT_S64,
+
+		[ FILTER_INSN_AND ] = &&LABEL_FILTER_INSN_AND,
+		[ FILTER_INSN_OR ] = &&LABEL_FILTER_INSN_OR,
+		[ FILTER_INSN_JUMP ] = &&LABEL_FILTER_INSN_JUMP,
+
+		[ FILTER_INSN_LOAD_FIELD_STRING ] = &&LABEL_FILTER_INSN_LOAD_FIELD_STRING,
+		[ FILTER_INSN_LOAD_FIELD_SEQUENCE ] = &&LABEL_FILTER_INSN_LOAD_FIELD_SEQUENCE,
+		[ FILTER_INSN_LOAD_FIELD_S64 ] = &&LABEL_FILTER_INSN_LOAD_FIELD_S64,
+		[ FILTER_INSN_LOAD_FIELD_USER_STRING ] = &&LABEL_FILTER_INSN_LOAD_FIELD_USER_STRING,
+		[ FILTER_INSN_LOAD_FIELD_USER_SEQUENCE ] = &&LABEL_FILTER_INSN_LOAD_FIELD_USER_SEQUENCE,
+
+		[ FILTER_INSN_LOAD_STRING ] = &&LABEL_FILTER_INSN_LOAD_STRING,
+		[ FILTER_INSN_LOAD_S64 ] = &&LABEL_FILTER_INSN_LOAD_S64,
+
+		[ FILTER_INSN_GET_CONTEXT_STRING ] = &&LABEL_FILTER_INSN_GET_CONTEXT_STRING,
+		[ FILTER_INSN_GET_CONTEXT_S64 ] = &&LABEL_FILTER_INSN_GET_CONTEXT_S64,
+	};
+
+	if (unlikely(!bytecode)) {
+		*(const void * const **) filter_stack_data = dispatch;
+		return 0;
+	}
+#else
+	if (unlikely(!bytecode)) {
+		*(const void * const **) filter_stack_data = NULL;
+		return 0;
+	}
+#endif /* #ifndef INTERPRETER_USE_SWITCH */
+
+	insn = bytecode->insns;
+
+	START_INSN
+
+#ifdef INTERPRETER_USE_SWITCH
+		default:
+			printk(KERN_WARNING "unknown compiled filter insn %u\n",
+				(unsigned int) insn->op);
+			ret = -EINVAL;
+			goto end;
+#endif /* INTERPRETER_USE_SWITCH */
+
+		INSN(FILTER_INSN_RETURN):
+			/* LTTNG_FILTER_DISCARD  or LTTNG_FILTER_RECORD_FLAG */
+			retval = !!estack_ax_v;
+			ret = 0;
+			goto end;
+
+		INSN(FILTER_INSN_EQ_S64):
+		{
+			int res;
+
+			res = (estack_bx_v == estack_ax_v);
+			estack_pop(stack, top, ax, bx);
+			estack_ax_v = res;
+			insn++;
+			NEXT_INSN;
+		}
+		INSN(FILTER_INSN_NE_S64):
+		{
+			int res;
+
+			res = (estack_bx_v != estack_ax_v);
+			estack_pop(stack, top, ax, bx);
+			estack_ax_v = res;
+			insn++;
+			NEXT_INSN;
+		}
+		INSN(FILTER_INSN_GT_S64):
+		{
+			int res;
+
+			res = (estack_bx_v > estack_ax_v);
+			estack_pop(stack, top, ax, bx);
+			estack_ax_v = res;
+			insn++;
+			NEXT_INSN;
+		}
+		INSN(FILTER_INSN_LT_S64):
+		{
+			int res;
+
+			res = (estack_bx_v < estack_ax_v);
+			estack_pop(stack, top, ax, bx);
+			estack_ax_v = res;
+			insn++;
+			NEXT_INSN;
+		}
+		INSN(FILTER_INSN_GE_S64):
+		{
+			int res;
+
+			res = (estack_bx_v >= estack_ax_v);
+			estack_pop(stack, top, ax, bx);
+			estack_ax_v = res;
+			insn++;
+			NEXT_INSN;
+		}
+		INSN(FILTER_INSN_LE_S64):
+		{
+			int res;
+
+			res = (estack_bx_v <= estack_ax_v);
+			estack_pop(stack, top, ax, bx);
+			estack_ax_v = res;
+			insn++;
+			NEXT_INSN;
+		}
+
+		INSN(FILTER_INSN_EQ_S64_IMM):
+			estack_ax_v = (estack_ax_v == insn->u.v);
+			insn++;
+			NEXT_INSN;
+		INSN(FILTER_INSN_NE_S64_IMM):
+			estack_ax_v = (estack_ax_v != insn->u.v);
+			insn++;
+			NEXT_INSN;
+		INSN(FILTER_INSN_GT_S64_IMM):
+			estack_ax_v = (estack_ax_v > insn->u.v);
+			insn++;
+			NEXT_INSN;
+		INSN(FILTER_INSN_LT_S64_IMM):
+			estack_ax_v = (estack_ax_v < insn->u.v);
+			insn++;
+			NEXT_INSN;
+		INSN(FILTER_INSN_GE_S64_IMM):
+			estack_ax_v = (estack_ax_v >= insn->u.v);
+			insn++;
+			NEXT_INSN;
+		INSN(FILTER_INSN_LE_S64_IMM):
+			estack_ax_v = (estack_ax_v <= insn->u.v);
+			insn++;
+			NEXT_INSN;
+
+		INSN(FILTER_INSN_EQ_STRING):
+		{
+			int res;
+
+			res = (stack_strcmp(stack, top, "==") == 0);
+			estack_pop(stack, top, ax, bx);
+			estack_ax_v = res;
+			insn++;
+			NEXT_INSN;
+		}
+		INSN(FILTER_INSN_NE_STRING):
+		{
+			int res;
+
+			res = (stack_strcmp(stack, top, "!=") != 0);
+			estack_pop(stack, top, ax, bx);
+			estack_ax_v = res;
+			insn++;
+			NEXT_INSN;
+		}
+		INSN(FILTER_INSN_GT_STRING):
+		{
+			int res;
+
+			res = (stack_strcmp(stack, top, ">") > 0);
+			estack_pop(stack, top, ax, bx);
+			estack_ax_v = res;
+			insn++;
+			NEXT_INSN;
+		}
+		INSN(FILTER_INSN_LT_STRING):
+		{
+			int res;
+
+			res = (stack_strcmp(stack, top, "<") < 0);
+			estack_pop(stack, top, ax, bx);
+			estack_ax_v = res;
+			insn++;
+			NEXT_INSN;
+		}
+		INSN(FILTER_INSN_GE_STRING):
+		{
+			int res;
+
+			res = (stack_strcmp(stack, top, ">=") >= 0);
+			estack_pop(stack, top, ax, bx);
+			estack_ax_v = res;
+			insn++;
+			NEXT_INSN;
+		}
+		INSN(FILTER_INSN_LE_STRING):
+		{
+			int res;
+
+			res = (stack_strcmp(stack, top, "<=") <= 0);
+			estack_pop(stack, top, ax, bx);
+			estack_ax_v = res;
+			insn++;
+			NEXT_INSN;
+		}
+
+		INSN(FILTER_INSN_UNARY_MINUS_S64):
+			estack_ax_v = -estack_ax_v;
+			insn++;
+			NEXT_INSN;
+		INSN(FILTER_INSN_UNARY_NOT_S64):
+			estack_ax_v = !estack_ax_v;
+			insn++;
+			NEXT_INSN;
+
+		INSN(FILTER_INSN_AND):
+			/* If AX is 0, skip and evaluate to 0 */
+			if (unlikely(estack_ax_v == 0)) {
+				insn = insn->u.target;
+			} else {
+				/* Pop 1 when jump not taken */
+				estack_pop(stack, top, ax, bx);
+				insn++;
+			}
+			NEXT_INSN;
+		INSN(FILTER_INSN_OR):
+			/* If AX is nonzero, skip and evaluate to 1 */
+			if (unlikely(estack_ax_v != 0)) {
+				estack_ax_v = 1;
+				insn = insn->u.target;
+			} else {
+				/* Pop 1 when jump not taken */
+				estack_pop(stack, top, ax, bx);
+				insn++;
+			}
+			NEXT_INSN;
+		INSN(FILTER_INSN_JUMP):
+			insn = insn->u.target;
+			NEXT_INSN;
+
+		INSN(FILTER_INSN_LOAD_FIELD_STRING):
+		INSN(FILTER_INSN_LOAD_FIELD_USER_STRING):
+			estack_push(stack, top, ax, bx);
+			estack_ax(stack, top)->u.s.str =
+				*(const char * const *) &filter_stack_data[insn->u.offset];
+			if (unlikely(!estack_ax(stack, top)->u.s.str)) {
+				dbg_printk("Filter warning: loading a NULL string.\n");
+				ret = -EINVAL;
+				goto end;
+			}
+			estack_ax(stack, top)->u.s.seq_len = UINT_MAX;
+			estack_ax(stack, top)->u.s.literal = 0;
+			estack_ax(stack, top)->u.s.user =
+				(insn->op == FILTER_INSN_LOAD_FIELD_USER_STRING);
+			insn++;
+			NEXT_INSN;
+
+		INSN(FILTER_INSN_LOAD_FIELD_SEQUENCE):
+		INSN(FILTER_INSN_LOAD_FIELD_USER_SEQUENCE):
+			estack_push(stack, top, ax, bx);
+			estack_ax(stack, top)->u.s.seq_len =
+				*(unsigned long *) &filter_stack_data[insn->u.offset];
+			estack_ax(stack, top)->u.s.str =
+				*(const char **) (&filter_stack_data[insn->u.offset
+								+ sizeof(unsigned long)]);
+			if (unlikely(!estack_ax(stack, top)->u.s.str)) {
+				dbg_printk("Filter warning: loading a NULL sequence.\n");
+				ret = -EINVAL;
+				goto end;
+			}
+			estack_ax(stack, top)->u.s.literal = 0;
+			estack_ax(stack, top)->u.s.user =
+				(insn->op == FILTER_INSN_LOAD_FIELD_USER_SEQUENCE);
+			insn++;
+			NEXT_INSN;
+
+		INSN(FILTER_INSN_LOAD_FIELD_S64):
+			estack_push(stack, top, ax, bx);
+			estack_ax_v =
+				((struct literal_numeric *) &filter_stack_data[insn->u.offset])->v;
+			insn++;
+			NEXT_INSN;
+
+		INSN(FILTER_INSN_LOAD_STRING):
+			estack_push(stack, top, ax, bx);
+			estack_ax(stack, top)->u.s.str = insn->u.str;
+			estack_ax(stack, top)->u.s.seq_len = UINT_MAX;
+			estack_ax(stack, top)->u.s.literal = 1;
+			estack_ax(stack, top)->u.s.user = 0;
+			insn++;
+			NEXT_INSN;
+
+		INSN(FILTER_INSN_LOAD_S64):
+			estack_push(stack, top, ax, bx);
+			estack_ax_v = insn->u.v;
+			insn++;
+			NEXT_INSN;
+
+		INSN(FILTER_INSN_GET_CONTEXT_STRING):
+		{
+			struct lttng_ctx_field *ctx_field = insn->u.ctx_field;
+			union lttng_ctx_value v;
+
+			ctx_field->get_value(ctx_field, &v);
+			estack_push(stack, top, ax, bx);
+			estack_ax(stack, top)->u.s.str = v.str;
+			if (unlikely(!estack_ax(stack, top)->u.s.str)) {
+				dbg_printk("Filter warning: loading a NULL string.\n");
+				ret = -EINVAL;
+				goto end;
+			}
+			estack_ax(stack, top)->u.s.seq_len = UINT_MAX;
+			estack_ax(stack, top)->u.s.literal = 0;
+			estack_ax(stack, top)->u.s.user = 0;
+			insn++;
+			NEXT_INSN;
+		}
+
+		INSN(FILTER_INSN_GET_CONTEXT_S64):
+		{
+			struct lttng_ctx_field *ctx_field = insn->u.ctx_field;
+			union lttng_ctx_value v;
+
+			ctx_field->get_value(ctx_field, &v);
+			estack_push(stack, top, ax, bx);
+			estack_ax_v = v.s64;
+			insn++;
+			NEXT_INSN;
+		}
+
+	END_INSN
+end:
+	/* return 0 (discard) on error */
+	if (ret)
+		return 0;
+	return retval;
+}
+
+const void * const *lttng_filter_compiled_dispatch(void)
+{
+	const void * const *dispatch;
+
+	lttng_filter_interpret_compiled(NULL, (const char *) &dispatch);
+	return dispatch;
+}
+
+#undef START_INSN
+#undef INSN
+#undef NEXT_INSN
+#undef END_INSN
@@ -20,11 +20,21 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <linux/module.h>
 #include <linux/list.h>
 #include <linux/slab.h>
 
 #include "lttng-filter.h"
 
+/*
+ * Compile filter bytecode at link time. Filters linked while this is 0
+ * run on the interpreter, which allows comparing both executors.
+ */
+static int filter_compile = 1;
+module_param(filter_compile, int, 0644);
+MODULE_PARM_DESC(filter_compile,
+		 "Compile filter bytecode into threaded code (default: 1)");
+
 static const char *opnames[] = {
 	[ FILTER_OP_UNKNOWN ] = "UNKNOWN",
 
@@ -300,6 +310,17 @@ int apply_reloc(struct lttng_event *event,
 	return 0;
 }
 
+static
+uint64_t (*lttng_filter_runtime_func(struct bytecode_runtime *runtime))
+		(void *filter_data, const char *filter_stack_data)
+{
+	if (runtime->always_discard)
+		return lttng_filter_false;
+	if (runtime->insns)
+		return lttng_filter_interpret_compiled;
+	return lttng_filter_interpret_bytecode;
+}
+
 static
 int bytecode_is_linked(struct lttng_filter_bytecode_node *filter_bytecode,
 		struct lttng_event *event)
@@ -374,7 +395,16 @@ int _lttng_filter_event_link_bytecode(struct lttng_event *event,
 	if (ret) {
 		goto link_error;
 	}
-	runtime->p.filter = lttng_filter_interpret_bytecode;
+	/*
+	 * Compile bytecode. On failure, keep interpreting the
+	 * specialized bytecode.
+	 */
+	if (ACCESS_ONCE(filter_compile)) {
+		ret = lttng_filter_compile_bytecode(runtime);
+		if (ret)
+			dbg_printk("Bytecode not compiled, interpreting it.\n");
+	}
+	runtime->p.filter = lttng_filter_runtime_func(runtime);
 	runtime->p.link_failed = 0;
 	list_add_rcu(&runtime->p.node, insert_loc);
 	dbg_printk("Linking successful.\n");
@@ -393,61 +423,58 @@ void lttng_filter_sync_state(struct lttng_bytecode_runtime *runtime)
 {
 	struct lttng_filter_bytecode_node *bc = runtime->bc;
 
-	if (!bc->enabler->enabled || runtime->link_failed)
+	if ((bc->enabler && !bc->enabler->enabled) || runtime->link_failed)
 		runtime->filter = lttng_filter_false;
 	else
-		runtime->filter = lttng_filter_interpret_bytecode;
+		runtime->filter = lttng_filter_runtime_func(
+			container_of(runtime, struct bytecode_runtime, p));
 }
 
 /*
- * Link bytecode for all enablers referenced by an event.
+ * Link one bytecode to an event, at its priority (seqnum) in increasing
+ * order. Linking a bytecode twice is a no-op.
  */
-void lttng_enabler_event_link_bytecode(struct lttng_event *event,
-		struct lttng_enabler *enabler)
+int lttng_event_link_bytecode(struct lttng_event *event,
+		struct lttng_filter_bytecode_node *bc)
 {
-	struct lttng_filter_bytecode_node *bc;
 	struct lttng_bytecode_runtime *runtime;
+	struct list_head *insert_loc;
 
 	/* Can only be called for events with desc attached */
 	WARN_ON_ONCE(!event->desc);
 
-	/* Link each bytecode. */
-	list_for_each_entry(bc, &enabler->filter_bytecode_head, node) {
-		int found = 0, ret;
-		struct list_head *insert_loc;
-
-		list_for_each_entry(runtime,
-				&event->bytecode_runtime_head, node) {
-			if (runtime->bc == bc) {
-				found = 1;
-				break;
-			}
-		}
+	list_for_each_entry(runtime, &event->bytecode_runtime_head, node) {
 		/* Skip bytecode already linked */
-		if (found)
-			continue;
-
-		/*
-		 * Insert at specified priority (seqnum) in increasing
-		 * order.
-		 */
-		list_for_each_entry_reverse(runtime,
-				&event->bytecode_runtime_head, node) {
-			if (runtime->bc->bc.seqnum < bc->bc.seqnum) {
-				/* insert here */
-				insert_loc = &runtime->node;
-				goto add_within;
-			}
+		if (runtime->bc == bc)
+			return 0;
+	}
+	list_for_each_entry_reverse(runtime,
+			&event->bytecode_runtime_head, node) {
+		if (runtime->bc->bc.seqnum < bc->bc.seqnum) {
+			/* insert here */
+			insert_loc = &runtime->node;
+			goto add_within;
 		}
-		/* Add to head to list */
-		insert_loc = &event->bytecode_runtime_head;
-	add_within:
-		dbg_printk("linking bytecode\n");
-		ret = _lttng_filter_event_link_bytecode(event, bc,
-				insert_loc);
-		if (ret) {
+	}
+	/* Add to head to list */
+	insert_loc = &event->bytecode_runtime_head;
+add_within:
+	dbg_printk("linking bytecode\n");
+	return _lttng_filter_event_link_bytecode(event, bc, insert_loc);
+}
+
+/*
+ * Link bytecode for all enablers referenced by an event.
+ */
+void lttng_enabler_event_link_bytecode(struct lttng_event *event,
+		struct lttng_enabler *enabler)
+{
+	struct lttng_filter_bytecode_node *bc;
+
+	/* Link each bytecode. */
+	list_for_each_entry(bc, &enabler->filter_bytecode_head, node) {
+		if (lttng_event_link_bytecode(event, bc))
 			dbg_printk("[lttng filter] warning: cannot link event bytecode\n");
-		}
 	}
 }
 
@@ -477,6 +504,7 @@ void lttng_free_event_filter_runtime(struct lttng_event *event)
 
 	list_for_each_entry_safe(runtime, tmp,
 			&event->bytecode_runtime_head, p.node) {
+		kfree(runtime->insns);
 		kfree(runtime);
 	}
 }
@@ -46,9 +46,85 @@ do {								\
 } while (0)
 #endif
 
+/*
+ * Compiled filter instructions, produced from the specialized bytecode
+ * by lttng_filter_compile_bytecode().
+ */
+enum filter_insn_op {
+	FILTER_INSN_RETURN = 0,
+
+	/* s64 binary comparators (bx, ax) */
+	FILTER_INSN_EQ_S64,
+	FILTER_INSN_NE_S64,
+	FILTER_INSN_GT_S64,
+	FILTER_INSN_LT_S64,
+	FILTER_INSN_GE_S64,
+	FILTER_INSN_LE_S64,
+
+	/* s64 comparators against an immediate operand (ax, imm) */
+	FILTER_INSN_EQ_S64_IMM,
+	FILTER_INSN_NE_S64_IMM,
+	FILTER_INSN_GT_S64_IMM,
+	FILTER_INSN_LT_S64_IMM,
+	FILTER_INSN_GE_S64_IMM,
+	FILTER_INSN_LE_S64_IMM,
+
+	/* string binary comparators (bx, ax) */
+	FILTER_INSN_EQ_STRING,
+	FILTER_INSN_NE_STRING,
+	FILTER_INSN_GT_STRING,
+	FILTER_INSN_LT_STRING,
+	FILTER_INSN_GE_STRING,
+	FILTER_INSN_LE_STRING,
+
+	/* unary */
+	FILTER_INSN_UNARY_MINUS_S64,
+	FILTER_INSN_UNARY_NOT_S64,
+
+	/* logical */
+	FILTER_INSN_AND,
+	FILTER_INSN_OR,
+	FILTER_INSN_JUMP,		/* unconditional, from folded branches */
+
+	/* load field */
+	FILTER_INSN_LOAD_FIELD_STRING,
+	FILTER_INSN_LOAD_FIELD_SEQUENCE,
+	FILTER_INSN_LOAD_FIELD_S64,
+	FILTER_INSN_LOAD_FIELD_USER_STRING,
+	FILTER_INSN_LOAD_FIELD_USER_SEQUENCE,
+
+	/* load immediate */
+	FILTER_INSN_LOAD_STRING,
+	FILTER_INSN_LOAD_S64,
+
+	/* get context */
+	FILTER_INSN_GET_CONTEXT_STRING,
+	FILTER_INSN_GET_CONTEXT_S64,
+
+	NR_FILTER_INSN_OPS,
+};
+
+/*
+ * Compiled instruction: operands are decoded, and the dispatch target
+ * and branch target are resolved at link time.
+ */
+struct filter_insn {
+	const void *handler;		/* Dispatch target, NULL with switch */
+	enum filter_insn_op op;
+	union {
+		uint16_t offset;	/* Field offset in filter stack data */
+		int64_t v;		/* Immediate s64 operand */
+		const char *str;	/* Immediate string operand */
+		struct lttng_ctx_field *ctx_field;
+		const struct filter_insn *target;	/* Branch target */
+	} u;
+};
+
 /* Linked bytecode. Child of struct lttng_bytecode_runtime. */
 struct bytecode_runtime {
 	struct lttng_bytecode_runtime p;
+	struct filter_insn *insns;	/* Compiled bytecode, NULL if not compiled */
+	int always_discard;		/* Filter folded to false */
 	uint16_t len;
 	char data[0];
 };
@@ -169,10 +245,15 @@ const char *lttng_filter_print_op(enum filter_op op);
 
 int lttng_filter_validate_bytecode(struct bytecode_runtime *bytecode);
 int lttng_filter_specialize_bytecode(struct bytecode_runtime *bytecode);
+int lttng_filter_compile_bytecode(struct bytecode_runtime *bytecode);
 
 uint64_t lttng_filter_false(void *filter_data,
 		const char *filter_stack_data);
 uint64_t lttng_filter_interpret_bytecode(void *filter_data,
 		const char *filter_stack_data);
+uint64_t lttng_filter_interpret_compiled(void *filter_data,
+		const char *filter_stack_data);
+const void * const *lttng_filter_compiled_dispatch(void);
+int lttng_filter_strcmp_literals(const char *bx, const char *ax);
 
 #endif /* _LTTNG_FILTER_H */
@@ -24,9 +24,15 @@
 #include <linux/list.h>
 #include <linux/mutex.h>
 #include <linux/seq_file.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
 
+#include "wrapper/list.h"
 #include "lttng-events.h"
 
+#define LTTNG_EVENT_METADATA_HT_BITS		10
+#define LTTNG_EVENT_METADATA_HT_SIZE		(1U << LTTNG_EVENT_METADATA_HT_BITS)
+
 /*
  * probe list is protected by sessions lock.
  */
@@ -44,6 +50,136 @@ static LIST_HEAD(lazy_probe_init);
  */
 static int lazy_nesting;
 
+/*
+ * Pre-rendered event metadata, indexed by event descriptor address.
+ * Protected by the sessions lock.
+ */
+static struct hlist_head event_metadata_ht[LTTNG_EVENT_METADATA_HT_SIZE];
+
+/*
+ * Render the field declarations of each event of the probe. Events
+ * which cannot be rendered are left out of the cache, and are rendered
+ * by each session statedump instead.
+ */
+static
+int probe_metadata_cache_create(struct lttng_probe_desc *desc)
+{
+	int i;
+
+	desc->metadata_cache = kcalloc(desc->nr_events,
+			sizeof(struct lttng_event_metadata_cache), GFP_KERNEL);
+	if (!desc->metadata_cache)
+		return -ENOMEM;
+	for (i = 0; i < desc->nr_events; i++) {
+		struct lttng_event_metadata_cache *cache =
+			&desc->metadata_cache[i];
+		const struct lttng_event_desc *event_desc =
+			desc->event_desc[i];
+
+		cache->desc = event_desc;
+		/* cache->fields stays NULL on error. */
+		(void) lttng_metadata_fields_render(event_desc->fields,
+				event_desc->nr_fields, &cache->fields,
+				&cache->len);
+	}
+	return 0;
+}
+
+static
+void probe_metadata_cache_destroy(struct lttng_probe_desc *desc)
+{
+	int i;
+
+	if (!desc->metadata_cache)
+		return;
+	for (i = 0; i < desc->nr_events; i++)
+		kfree(desc->metadata_cache[i].fields);
+	kfree(desc->metadata_cache);
+	desc->metadata_cache = NULL;
+}
+
+/*
+ * Called under sessions lock.
+ */
+static
+void probe_metadata_cache_hash(struct lttng_probe_desc *desc)
+{
+	int i;
+
+	for (i = 0; i < desc->nr_events; i++) {
+		struct lttng_event_metadata_cache *cache =
+			&desc->metadata_cache[i];
+
+		if (!cache->fields)
+			continue;
+		hlist_add_head(&cache->hlist,
+			&event_metadata_ht[hash_ptr(cache->desc,
+				LTTNG_EVENT_METADATA_HT_BITS)]);
+	}
+}
+
+/*
+ * Called under sessions lock.
+ */
+static
+void probe_metadata_cache_unhash(struct lttng_probe_desc *desc)
+{
+	int i;
+
+	if (!desc->metadata_cache)
+		return;
+	for (i = 0; i < desc->nr_events; i++) {
+		struct lttng_event_metadata_cache *cache =
+			&desc->metadata_cache[i];
+
+		if (!cache->fields)
+			continue;
+		hlist_del(&cache->hlist);
+	}
+}
+
+/*
+ * Pre-render the metadata of a probe which is not registered through
+ * lttng_probe_register(), e.g. the system call probes.
+ * Called under sessions lock.
+ */
+int lttng_probe_metadata_cache_register(struct lttng_probe_desc *desc)
+{
+	int ret;
+
+	ret = probe_metadata_cache_create(desc);
+	if (ret)
+		return ret;
+	probe_metadata_cache_hash(desc);
+	return 0;
+}
+
+/*
+ * Called under sessions lock.
+ */
+void lttng_probe_metadata_cache_unregister(struct lttng_probe_desc *desc)
+{
+	probe_metadata_cache_unhash(desc);
+	probe_metadata_cache_destroy(desc);
+}
+
+/*
+ * Called under sessions lock.
+ */
+const struct lttng_event_metadata_cache *
+	lttng_event_metadata_cache_get(const struct lttng_event_desc *desc)
+{
+	struct lttng_event_metadata_cache *cache;
+	struct hlist_head *head;
+
+	head = &event_metadata_ht[hash_ptr(desc, LTTNG_EVENT_METADATA_HT_BITS)];
+	lttng_hlist_for_each_entry(cache, head, hlist) {
+		if (cache->desc == desc)
+			return cache;
+	}
+	return NULL;
+}
+
 /*
  * Called under sessions lock.
  */
@@ -164,6 +300,14 @@ int lttng_probe_register(struct lttng_probe_desc *desc)
 {
 	int ret = 0;
 
+	/*
+	 * Render the event metadata before taking the sessions lock:
+	 * it only depends on the static event descriptions.
+	 */
+	ret = probe_metadata_cache_create(desc);
+	if (ret)
+		return ret;
+
 	lttng_lock_sessions();
 
 	/*
@@ -173,6 +317,7 @@ int lttng_probe_register(struct lttng_probe_desc *desc)
 		ret = -EEXIST;
 		goto end;
 	}
+	probe_metadata_cache_hash(desc);
 	list_add(&desc->lazy_init_head, &lazy_probe_init);
 	desc->lazy = 1;
 	pr_debug("LTTng: adding probe %s containing %u events to lazy registration list\n",
@@ -186,6 +331,8 @@ int lttng_probe_register(struct lttng_probe_desc *desc)
 		fixup_lazy_probes();
 end:
 	lttng_unlock_sessions();
+	if (ret)
+		probe_metadata_cache_destroy(desc);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(lttng_probe_register);
@@ -197,8 +344,10 @@ void lttng_probe_unregister(struct lttng_probe_desc *desc)
 		list_del(&desc->head);
 	else
 		list_del(&desc->lazy_init_head);
+	probe_metadata_cache_unhash(desc);
 	pr_debug("LTTng: just unregistered probe %s\n", desc->provider);
 	lttng_unlock_sessions();
+	probe_metadata_cache_destroy(desc);
 }
 EXPORT_SYMBOL_GPL(lttng_probe_unregister);
 
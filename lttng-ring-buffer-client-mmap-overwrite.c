@@ -26,6 +26,7 @@
 #define RING_BUFFER_MODE_TEMPLATE		RING_BUFFER_OVERWRITE
 #define RING_BUFFER_MODE_TEMPLATE_STRING	"overwrite-mmap"
 #define RING_BUFFER_OUTPUT_TEMPLATE		RING_BUFFER_MMAP
+#define RING_BUFFER_BACKEND_TEMPLATE		RING_BUFFER_PAGE
 #include "lttng-ring-buffer-client.h"
 
 MODULE_LICENSE("GPL and additional rights");
@@ -22,6 +22,7 @@
 
 #include <linux/module.h>
 #include <linux/types.h>
+#include <linux/sched.h>
 #include "lib/bitfield.h"
 #include "wrapper/vmalloc.h"	/* for wrapper_vmalloc_sync_all() */
 #include "wrapper/trace-clock.h"
@@ -32,6 +33,15 @@
 #define LTTNG_COMPACT_EVENT_BITS	5
 #define LTTNG_COMPACT_TSC_BITS		27
 
+/*
+ * Clients default to per-cpu buffers. Per-node clients share each buffer
+ * between the CPUs of a NUMA node, which needs global synchronization.
+ */
+#ifndef RING_BUFFER_ALLOC_TEMPLATE
+#define RING_BUFFER_ALLOC_TEMPLATE		RING_BUFFER_ALLOC_PER_CPU
+#define RING_BUFFER_SYNC_TEMPLATE		RING_BUFFER_SYNC_PER_CPU
+#endif
+
 static struct lttng_transport lttng_relay_transport;
 
 /*
@@ -91,25 +101,13 @@ size_t ctx_get_size(size_t offset, struct lttng_ctx *ctx)
 	if (likely(!ctx))
 		return 0;
 	offset += lib_ring_buffer_align(offset, ctx->largest_align);
+	if (likely(ctx->fixed_size))
+		return offset - orig_offset + ctx->fixed_size;
 	for (i = 0; i < ctx->nr_fields; i++)
 		offset += ctx->fields[i].get_size(offset);
 	return offset - orig_offset;
 }
 
-static inline
-void ctx_record(struct lib_ring_buffer_ctx *bufctx,
-		struct lttng_channel *chan,
-		struct lttng_ctx *ctx)
-{
-	int i;
-
-	if (likely(!ctx))
-		return;
-	lib_ring_buffer_align_ctx(bufctx, ctx->largest_align);
-	for (i = 0; i < ctx->nr_fields; i++)
-		ctx->fields[i].record(&ctx->fields[i], bufctx, chan);
-}
-
 /*
  * record_header_size - Calculate the header size and padding necessary.
  * @config: ring buffer instance configuration
@@ -178,6 +176,76 @@ unsigned char record_header_size(const struct lib_ring_buffer_config *config,
 
 #include "wrapper/ringbuffer/api.h"
 
+static const struct lib_ring_buffer_config client_config;
+
+static inline
+void ctx_record_int(struct lib_ring_buffer_ctx *bufctx, int value)
+{
+	lib_ring_buffer_align_ctx(bufctx, lttng_alignof(value));
+	lib_ring_buffer_write(&client_config, bufctx, &value, sizeof(value));
+}
+
+/*
+ * The common contexts are recorded inline, to save two indirect calls
+ * per context field on each event. They match the record() callbacks
+ * of lttng-context-*.c.
+ */
+static inline
+void ctx_record(struct lib_ring_buffer_ctx *bufctx,
+		struct lttng_channel *chan,
+		struct lttng_ctx *ctx)
+{
+	int i;
+
+	if (likely(!ctx))
+		return;
+	lib_ring_buffer_align_ctx(bufctx, ctx->largest_align);
+	for (i = 0; i < ctx->nr_fields; i++) {
+		struct lttng_ctx_field *field = &ctx->fields[i];
+
+		switch (field->record_type) {
+		case LTTNG_CTX_RECORD_PID:
+			ctx_record_int(bufctx, task_tgid_nr(current));
+			break;
+		case LTTNG_CTX_RECORD_TID:
+			ctx_record_int(bufctx, task_pid_nr(current));
+			break;
+		case LTTNG_CTX_RECORD_VPID:
+			ctx_record_int(bufctx, lttng_ctx_cache_get()->vpid);
+			break;
+		case LTTNG_CTX_RECORD_VTID:
+			ctx_record_int(bufctx, lttng_ctx_cache_get()->vtid);
+			break;
+		case LTTNG_CTX_RECORD_PPID:
+			ctx_record_int(bufctx, lttng_ctx_cache_get()->ppid);
+			break;
+		case LTTNG_CTX_RECORD_VPPID:
+			ctx_record_int(bufctx, lttng_ctx_cache_get()->vppid);
+			break;
+		case LTTNG_CTX_RECORD_CPU_ID:
+			ctx_record_int(bufctx, bufctx->cpu);
+			break;
+		case LTTNG_CTX_RECORD_PRIO:
+			/* Same as task_prio(), which is not exported. */
+			ctx_record_int(bufctx, current->prio - MAX_RT_PRIO);
+			break;
+		case LTTNG_CTX_RECORD_NICE:
+			ctx_record_int(bufctx, task_nice(current));
+			break;
+		case LTTNG_CTX_RECORD_PROCNAME:
+			lib_ring_buffer_write(&client_config, bufctx,
+				current->comm, sizeof(current->comm));
+			break;
+		case LTTNG_CTX_RECORD_NONE:
+			break;
+		case LTTNG_CTX_RECORD_CALLBACK:
+		default:
+			field->record(field, bufctx, chan);
+			break;
+		}
+	}
+}
+
 static
 void lttng_write_event_header_slow(const struct lib_ring_buffer_config *config,
 				 struct lib_ring_buffer_ctx *ctx,
@@ -310,8 +378,6 @@ void lttng_write_event_header_slow(const struct lib_ring_buffer_config *config,
 	lib_ring_buffer_align_ctx(ctx, ctx->largest_align);
 }
 
-static const struct lib_ring_buffer_config client_config;
-
 static u64 client_ring_buffer_clock_read(struct channel *chan)
 {
 	return lib_ring_buffer_clock_read(chan);
@@ -508,10 +574,10 @@ static const struct lib_ring_buffer_config client_config = {
 	.cb.buffer_finalize = client_buffer_finalize,
 
 	.tsc_bits = LTTNG_COMPACT_TSC_BITS,
-	.alloc = RING_BUFFER_ALLOC_PER_CPU,
-	.sync = RING_BUFFER_SYNC_PER_CPU,
+	.alloc = RING_BUFFER_ALLOC_TEMPLATE,
+	.sync = RING_BUFFER_SYNC_TEMPLATE,
 	.mode = RING_BUFFER_MODE_TEMPLATE,
-	.backend = RING_BUFFER_PAGE,
+	.backend = RING_BUFFER_BACKEND_TEMPLATE,
 	.output = RING_BUFFER_OUTPUT_TEMPLATE,
 	.oops = RING_BUFFER_OOPS_CONSISTENCY,
 	.ipi = RING_BUFFER_IPI_BARRIER,
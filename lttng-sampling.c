@@ -0,0 +1,297 @@
+/*
+ * lttng-sampling.c
+ *
+ * LTTng per-event sampling.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; only
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/timer.h>
+#include <linux/jiffies.h>
+#include <linux/time.h>
+#include <linux/err.h>
+#include <linux/math64.h>
+
+#include "wrapper/trace-clock.h"
+#include "wrapper/vmalloc.h"	/* for wrapper_vmalloc_sync_all() */
+#include "wrapper/percpu-defs.h"
+#include "wrapper/ringbuffer/frontend_types.h"
+#include "lttng-events.h"
+#include "lttng-endian.h"
+#include "lttng-tracer.h"
+
+/*
+ * Sampling is evaluated per CPU: a period of N records 1 in N hits of
+ * each CPU, and a rate of R records at most R hits per second on each
+ * CPU, with bursts of up to one second worth of hits.
+ *
+ * Once per second, a timer writes the number of hits sampled out on all
+ * CPUs since its last report to the channel, in a lttng_sampled_out
+ * record. Nothing is written while no hit is sampled out.
+ *
+ * Times are in trace clock units: one second is trace_clock_freq().
+ *
+ * The per-CPU state is updated with preemption disabled, but without
+ * protection against probes nested from interrupt or NMI context on
+ * the same CPU: a nested hit can be miscounted.
+ */
+struct lttng_sampler {
+	uint64_t count;		/* Hits since the last sample (period) */
+	uint64_t tat;		/* Theoretical arrival time (rate) */
+};
+
+#define LTTNG_SAMPLING_REPORT_INTERVAL	HZ
+
+static const struct lttng_event_field lttng_sampled_out_fields[] = {
+	{
+		.name = "id",
+		.type = __type_integer(uint32_t, __BYTE_ORDER, 10, none),
+	},
+	{
+		.name = "sampled_out",
+		.type = __type_integer(uint64_t, __BYTE_ORDER, 10, none),
+	},
+};
+
+static const struct lttng_event_desc lttng_sampled_out_desc = {
+	.name = "lttng_sampled_out",
+	.fields = lttng_sampled_out_fields,
+	.nr_fields = ARRAY_SIZE(lttng_sampled_out_fields),
+	.owner = THIS_MODULE,
+};
+
+int lttng_sampling_validate(const struct lttng_kernel_event *event_param)
+{
+	const struct lttng_kernel_event_sampling *param =
+		&event_param->sampling;
+
+	switch (param->type) {
+	case LTTNG_KERNEL_SAMPLING_NONE:
+		return 0;
+	case LTTNG_KERNEL_SAMPLING_PERIOD:
+		if (!param->value)
+			return -EINVAL;
+		break;
+	case LTTNG_KERNEL_SAMPLING_RATE:
+		if (!param->value || param->value > NSEC_PER_SEC)
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+	switch (event_param->instrumentation) {
+	case LTTNG_KERNEL_TRACEPOINT:
+	case LTTNG_KERNEL_KPROBE:
+	case LTTNG_KERNEL_KRETPROBE:
+	case LTTNG_KERNEL_FUNCTION:
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Create the lttng_sampled_out event of the channel on first use. It is
+ * destroyed along with the sampled event if the creation of the latter
+ * fails. Called with sessions_mutex held.
+ */
+static
+int lttng_sampling_create_report_event(struct lttng_event *sampled)
+{
+	struct lttng_channel *chan = sampled->chan;
+	struct lttng_kernel_event ev;
+	struct lttng_event *event;
+
+	if (chan->sampling_event)
+		return 0;
+	memset(&ev, 0, sizeof(ev));
+	strncpy(ev.name, lttng_sampled_out_desc.name,
+		LTTNG_KERNEL_SYM_NAME_LEN);
+	ev.name[LTTNG_KERNEL_SYM_NAME_LEN - 1] = '\0';
+	ev.instrumentation = LTTNG_KERNEL_NOOP;
+	event = _lttng_event_create(chan, &ev, NULL, &lttng_sampled_out_desc,
+			LTTNG_KERNEL_NOOP);
+	if (IS_ERR(event))
+		return PTR_ERR(event);
+	chan->sampling_event = event;
+	sampled->sampling.new_report = event;
+	return 0;
+}
+
+/*
+ * Called with sessions_mutex held, before the event is registered.
+ */
+int lttng_sampling_init(struct lttng_event *event,
+		const struct lttng_kernel_event_sampling *param)
+{
+	struct lttng_event_sampling *sampling = &event->sampling;
+	int ret;
+
+	if (param->type == LTTNG_KERNEL_SAMPLING_NONE)
+		return 0;
+	ret = lttng_sampling_create_report_event(event);
+	if (ret)
+		return ret;
+	sampling->state = alloc_percpu(struct lttng_sampler);
+	if (!sampling->state)
+		return -ENOMEM;
+	wrapper_vmalloc_sync_all();
+	sampling->value = param->value;
+	if (param->type == LTTNG_KERNEL_SAMPLING_RATE)
+		sampling->interval = div64_u64(trace_clock_freq(),
+				param->value);
+	sampling->type = param->type;
+	return 0;
+}
+
+/*
+ * Called with sessions_mutex held, on event destruction, or when the
+ * creation of the event fails.
+ */
+void lttng_sampling_destroy(struct lttng_event *event)
+{
+	struct lttng_event *report = event->sampling.new_report;
+
+	if (report) {
+		event->chan->sampling_event = NULL;
+		hlist_del(&report->hlist);
+		_lttng_event_destroy(report);
+	}
+	free_percpu(event->sampling.state);
+}
+
+static
+int lttng_sampling_report(struct lttng_event *event, uint64_t sampled_out)
+{
+	struct lttng_channel *chan = event->chan;
+	struct lttng_event *report = chan->sampling_event;
+	struct lib_ring_buffer_ctx ctx;
+	uint32_t id = event->id;
+	size_t event_len;
+	int ret;
+
+	event_len = sizeof(id);
+	event_len += lib_ring_buffer_align(event_len, lttng_alignof(sampled_out));
+	event_len += sizeof(sampled_out);
+	lib_ring_buffer_ctx_init(&ctx, chan->chan, report, event_len,
+				 lttng_alignof(sampled_out), -1);
+	ret = chan->ops->event_reserve(&ctx, report->id);
+	if (ret < 0)
+		return ret;
+	lib_ring_buffer_align_ctx(&ctx, lttng_alignof(id));
+	chan->ops->event_write(&ctx, &id, sizeof(id));
+	lib_ring_buffer_align_ctx(&ctx, lttng_alignof(sampled_out));
+	chan->ops->event_write(&ctx, &sampled_out, sizeof(sampled_out));
+	chan->ops->event_commit(&ctx);
+	return 0;
+}
+
+/*
+ * Report timer. The sampled_out event counters only grow, so the hits
+ * to report are the difference between their sum and the sum at the
+ * last report.
+ */
+static
+void lttng_sampling_report_timer(unsigned long data)
+{
+	struct lttng_event *event = (struct lttng_event *) data;
+	struct lttng_event_sampling *sampling = &event->sampling;
+	struct lttng_channel *chan = event->chan;
+	uint64_t sampled_out = 0;
+	int cpu;
+
+	if (ACCESS_ONCE(chan->session->active)
+			&& ACCESS_ONCE(chan->enabled)) {
+		for_each_possible_cpu(cpu)
+			sampled_out += ACCESS_ONCE(per_cpu_ptr(event->counters,
+					cpu)->sampled_out);
+		if (sampled_out != sampling->reported
+				&& !lttng_sampling_report(event,
+					sampled_out - sampling->reported))
+			sampling->reported = sampled_out;
+	}
+	mod_timer(&sampling->timer, jiffies + LTTNG_SAMPLING_REPORT_INTERVAL);
+}
+
+/*
+ * Start reporting once the event is created. Called with sessions_mutex
+ * held.
+ */
+void lttng_sampling_start(struct lttng_event *event)
+{
+	struct lttng_event_sampling *sampling = &event->sampling;
+
+	if (sampling->type == LTTNG_KERNEL_SAMPLING_NONE)
+		return;
+	/* The report event now belongs to the channel. */
+	sampling->new_report = NULL;
+	init_timer(&sampling->timer);
+	sampling->timer.function = lttng_sampling_report_timer;
+	sampling->timer.expires = jiffies + LTTNG_SAMPLING_REPORT_INTERVAL;
+	sampling->timer.data = (unsigned long) event;
+	add_timer(&sampling->timer);
+	sampling->timer_enabled = 1;
+}
+
+/*
+ * Stop reporting, before the events of the session are destroyed: the
+ * timer writes through the channel report event.
+ */
+void lttng_sampling_stop(struct lttng_event *event)
+{
+	struct lttng_event_sampling *sampling = &event->sampling;
+
+	if (!sampling->timer_enabled)
+		return;
+	del_timer_sync(&sampling->timer);
+	sampling->timer_enabled = 0;
+}
+
+/*
+ * Slow path of lttng_event_sampling_record(), for events with a
+ * sampling policy. Called from the probes with preemption disabled.
+ */
+bool lttng_sampling_record(struct lttng_event *event)
+{
+	struct lttng_event_sampling *sampling = &event->sampling;
+	struct lttng_sampler *state = lttng_this_cpu_ptr(sampling->state);
+	uint64_t now;
+
+	switch (sampling->type) {
+	case LTTNG_KERNEL_SAMPLING_PERIOD:
+		if (++state->count < sampling->value)
+			goto sampled_out;
+		state->count = 0;
+		break;
+	case LTTNG_KERNEL_SAMPLING_RATE:
+		now = trace_clock_read64();
+		if ((int64_t) (state->tat - now) > (int64_t) trace_clock_freq())
+			goto sampled_out;
+		state->tat = max(state->tat, now) + sampling->interval;
+		break;
+	default:
+		break;
+	}
+	return true;
+
+sampled_out:
+	lttng_event_count(event, sampled_out);
+	return false;
+}
+EXPORT_SYMBOL_GPL(lttng_sampling_record);
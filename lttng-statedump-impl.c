@@ -46,6 +46,11 @@
 #include <linux/wait.h>
 #include <linux/mutex.h>
 #include <linux/device.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+#include <linux/vmalloc.h>
 
 #include "lttng-events.h"
 #include "lttng-tracer.h"
@@ -77,6 +82,9 @@ DEFINE_TRACE(lttng_statedump_file_descriptor);
 DEFINE_TRACE(lttng_statedump_start);
 DEFINE_TRACE(lttng_statedump_process_state);
 DEFINE_TRACE(lttng_statedump_network_interface);
+DEFINE_TRACE(lttng_statedump_vm_map);
+DEFINE_TRACE(lttng_statedump_shard);
+DEFINE_TRACE(lttng_statedump_system);
 
 struct lttng_fd_ctx {
 	char *page;
@@ -86,11 +94,26 @@ struct lttng_fd_ctx {
 };
 
 /*
- * Protected by the trace lock.
+ * The process list is split in shards by thread group id, each dumped by
+ * a work item bound to one online CPU, so its events are written to that
+ * CPU's buffer.
  */
-static struct delayed_work cpu_work[NR_CPUS];
-static DECLARE_WAIT_QUEUE_HEAD(statedump_wq);
-static atomic_t kernel_threads_to_run;
+struct lttng_statedump_shard {
+	struct work_struct work;
+	struct lttng_statedump_ctx *ctx;
+	unsigned int index;
+	int cpu;
+	int ret;
+};
+
+struct lttng_statedump_ctx {
+	struct lttng_session *session;
+	unsigned int nr_shards;
+	struct lttng_statedump_shard shards[];
+};
+
+/* Runs the statedump jobs and their shards. */
+static struct workqueue_struct *statedump_workqueue;
 
 enum lttng_thread_type {
 	LTTNG_USER_THREAD = 0,
@@ -122,6 +145,12 @@ enum lttng_process_status {
 	LTTNG_DEAD = 7,
 };
 
+static
+int lttng_statedump_cancelled(struct lttng_session *session)
+{
+	return ACCESS_ONCE(session->statedump.cancel);
+}
+
 static
 int lttng_enumerate_block_devices(struct lttng_session *session)
 {
@@ -275,7 +304,15 @@ end:
 }
 
 static
-int lttng_enumerate_file_descriptors(struct lttng_session *session)
+int lttng_statedump_in_shard(struct task_struct *p, unsigned int index,
+		unsigned int nr_shards)
+{
+	return (task_tgid_nr(p) % nr_shards) == index;
+}
+
+static
+int lttng_enumerate_file_descriptors(struct lttng_session *session,
+		unsigned int index, unsigned int nr_shards)
 {
 	struct task_struct *p;
 	char *tmp;
@@ -286,18 +323,28 @@ int lttng_enumerate_file_descriptors(struct lttng_session *session)
 
 	/* Enumerate active file descriptors */
 	rcu_read_lock();
-	for_each_process(p)
+	for_each_process(p) {
+		if (lttng_statedump_cancelled(session))
+			break;
+		if (!lttng_statedump_in_shard(p, index, nr_shards))
+			continue;
 		lttng_enumerate_task_fd(session, p, tmp);
+	}
 	rcu_read_unlock();
 	free_page((unsigned long) tmp);
-	return 0;
+	return lttng_statedump_cancelled(session) ? -ECANCELED : 0;
 }
 
-#if 0
 /*
- * FIXME: we cannot take a mmap_sem while in a RCU read-side critical section
- * (scheduling in atomic). Normally, the tasklist lock protects this kind of
- * iteration, but it is not exported to modules.
+ * Maximum number of maps dumped per mmap_sem read-side critical section,
+ * so large address spaces do not hold off writers for long.
+ */
+#define LTTNG_STATEDUMP_VM_MAP_BATCH	64
+
+/*
+ * Called with a reference held on the task, outside of RCU read-side
+ * critical sections. The mmap_sem is released every batch of maps, and
+ * the walk resumes from the end of the last map dumped.
  */
 static
 void lttng_enumerate_task_vm_maps(struct lttng_session *session,
@@ -305,41 +352,77 @@ void lttng_enumerate_task_vm_maps(struct lttng_session *session,
 {
 	struct mm_struct *mm;
 	struct vm_area_struct *map;
-	unsigned long ino;
+	unsigned long ino, addr = 0;
+	unsigned int nr;
 
 	/* get_task_mm does a task_lock... */
 	mm = get_task_mm(p);
 	if (!mm)
 		return;
 
-	map = mm->mmap;
-	if (map) {
+	do {
 		down_read(&mm->mmap_sem);
-		while (map) {
+		for (map = find_vma(mm, addr), nr = 0;
+				map && nr < LTTNG_STATEDUMP_VM_MAP_BATCH;
+				map = map->vm_next, nr++) {
 			if (map->vm_file)
 				ino = map->vm_file->lttng_f_dentry->d_inode->i_ino;
 			else
 				ino = 0;
 			trace_lttng_statedump_vm_map(session, p, map, ino);
-			map = map->vm_next;
+			addr = map->vm_end;
 		}
 		up_read(&mm->mmap_sem);
-	}
+		cond_resched();
+	} while (map && !lttng_statedump_cancelled(session));
 	mmput(mm);
 }
 
+/*
+ * The mmap_sem cannot be taken within the RCU read-side critical section
+ * of the process list iteration: pin the processes of the shard first,
+ * then walk their address spaces.
+ */
 static
-int lttng_enumerate_vm_maps(struct lttng_session *session)
+int lttng_enumerate_vm_maps(struct lttng_session *session,
+		unsigned int index, unsigned int nr_shards)
 {
-	struct task_struct *p;
+	struct task_struct *p, **tasks;
+	unsigned int nr_tasks = 0, max_tasks = 0, i;
 
 	rcu_read_lock();
-	for_each_process(p)
-		lttng_enumerate_task_vm_maps(session, p);
+	for_each_process(p) {
+		if (lttng_statedump_in_shard(p, index, nr_shards))
+			max_tasks++;
+	}
 	rcu_read_unlock();
-	return 0;
+	if (!max_tasks)
+		return 0;
+	tasks = vmalloc(max_tasks * sizeof(*tasks));
+	if (!tasks)
+		return -ENOMEM;
+
+	/* Processes created since the count are not dumped. */
+	rcu_read_lock();
+	for_each_process(p) {
+		if (nr_tasks == max_tasks)
+			break;
+		if (!lttng_statedump_in_shard(p, index, nr_shards))
+			continue;
+		get_task_struct(p);
+		tasks[nr_tasks++] = p;
+	}
+	rcu_read_unlock();
+
+	for (i = 0; i < nr_tasks; i++) {
+		if (!lttng_statedump_cancelled(session))
+			lttng_enumerate_task_vm_maps(session, tasks[i]);
+		put_task_struct(tasks[i]);
+		cond_resched();
+	}
+	vfree(tasks);
+	return lttng_statedump_cancelled(session) ? -ECANCELED : 0;
 }
-#endif
 
 #ifdef CONFIG_LTTNG_HAS_LIST_IRQ
 
@@ -430,12 +513,17 @@ void lttng_statedump_process_ns(struct lttng_session *session,
 }
 
 static
-int lttng_enumerate_process_states(struct lttng_session *session)
+int lttng_enumerate_process_states(struct lttng_session *session,
+		unsigned int index, unsigned int nr_shards)
 {
 	struct task_struct *g, *p;
 
 	rcu_read_lock();
 	for_each_process(g) {
+		if (lttng_statedump_cancelled(session))
+			break;
+		if (!lttng_statedump_in_shard(g, index, nr_shards))
+			continue;
 		p = g;
 		do {
 			enum lttng_execution_mode mode =
@@ -485,85 +573,283 @@ int lttng_enumerate_process_states(struct lttng_session *session)
 	}
 	rcu_read_unlock();
 
-	return 0;
+	return lttng_statedump_cancelled(session) ? -ECANCELED : 0;
 }
 
 static
 void lttng_statedump_work_func(struct work_struct *work)
 {
-	if (atomic_dec_and_test(&kernel_threads_to_run))
-		/* If we are the last thread, wake up do_lttng_statedump */
-		wake_up(&statedump_wq);
+	/* Running in process context on this CPU is all we need. */
+}
+
+static
+void lttng_statedump_shard_func(struct work_struct *work)
+{
+	struct lttng_statedump_shard *shard =
+		container_of(work, struct lttng_statedump_shard, work);
+	struct lttng_statedump_ctx *ctx = shard->ctx;
+	u64 t0, t1, t2, t3;
+
+	t0 = ktime_to_ns(ktime_get());
+	shard->ret = lttng_enumerate_process_states(ctx->session,
+			shard->index, ctx->nr_shards);
+	t1 = ktime_to_ns(ktime_get());
+	if (!shard->ret)
+		shard->ret = lttng_enumerate_file_descriptors(ctx->session,
+				shard->index, ctx->nr_shards);
+	t2 = ktime_to_ns(ktime_get());
+	if (!shard->ret && ctx->session->statedump.vm_maps)
+		shard->ret = lttng_enumerate_vm_maps(ctx->session,
+				shard->index, ctx->nr_shards);
+	t3 = ktime_to_ns(ktime_get());
+	trace_lttng_statedump_shard(ctx->session, shard->index,
+			ctx->nr_shards, t1 - t0, t2 - t1, t3 - t2);
+}
+
+/*
+ * One shard per online CPU. Must be called with CPU hotplug disabled.
+ * The shards only partition the tasks: a shard whose CPU goes offline
+ * later still runs, on another CPU.
+ */
+static
+struct lttng_statedump_ctx *lttng_statedump_ctx_create(
+		struct lttng_session *session)
+{
+	struct lttng_statedump_ctx *ctx;
+	unsigned int nr_shards = num_online_cpus(), i = 0;
+	int cpu;
+
+	ctx = kzalloc(sizeof(*ctx)
+			+ nr_shards * sizeof(struct lttng_statedump_shard),
+			GFP_KERNEL);
+	if (!ctx)
+		return NULL;
+	ctx->session = session;
+	ctx->nr_shards = nr_shards;
+	for_each_online_cpu(cpu) {
+		struct lttng_statedump_shard *shard = &ctx->shards[i];
+
+		shard->ctx = ctx;
+		shard->index = i++;
+		shard->cpu = cpu;
+	}
+	return ctx;
+}
+
+/*
+ * Run func on each shard's CPU, and wait for all of them to complete.
+ */
+static
+void lttng_statedump_shards_run(struct lttng_statedump_ctx *ctx,
+		work_func_t func)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->nr_shards; i++) {
+		struct lttng_statedump_shard *shard = &ctx->shards[i];
+
+		INIT_WORK(&shard->work, func);
+		queue_work_on(shard->cpu, statedump_workqueue, &shard->work);
+	}
+}
+
+static
+void lttng_statedump_shards_wait(struct lttng_statedump_ctx *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->nr_shards; i++)
+		flush_work(&ctx->shards[i].work);
+}
+
+/*
+ * Return the first error reported by a shard.
+ */
+static
+int lttng_statedump_shards_result(struct lttng_statedump_ctx *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->nr_shards; i++) {
+		if (ctx->shards[i].ret)
+			return ctx->shards[i].ret;
+	}
+	return 0;
+}
+
+/*
+ * Fire off a work queue on each online CPU, and wait for them. Their
+ * sole purpose in life is to guarantee that each CPU has been in a
+ * state where is was in syscall mode (i.e. not in a trap, an IRQ or a
+ * soft IRQ).
+ */
+static
+int lttng_statedump_cpu_barrier(void)
+{
+	struct work_struct __percpu *works;
+	int cpu;
+
+	works = alloc_percpu(struct work_struct);
+	if (!works)
+		return -ENOMEM;
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		struct work_struct *work = per_cpu_ptr(works, cpu);
+
+		INIT_WORK(work, lttng_statedump_work_func);
+		queue_work_on(cpu, statedump_workqueue, work);
+	}
+	/* Wait for all threads to run */
+	for_each_online_cpu(cpu)
+		flush_work(per_cpu_ptr(works, cpu));
+	put_online_cpus();
+	free_percpu(works);
+	return 0;
 }
 
 static
 int do_lttng_statedump(struct lttng_session *session)
 {
-	int cpu, ret;
+	struct lttng_statedump_ctx *ctx;
+	int ret, shards_ret;
+	u64 t0, t1;
 
 	trace_lttng_statedump_start(session);
-	ret = lttng_enumerate_process_states(session);
-	if (ret)
-		return ret;
-	ret = lttng_enumerate_file_descriptors(session);
-	if (ret)
-		return ret;
-	/*
-	 * FIXME
-	 * ret = lttng_enumerate_vm_maps(session);
-	 * if (ret)
-	 * 	return ret;
-	 */
+	/* Only shard setup needs the online CPUs to stay put. */
+	get_online_cpus();
+	ctx = lttng_statedump_ctx_create(session);
+	if (ctx)
+		lttng_statedump_shards_run(ctx, lttng_statedump_shard_func);
+	put_online_cpus();
+	if (!ctx)
+		return -ENOMEM;
+	/* System-wide phases run here while the shards dump tasks. */
+	t0 = ktime_to_ns(ktime_get());
 	ret = lttng_list_interrupts(session);
 	if (ret)
-		return ret;
+		goto wait_shards;
 	ret = lttng_enumerate_network_ip_interface(session);
 	if (ret)
-		return ret;
+		goto wait_shards;
 	ret = lttng_enumerate_block_devices(session);
 	switch (ret) {
 	case 0:
 		break;
 	case -ENOSYS:
 		printk(KERN_WARNING "LTTng: block device enumeration is not supported by kernel\n");
+		ret = 0;
 		break;
 	default:
-		return ret;
+		break;
 	}
+wait_shards:
+	t1 = ktime_to_ns(ktime_get());
+	trace_lttng_statedump_system(session, t1 - t0);
+	lttng_statedump_shards_wait(ctx);
+	shards_ret = lttng_statedump_shards_result(ctx);
+	if (!ret)
+		ret = shards_ret;
+	if (!ret && lttng_statedump_cancelled(session))
+		ret = -ECANCELED;
+	if (ret)
+		goto end;
 
 	/* TODO lttng_dump_idt_table(session); */
 	/* TODO lttng_dump_softirq_vec(session); */
 	/* TODO lttng_list_modules(session); */
 	/* TODO lttng_dump_swap_files(session); */
 
-	/*
-	 * Fire off a work queue on each CPU. Their sole purpose in life
-	 * is to guarantee that each CPU has been in a state where is was in
-	 * syscall mode (i.e. not in a trap, an IRQ or a soft IRQ).
-	 */
-	get_online_cpus();
-	atomic_set(&kernel_threads_to_run, num_online_cpus());
-	for_each_online_cpu(cpu) {
-		INIT_DELAYED_WORK(&cpu_work[cpu], lttng_statedump_work_func);
-		schedule_delayed_work_on(cpu, &cpu_work[cpu], 0);
-	}
-	/* Wait for all threads to run */
-	__wait_event(statedump_wq, (atomic_read(&kernel_threads_to_run) == 0));
-	put_online_cpus();
+	ret = lttng_statedump_cpu_barrier();
+	if (ret)
+		goto end;
 	/* Our work is done */
 	trace_lttng_statedump_end(session);
-	return 0;
+end:
+	kfree(ctx);
+	return ret;
+}
+
+static
+void lttng_statedump_job_func(struct work_struct *work)
+{
+	struct lttng_statedump *sd =
+		container_of(work, struct lttng_statedump, work);
+	struct lttng_session *session =
+		container_of(sd, struct lttng_session, statedump);
+
+	sd->ret = do_lttng_statedump(session);
+	/* Publish ret before clearing running. */
+	smp_wmb();
+	ACCESS_ONCE(sd->running) = 0;
+	wake_up_all(&sd->wait);
+}
+
+void lttng_statedump_session_init(struct lttng_session *session)
+{
+	struct lttng_statedump *sd = &session->statedump;
+
+	INIT_WORK(&sd->work, lttng_statedump_job_func);
+	init_waitqueue_head(&sd->wait);
 }
+EXPORT_SYMBOL_GPL(lttng_statedump_session_init);
 
 /*
- * Called with session mutex held.
+ * Called with session mutex held. Queue the statedump and return: it
+ * runs without the session mutex. Completion is observed with
+ * lttng_statedump_wait() or by polling the session file.
  */
 int lttng_statedump_start(struct lttng_session *session)
 {
-	return do_lttng_statedump(session);
+	struct lttng_statedump *sd = &session->statedump;
+
+	if (ACCESS_ONCE(sd->running))
+		return -EBUSY;
+	sd->cancel = 0;
+	sd->ret = 0;
+	ACCESS_ONCE(sd->running) = 1;
+	queue_work(statedump_workqueue, &sd->work);
+	return 0;
 }
 EXPORT_SYMBOL_GPL(lttng_statedump_start);
 
+/*
+ * Called with session mutex held. Stop the statedump of the session, if
+ * any, and wait for its job to return. The statedump job never takes the
+ * session mutex.
+ */
+void lttng_statedump_cancel(struct lttng_session *session)
+{
+	struct lttng_statedump *sd = &session->statedump;
+
+	ACCESS_ONCE(sd->cancel) = 1;
+	if (cancel_work_sync(&sd->work)) {
+		/* The job was cancelled before it ran. */
+		sd->ret = -ECANCELED;
+		smp_wmb();
+		ACCESS_ONCE(sd->running) = 0;
+		wake_up_all(&sd->wait);
+	}
+}
+EXPORT_SYMBOL_GPL(lttng_statedump_cancel);
+
+/*
+ * Wait for the statedump of the session to complete, and return its
+ * result: 0, -ECANCELED, or the error it hit.
+ */
+int lttng_statedump_wait(struct lttng_session *session)
+{
+	struct lttng_statedump *sd = &session->statedump;
+	int ret;
+
+	ret = wait_event_interruptible(sd->wait, !ACCESS_ONCE(sd->running));
+	if (ret)
+		return ret;
+	/* Read ret after observing running cleared. */
+	smp_rmb();
+	return sd->ret;
+}
+EXPORT_SYMBOL_GPL(lttng_statedump_wait);
+
 static
 int __init lttng_statedump_init(void)
 {
@@ -574,6 +860,9 @@ int __init lttng_statedump_init(void)
 	 * "tracepoint_module_notify" is turned into a static function.
 	 */
 	(void) wrapper_lttng_fixup_sig(THIS_MODULE);
+	statedump_workqueue = alloc_workqueue("lttng_statedump", 0, 0);
+	if (!statedump_workqueue)
+		return -ENOMEM;
 	return 0;
 }
 
@@ -582,6 +871,7 @@ module_init(lttng_statedump_init);
 static
 void __exit lttng_statedump_exit(void)
 {
+	destroy_workqueue(statedump_workqueue);
 }
 
 module_exit(lttng_statedump_exit);
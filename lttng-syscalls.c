@@ -343,6 +343,25 @@ const struct trace_syscall_entry compat_sc_exit_table[] = {
 
 #undef CREATE_SYSCALL_TABLE
 
+/*
+ * System call probes are not registered with lttng_probe_register(),
+ * their event metadata is pre-rendered on first use.
+ */
+static struct lttng_probe_desc *syscall_probe_descs[] = {
+	&__probe_desc___syscalls_unknown,
+	&__probe_desc___syscall_entry_integers,
+	&__probe_desc___syscall_entry_pointers,
+	&__probe_desc___compat_syscall_entry_integers,
+	&__probe_desc___compat_syscall_entry_pointers,
+	&__probe_desc___syscall_exit_integers,
+	&__probe_desc___syscall_exit_pointers,
+	&__probe_desc___compat_syscall_exit_integers,
+	&__probe_desc___compat_syscall_exit_pointers,
+};
+
+/* Protected by the sessions lock. */
+static int syscall_metadata_cached;
+
 struct lttng_syscall_filter {
 	DECLARE_BITMAP(sc, NR_syscalls);
 	DECLARE_BITMAP(sc_compat, NR_compat_syscalls);
@@ -730,8 +749,45 @@ int fill_table(const struct trace_syscall_entry *table, size_t table_len,
 }
 
 /*
- * Should be called with sessions lock held.
+ * Called under sessions lock.
+ */
+static
+int lttng_syscalls_metadata_cache_init(void)
+{
+	int i, ret;
+
+	if (syscall_metadata_cached)
+		return 0;
+	for (i = 0; i < ARRAY_SIZE(syscall_probe_descs); i++) {
+		ret = lttng_probe_metadata_cache_register(syscall_probe_descs[i]);
+		if (ret)
+			goto error;
+	}
+	syscall_metadata_cached = 1;
+	return 0;
+
+error:
+	while (--i >= 0)
+		lttng_probe_metadata_cache_unregister(syscall_probe_descs[i]);
+	return ret;
+}
+
+/*
+ * Called on tracer module exit, after all sessions are destroyed.
  */
+void lttng_syscalls_exit(void)
+{
+	int i;
+
+	lttng_lock_sessions();
+	if (syscall_metadata_cached) {
+		for (i = 0; i < ARRAY_SIZE(syscall_probe_descs); i++)
+			lttng_probe_metadata_cache_unregister(syscall_probe_descs[i]);
+		syscall_metadata_cached = 0;
+	}
+	lttng_unlock_sessions();
+}
+
 int lttng_syscalls_register(struct lttng_channel *chan, void *filter)
 {
 	struct lttng_kernel_event ev;
@@ -739,6 +795,10 @@ int lttng_syscalls_register(struct lttng_channel *chan, void *filter)
 
 	wrapper_vmalloc_sync_all();
 
+	ret = lttng_syscalls_metadata_cache_init();
+	if (ret)
+		return ret;
+
 	if (!chan->sc_table) {
 		/* create syscall table mapping syscall to events */
 		chan->sc_table = kzalloc(sizeof(struct lttng_event *)
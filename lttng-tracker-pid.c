@@ -27,132 +27,518 @@
 #include <linux/stringify.h>
 #include <linux/hash.h>
 #include <linux/rcupdate.h>
+#include <linux/threads.h>
+#include <linux/bitops.h>
+#include <linux/mm.h>
+#include <linux/cgroup.h>
 
 #include "wrapper/tracepoint.h"
 #include "wrapper/rcu.h"
 #include "wrapper/list.h"
+#include "wrapper/vmalloc.h"	/* for wrapper_vmalloc_sync_all() */
+#include "wrapper/vzalloc.h"
 #include "lttng-events.h"
+#include "lttng-kernel-version.h"
 
 /*
- * Hash table is allocated and freed when there are no possible
- * concurrent lookups (ensured by the alloc/free caller). However,
- * there can be concurrent RCU lookups vs add/del operations.
+ * The tracked ids are kept in a flat table published through RCU. It
+ * is either an open-addressing hash table of ids (linear probing), or
+ * a bitmap indexed by id when it is smaller than the hash table would
+ * be, which happens for dense PID populations. Lookups read one or a
+ * few consecutive words and never follow pointers.
  *
- * Concurrent updates of the PID hash table are forbidden: the caller
- * must ensure mutual exclusion. This is currently done by holding the
+ * Hash slots hold an id, LTTNG_PID_SLOT_EMPTY or
+ * LTTNG_PID_SLOT_DELETED. Adding and removing an id write a single
+ * word in place, so they support concurrent RCU lookups without any
+ * grace period. A grace period is only needed to free a table replaced
+ * by a resize, and bulk operations resize at most once.
+ *
+ * Concurrent updates of the tracker are forbidden: the caller must
+ * ensure mutual exclusion. This is currently done by holding the
  * sessions_mutex across calls to create, destroy, add, and del
  * functions of this API.
  */
-int lttng_pid_tracker_get_node_pid(const struct lttng_pid_hash_node *node)
+#define LTTNG_PID_SLOT_EMPTY		(~0UL)
+#define LTTNG_PID_SLOT_DELETED		(~0UL - 1)
+#define LTTNG_PID_TABLE_MIN_ORDER	6
+
+static
+struct lttng_pid_table *pid_table_alloc(unsigned int bitmap,
+		unsigned long size, unsigned int order)
+{
+	struct lttng_pid_table *table;
+	size_t len;
+
+	if (bitmap)
+		len = sizeof(*table) + BITS_TO_LONGS(size) * sizeof(unsigned long);
+	else
+		len = sizeof(*table) + size * sizeof(unsigned long);
+	if (len <= PAGE_SIZE) {
+		table = kzalloc(len, GFP_KERNEL);
+	} else {
+		table = lttng_vzalloc(len);
+		/* Looked up from page fault and NMI probes. */
+		wrapper_vmalloc_sync_all();
+	}
+	if (!table)
+		return NULL;
+	table->bitmap = bitmap;
+	table->order = order;
+	table->size = size;
+	if (!bitmap)
+		memset(table->data, 0xFF, size * sizeof(unsigned long));
+	return table;
+}
+
+static
+void pid_table_free(struct lttng_pid_table *table)
+{
+	if (is_vmalloc_addr(table))
+		vfree(table);
+	else
+		kfree(table);
+}
+
+static
+bool pid_table_lookup(const struct lttng_pid_table *table, unsigned long id)
+{
+	unsigned long i, mask, slot;
+
+	if (table->bitmap)
+		return id < table->size && test_bit(id, table->data);
+	mask = table->size - 1;
+	for (i = hash_long(id, table->order); ; i = (i + 1) & mask) {
+		slot = ACCESS_ONCE(table->data[i]);
+		if (slot == LTTNG_PID_SLOT_EMPTY)
+			return false;
+		if (slot == id)
+			return true;
+	}
+}
+
+/*
+ * Insert an id known not to be present. The caller reserved room for
+ * it with pid_tracker_reserve().
+ */
+static
+void pid_table_insert(struct lttng_pid_table *table, unsigned long id)
+{
+	unsigned long i, mask, slot;
+
+	if (table->bitmap) {
+		set_bit(id, table->data);
+		return;
+	}
+	mask = table->size - 1;
+	for (i = hash_long(id, table->order); ; i = (i + 1) & mask) {
+		slot = table->data[i];
+		if (slot == LTTNG_PID_SLOT_EMPTY) {
+			table->used++;
+			break;
+		}
+		if (slot == LTTNG_PID_SLOT_DELETED)
+			break;
+	}
+	ACCESS_ONCE(table->data[i]) = id;
+}
+
+static
+bool pid_table_remove(struct lttng_pid_table *table, unsigned long id)
+{
+	unsigned long i, mask, slot;
+
+	if (table->bitmap) {
+		if (id >= table->size)
+			return false;
+		return test_and_clear_bit(id, table->data);
+	}
+	mask = table->size - 1;
+	for (i = hash_long(id, table->order); ; i = (i + 1) & mask) {
+		slot = table->data[i];
+		if (slot == LTTNG_PID_SLOT_EMPTY)
+			return false;
+		if (slot == id) {
+			ACCESS_ONCE(table->data[i]) = LTTNG_PID_SLOT_DELETED;
+			return true;
+		}
+	}
+}
+
+/*
+ * Find the first id at or after *pos in table iteration order, and
+ * move *pos past it. Return 0 if found, -ENOENT at end of table.
+ */
+static
+int pid_table_next(const struct lttng_pid_table *table, unsigned long *pos,
+		unsigned long *id)
+{
+	unsigned long i;
+
+	if (table->bitmap) {
+		i = find_next_bit(table->data, table->size, *pos);
+		if (i >= table->size)
+			return -ENOENT;
+		*id = i;
+		*pos = i + 1;
+		return 0;
+	}
+	for (i = *pos; i < table->size; i++) {
+		unsigned long slot = table->data[i];
+
+		if (slot != LTTNG_PID_SLOT_EMPTY
+				&& slot != LTTNG_PID_SLOT_DELETED) {
+			*id = slot;
+			*pos = i + 1;
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+
+static
+unsigned long pid_table_max_id(const struct lttng_pid_table *table)
+{
+	unsigned long pos = 0, id, max_id = 0;
+
+	while (!pid_table_next(table, &pos, &id))
+		max_id = max(max_id, id);
+	return max_id;
+}
+
+static
+bool pid_tracker_can_use_bitmap(const struct lttng_pid_tracker *lpf)
+{
+	return lpf->type == LTTNG_KERNEL_TRACKER_PID
+		|| lpf->type == LTTNG_KERNEL_TRACKER_TGID;
+}
+
+/*
+ * Build a table holding the ids of the current table, sized for
+ * nr_ids ids up to max_id. The hash table keeps its load factor,
+ * tombstones included, at or below 1/2. The bitmap is used instead
+ * when it takes less memory.
+ */
+static
+struct lttng_pid_table *pid_tracker_rebuild(struct lttng_pid_tracker *lpf,
+		unsigned long nr_ids, unsigned long max_id)
+{
+	struct lttng_pid_table *old_table = lpf->table, *table;
+	unsigned long pos = 0, id, nr_bits;
+	unsigned int order = LTTNG_PID_TABLE_MIN_ORDER;
+
+	while ((1UL << order) < 2 * nr_ids)
+		order++;
+	nr_bits = ALIGN(max_t(unsigned long, max_id + 1, PID_MAX_DEFAULT),
+			BITS_PER_LONG);
+	if (pid_tracker_can_use_bitmap(lpf)
+			&& nr_bits / BITS_PER_BYTE
+				< (1UL << order) * sizeof(unsigned long))
+		table = pid_table_alloc(1, nr_bits, 0);
+	else
+		table = pid_table_alloc(0, 1UL << order, order);
+	if (!table)
+		return NULL;
+	while (!pid_table_next(old_table, &pos, &id))
+		pid_table_insert(table, id);
+	return table;
+}
+
+/*
+ * Make room for nr_add more ids, the largest being max_id. On resize,
+ * the new table is published and the old one is returned in *old_table
+ * for the caller to free after a grace period.
+ */
+static
+int pid_tracker_reserve(struct lttng_pid_tracker *lpf, unsigned long nr_add,
+		unsigned long max_id, struct lttng_pid_table **old_table)
+{
+	struct lttng_pid_table *table = lpf->table, *new_table;
+
+	if (table->bitmap) {
+		if (max_id < table->size)
+			return 0;
+	} else {
+		if (2 * (table->used + nr_add) <= table->size)
+			return 0;
+	}
+	new_table = pid_tracker_rebuild(lpf, lpf->nr_ids + nr_add,
+			max(max_id, pid_table_max_id(table)));
+	if (!new_table)
+		return -ENOMEM;
+	rcu_assign_pointer(lpf->table, new_table);
+	*old_table = table;
+	return 0;
+}
+
+/*
+ * Shrink the table after removals, when it is mostly empty.
+ */
+static
+void pid_tracker_shrink(struct lttng_pid_tracker *lpf,
+		struct lttng_pid_table **old_table)
+{
+	struct lttng_pid_table *table = lpf->table, *new_table;
+
+	if (table->bitmap) {
+		/* Keep it unless a hash table would be 4 times smaller. */
+		if (128 * sizeof(unsigned long) * lpf->nr_ids >= table->size)
+			return;
+	} else {
+		if (table->order == LTTNG_PID_TABLE_MIN_ORDER
+				|| 8 * lpf->nr_ids >= table->size)
+			return;
+	}
+	new_table = pid_tracker_rebuild(lpf, lpf->nr_ids,
+			pid_table_max_id(table));
+	if (!new_table)
+		return;	/* Keep the larger table. */
+	rcu_assign_pointer(lpf->table, new_table);
+	*old_table = table;
+}
+
+static
+int pid_tracker_check_id(struct lttng_pid_tracker *lpf, uint64_t id)
+{
+	switch (lpf->type) {
+	case LTTNG_KERNEL_TRACKER_PID:
+	case LTTNG_KERNEL_TRACKER_TGID:
+		if (id >= PID_MAX_LIMIT)
+			return -EINVAL;
+		return 0;
+	case LTTNG_KERNEL_TRACKER_CGROUP:
+		if (id >= LTTNG_PID_SLOT_DELETED)
+			return -EINVAL;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Id of the default hierarchy cgroup of a task: the inode number of
+ * its cgroupfs directory.
+ */
+#if (defined(CONFIG_CGROUPS) \
+	&& LTTNG_KERNEL_RANGE(4,6,0, 5,5,0))
+static
+unsigned long lttng_task_cgroup_id(struct task_struct *p)
+{
+	unsigned long id;
+
+	rcu_read_lock();
+	id = cgroup_ino(task_dfl_cgroup(p));
+	rcu_read_unlock();
+	return id;
+}
+
+static
+int lttng_cgroup_tracker_supported(void)
+{
+	return 1;
+}
+#else
+static
+unsigned long lttng_task_cgroup_id(struct task_struct *p)
 {
-	return node->pid;
+	return LTTNG_PID_SLOT_EMPTY;
 }
 
+static
+int lttng_cgroup_tracker_supported(void)
+{
+	return 0;
+}
+#endif
+
 /*
  * Lookup performed from RCU read-side critical section (RCU sched),
  * protected by preemption off at the tracepoint call site.
- * Return 1 if found, 0 if not found.
+ * Return 1 if the task is tracked, 0 otherwise.
  */
-bool lttng_pid_tracker_lookup(struct lttng_pid_tracker *lpf, int pid)
+bool lttng_pid_tracker_lookup(struct lttng_pid_tracker *lpf,
+		struct task_struct *p)
 {
-	struct hlist_head *head;
-	struct lttng_pid_hash_node *e;
-	uint32_t hash = hash_32(pid, 32);
+	struct lttng_pid_table *table;
+	unsigned long id;
 
-	head = &lpf->pid_hash[hash & (LTTNG_PID_TABLE_SIZE - 1)];
-	lttng_hlist_for_each_entry_rcu(e, head, hlist) {
-		if (pid == e->pid)
-			return 1;	/* Found */
+	switch (ACCESS_ONCE(lpf->type)) {
+	case LTTNG_KERNEL_TRACKER_PID:
+		id = p->pid;
+		break;
+	case LTTNG_KERNEL_TRACKER_TGID:
+		id = p->tgid;
+		break;
+	case LTTNG_KERNEL_TRACKER_CGROUP:
+		id = lttng_task_cgroup_id(p);
+		break;
+	default:
+		return 0;
 	}
-	return 0;
+	table = lttng_rcu_dereference(lpf->table);
+	return pid_table_lookup(table, id);
 }
 EXPORT_SYMBOL_GPL(lttng_pid_tracker_lookup);
 
 /*
  * Tracker add and del operations support concurrent RCU lookups.
  */
-int lttng_pid_tracker_add(struct lttng_pid_tracker *lpf, int pid)
+int lttng_pid_tracker_add(struct lttng_pid_tracker *lpf, uint64_t id)
 {
-	struct hlist_head *head;
-	struct lttng_pid_hash_node *e;
-	uint32_t hash = hash_32(pid, 32);
+	struct lttng_pid_table *old_table = NULL;
+	int ret;
 
-	head = &lpf->pid_hash[hash & (LTTNG_PID_TABLE_SIZE - 1)];
-	lttng_hlist_for_each_entry(e, head, hlist) {
-		if (pid == e->pid)
-			return -EEXIST;
+	ret = pid_tracker_check_id(lpf, id);
+	if (ret)
+		return ret;
+	if (pid_table_lookup(lpf->table, id))
+		return -EEXIST;
+	ret = pid_tracker_reserve(lpf, 1, id, &old_table);
+	if (ret)
+		return ret;
+	pid_table_insert(lpf->table, id);
+	lpf->nr_ids++;
+	if (old_table) {
+		synchronize_trace();
+		pid_table_free(old_table);
 	}
-	e = kmalloc(sizeof(struct lttng_pid_hash_node), GFP_KERNEL);
-	if (!e)
-		return -ENOMEM;
-	e->pid = pid;
-	hlist_add_head_rcu(&e->hlist, head);
 	return 0;
 }
 
-static
-void pid_tracker_del_node_rcu(struct lttng_pid_hash_node *e)
+/*
+ * Add an array of ids. Ids already tracked are skipped. At most one
+ * grace period is waited for.
+ */
+int lttng_pid_tracker_add_ids(struct lttng_pid_tracker *lpf,
+		const uint64_t *ids, size_t nr_ids)
 {
-	hlist_del_rcu(&e->hlist);
-	/*
-	 * We choose to use a heavyweight synchronize on removal here,
-	 * since removal of a PID from the tracker mask is a rare
-	 * operation, and we don't want to use more cache lines than
-	 * what we really need when doing the PID lookups, so we don't
-	 * want to afford adding a rcu_head field to those pid hash
-	 * node.
-	 */
-	synchronize_trace();
-	kfree(e);
+	struct lttng_pid_table *old_table = NULL;
+	unsigned long max_id = 0;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < nr_ids; i++) {
+		ret = pid_tracker_check_id(lpf, ids[i]);
+		if (ret)
+			return ret;
+		max_id = max_t(unsigned long, max_id, ids[i]);
+	}
+	ret = pid_tracker_reserve(lpf, nr_ids, max_id, &old_table);
+	if (ret)
+		return ret;
+	for (i = 0; i < nr_ids; i++) {
+		if (pid_table_lookup(lpf->table, ids[i]))
+			continue;
+		pid_table_insert(lpf->table, ids[i]);
+		lpf->nr_ids++;
+	}
+	if (old_table) {
+		synchronize_trace();
+		pid_table_free(old_table);
+	}
+	return 0;
 }
 
 /*
- * This removal is only used on destroy, so it does not need to support
- * concurrent RCU lookups.
+ * Removal waits for a grace period before returning, so no event of the
+ * removed ids is recorded afterwards.
  */
-static
-void pid_tracker_del_node(struct lttng_pid_hash_node *e)
+int lttng_pid_tracker_del(struct lttng_pid_tracker *lpf, uint64_t id)
 {
-	hlist_del(&e->hlist);
-	kfree(e);
+	if (!lttng_pid_tracker_del_ids(lpf, &id, 1))
+		return -ENOENT;	/* Not found */
+	return 0;
 }
 
-int lttng_pid_tracker_del(struct lttng_pid_tracker *lpf, int pid)
+/*
+ * Remove an array of ids, waiting for a single grace period. Return the
+ * number of ids removed: ids not tracked are skipped.
+ */
+int lttng_pid_tracker_del_ids(struct lttng_pid_tracker *lpf,
+		const uint64_t *ids, size_t nr_ids)
 {
-	struct hlist_head *head;
-	struct lttng_pid_hash_node *e;
-	uint32_t hash = hash_32(pid, 32);
+	struct lttng_pid_table *old_table = NULL;
+	size_t i;
+	int removed = 0;
 
-	head = &lpf->pid_hash[hash & (LTTNG_PID_TABLE_SIZE - 1)];
-	/*
-	 * No need of _safe iteration, because we stop traversal as soon
-	 * as we remove the entry.
-	 */
-	lttng_hlist_for_each_entry(e, head, hlist) {
-		if (pid == e->pid) {
-			pid_tracker_del_node_rcu(e);
-			return 0;
-		}
+	for (i = 0; i < nr_ids; i++) {
+		if (pid_tracker_check_id(lpf, ids[i]))
+			continue;
+		if (pid_table_remove(lpf->table, ids[i]))
+			removed++;
 	}
-	return -ENOENT;	/* Not found */
+	if (!removed)
+		return 0;
+	lpf->nr_ids -= removed;
+	pid_tracker_shrink(lpf, &old_table);
+	synchronize_trace();
+	if (old_table)
+		pid_table_free(old_table);
+	return removed;
 }
 
-struct lttng_pid_tracker *lttng_pid_tracker_create(void)
+/*
+ * Iterate on the tracked ids, in table order. *pos starts at 0.
+ */
+int lttng_pid_tracker_next(struct lttng_pid_tracker *lpf,
+		unsigned long *pos, uint64_t *id)
 {
-	return kzalloc(sizeof(struct lttng_pid_tracker), GFP_KERNEL);
+	unsigned long value;
+	int ret;
+
+	ret = pid_table_next(lpf->table, pos, &value);
+	if (ret)
+		return ret;
+	*id = value;
+	return 0;
 }
 
-void lttng_pid_tracker_destroy(struct lttng_pid_tracker *lpf)
+/*
+ * The type can only be changed while the tracker is empty.
+ */
+int lttng_pid_tracker_set_type(struct lttng_pid_tracker *lpf,
+		enum lttng_kernel_tracker_type type)
 {
-	int i;
+	if (lpf->type == type)
+		return 0;
+	switch (type) {
+	case LTTNG_KERNEL_TRACKER_PID:
+	case LTTNG_KERNEL_TRACKER_TGID:
+		break;
+	case LTTNG_KERNEL_TRACKER_CGROUP:
+		if (!lttng_cgroup_tracker_supported())
+			return -ENOSYS;
+		break;
+	default:
+		return -EINVAL;
+	}
+	if (lpf->nr_ids)
+		return -EBUSY;
+	ACCESS_ONCE(lpf->type) = type;
+	return 0;
+}
 
-	for (i = 0; i < LTTNG_PID_TABLE_SIZE; i++) {
-		struct hlist_head *head = &lpf->pid_hash[i];
-		struct lttng_pid_hash_node *e;
-		struct hlist_node *tmp;
+/*
+ * Create an empty tracker of PIDs.
+ */
+struct lttng_pid_tracker *lttng_pid_tracker_create(void)
+{
+	struct lttng_pid_tracker *lpf;
 
-		lttng_hlist_for_each_entry_safe(e, tmp, head, hlist)
-			pid_tracker_del_node(e);
+	lpf = kzalloc(sizeof(struct lttng_pid_tracker), GFP_KERNEL);
+	if (!lpf)
+		return NULL;
+	lpf->type = LTTNG_KERNEL_TRACKER_PID;
+	lpf->table = pid_table_alloc(0, 1UL << LTTNG_PID_TABLE_MIN_ORDER,
+			LTTNG_PID_TABLE_MIN_ORDER);
+	if (!lpf->table) {
+		kfree(lpf);
+		return NULL;
 	}
+	return lpf;
+}
+
+void lttng_pid_tracker_destroy(struct lttng_pid_tracker *lpf)
+{
+	pid_table_free(lpf->table);
 	kfree(lpf);
 }
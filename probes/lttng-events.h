@@ -729,13 +729,19 @@ static void __event_probe__##_name(void *__data, _proto)		      \
 		return;							      \
 	if (unlikely(!ACCESS_ONCE(__event->enabled)))			      \
 		return;							      \
+	lttng_event_count(__event, hit);				      \
 	__lpf = lttng_rcu_dereference(__session->pid_tracker);		      \
-	if (__lpf && likely(!lttng_pid_tracker_lookup(__lpf, current->pid)))  \
+	if (__lpf && likely(!lttng_pid_tracker_lookup(__lpf, current))) {     \
+		lttng_event_count(__event, pid_filtered);		      \
+		return;							      \
+	}								      \
+	if (unlikely(!lttng_event_sampling_record(__event)))		      \
 		return;							      \
 	_code								      \
-	if (unlikely(!list_empty(&__event->bytecode_runtime_head))) {	      \
+	if (unlikely(!list_empty(&__event->bytecode_runtime_head)	      \
+			&& !ACCESS_ONCE(__event->has_enablers_without_bytecode))) { \
 		struct lttng_bytecode_runtime *bc_runtime;		      \
-		int __filter_record = __event->has_enablers_without_bytecode; \
+		int __filter_record = 0;				      \
 									      \
 		__event_prepare_filter_stack__##_name(__stackvar.__filter_stack_data, \
 				tp_locvar, _args);				      \
@@ -744,8 +750,10 @@ static void __event_probe__##_name(void *__data, _proto)		      \
 					__stackvar.__filter_stack_data) & LTTNG_FILTER_RECORD_FLAG)) \
 				__filter_record = 1;			      \
 		}							      \
-		if (likely(!__filter_record))				      \
+		if (likely(!__filter_record)) {				      \
+			lttng_event_count(__event, filtered);		      \
 			return;						      \
+		}							      \
 	}								      \
 	__event_len = __event_get_size__##_name(__stackvar.__dynamic_len,     \
 				tp_locvar, _args);			      \
@@ -753,8 +761,10 @@ static void __event_probe__##_name(void *__data, _proto)		      \
 	lib_ring_buffer_ctx_init(&__ctx, __chan->chan, __event, __event_len,  \
 				 __event_align, -1);			      \
 	__ret = __chan->ops->event_reserve(&__ctx, __event->id);	      \
-	if (__ret < 0)							      \
+	if (__ret < 0) {						      \
+		lttng_event_count(__event, discarded);			      \
 		return;							      \
+	}								      \
 	_fields								      \
 	__chan->ops->event_commit(&__ctx);				      \
 }
@@ -788,13 +798,19 @@ static void __event_probe__##_name(void *__data)			      \
 		return;							      \
 	if (unlikely(!ACCESS_ONCE(__event->enabled)))			      \
 		return;							      \
+	lttng_event_count(__event, hit);				      \
 	__lpf = lttng_rcu_dereference(__session->pid_tracker);		      \
-	if (__lpf && likely(!lttng_pid_tracker_lookup(__lpf, current->pid)))  \
+	if (__lpf && likely(!lttng_pid_tracker_lookup(__lpf, current))) {     \
+		lttng_event_count(__event, pid_filtered);		      \
+		return;							      \
+	}								      \
+	if (unlikely(!lttng_event_sampling_record(__event)))		      \
 		return;							      \
 	_code								      \
-	if (unlikely(!list_empty(&__event->bytecode_runtime_head))) {	      \
+	if (unlikely(!list_empty(&__event->bytecode_runtime_head)	      \
+			&& !ACCESS_ONCE(__event->has_enablers_without_bytecode))) { \
 		struct lttng_bytecode_runtime *bc_runtime;		      \
-		int __filter_record = __event->has_enablers_without_bytecode; \
+		int __filter_record = 0;				      \
 									      \
 		__event_prepare_filter_stack__##_name(__stackvar.__filter_stack_data, \
 				tp_locvar);				      \
@@ -803,16 +819,20 @@ static void __event_probe__##_name(void *__data)			      \
 					__stackvar.__filter_stack_data) & LTTNG_FILTER_RECORD_FLAG)) \
 				__filter_record = 1;			      \
 		}							      \
-		if (likely(!__filter_record))				      \
+		if (likely(!__filter_record)) {				      \
+			lttng_event_count(__event, filtered);		      \
 			return;						      \
+		}							      \
 	}								      \
 	__event_len = __event_get_size__##_name(__stackvar.__dynamic_len, tp_locvar); \
 	__event_align = __event_get_align__##_name(tp_locvar);		      \
 	lib_ring_buffer_ctx_init(&__ctx, __chan->chan, __event, __event_len,  \
 				 __event_align, -1);			      \
 	__ret = __chan->ops->event_reserve(&__ctx, __event->id);	      \
-	if (__ret < 0)							      \
+	if (__ret < 0) {						      \
+		lttng_event_count(__event, discarded);			      \
 		return;							      \
+	}								      \
 	_fields								      \
 	__chan->ops->event_commit(&__ctx);				      \
 }
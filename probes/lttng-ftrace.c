@@ -57,12 +57,31 @@ void lttng_ftrace_handler(unsigned long ip, unsigned long parent_ip, void **data
 		return;
 	if (unlikely(!ACCESS_ONCE(event->enabled)))
 		return;
+	lttng_event_count(event, hit);
+	if (!lttng_event_pid_tracked(chan->session)) {
+		lttng_event_count(event, pid_filtered);
+		return;
+	}
+	if (unlikely(!lttng_event_sampling_record(event)))
+		return;
+	if (unlikely(lttng_event_has_filter(event))) {
+		/* ip, parent_ip */
+		int64_t filter_stack[2] = { (int64_t) ip, (int64_t) parent_ip };
+
+		if (likely(!lttng_event_filter_record(event,
+				(const char *) filter_stack))) {
+			lttng_event_count(event, filtered);
+			return;
+		}
+	}
 
 	lib_ring_buffer_ctx_init(&ctx, chan->chan, event,
 				 sizeof(payload), lttng_alignof(payload), -1);
 	ret = chan->ops->event_reserve(&ctx, event->id);
-	if (ret < 0)
+	if (ret < 0) {
+		lttng_event_count(event, discarded);
 		return;
+	}
 	payload.ip = ip;
 	payload.parent_ip = parent_ip;
 	lib_ring_buffer_align_ctx(&ctx, lttng_alignof(payload));
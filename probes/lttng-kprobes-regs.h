@@ -0,0 +1,121 @@
+#ifndef _LTTNG_KPROBES_REGS_H
+#define _LTTNG_KPROBES_REGS_H
+
+/*
+ * lttng-kprobes-regs.h
+ *
+ * Function argument access from the registers at a kprobe hit, for the
+ * architectures where the calling convention passes them in registers.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; only
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <linux/ptrace.h>
+
+/*
+ * Only meaningful at function entry (offset 0).
+ */
+#if defined(CONFIG_X86_64)
+
+#define LTTNG_KPROBE_NR_ARGS	6
+
+static inline
+unsigned long lttng_kprobe_regs_arg(struct pt_regs *regs, unsigned int n)
+{
+	switch (n) {
+	case 0:	return regs->di;
+	case 1:	return regs->si;
+	case 2:	return regs->dx;
+	case 3:	return regs->cx;
+	case 4:	return regs->r8;
+	case 5:	return regs->r9;
+	default:	return 0;
+	}
+}
+
+#elif defined(CONFIG_X86_32)
+
+/* The kernel is built with -mregparm=3. */
+#define LTTNG_KPROBE_NR_ARGS	3
+
+static inline
+unsigned long lttng_kprobe_regs_arg(struct pt_regs *regs, unsigned int n)
+{
+	switch (n) {
+	case 0:	return regs->ax;
+	case 1:	return regs->dx;
+	case 2:	return regs->cx;
+	default:	return 0;
+	}
+}
+
+#elif defined(CONFIG_ARM64)
+
+#define LTTNG_KPROBE_NR_ARGS	8
+
+static inline
+unsigned long lttng_kprobe_regs_arg(struct pt_regs *regs, unsigned int n)
+{
+	return n < LTTNG_KPROBE_NR_ARGS ? regs->regs[n] : 0;
+}
+
+#elif defined(CONFIG_ARM)
+
+#define LTTNG_KPROBE_NR_ARGS	4
+
+static inline
+unsigned long lttng_kprobe_regs_arg(struct pt_regs *regs, unsigned int n)
+{
+	return n < LTTNG_KPROBE_NR_ARGS ? regs->uregs[n] : 0;
+}
+
+#else
+
+#define LTTNG_KPROBE_NR_ARGS	0
+
+static inline
+unsigned long lttng_kprobe_regs_arg(struct pt_regs *regs, unsigned int n)
+{
+	return 0;
+}
+
+#endif
+
+#ifdef CONFIG_HAVE_REGS_AND_STACK_ACCESS_API
+#define LTTNG_KPROBE_HAS_STACK	1
+
+static inline
+unsigned long lttng_kprobe_regs_stack(struct pt_regs *regs, unsigned int n)
+{
+	return regs_get_kernel_stack_nth(regs, n);
+}
+#else
+#define LTTNG_KPROBE_HAS_STACK	0
+
+static inline
+unsigned long lttng_kprobe_regs_stack(struct pt_regs *regs, unsigned int n)
+{
+	return 0;
+}
+#endif
+
+/* Filter field names of the arguments. */
+static const char *const lttng_kprobe_arg_names[] = {
+	"arg0", "arg1", "arg2", "arg3", "arg4", "arg5", "arg6", "arg7",
+};
+
+#endif /* _LTTNG_KPROBES_REGS_H */
@@ -23,10 +23,133 @@
 #include <linux/module.h>
 #include <linux/kprobes.h>
 #include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/ctype.h>
 #include "../lttng-events.h"
 #include "../wrapper/ringbuffer/frontend_types.h"
 #include "../wrapper/vmalloc.h"
+#include "../wrapper/percpu-defs.h"
 #include "../lttng-tracer.h"
+#include "lttng-probe-user.h"
+#include "lttng-kprobes-regs.h"
+
+/* Longest user string captured, including the final '\0'. */
+#define LTTNG_KPROBE_FETCH_STRING_MAX	1024
+
+struct lttng_kprobe_fetch {
+	enum lttng_kernel_kprobe_fetch_type type;
+	unsigned int index;
+	long offset;
+	unsigned int size;		/* Integer size, in bytes */
+	unsigned int is_signed:1;
+};
+
+/* Value fetched at a probe hit. */
+struct lttng_kprobe_fetch_value {
+	union {
+		uint8_t v8;
+		uint16_t v16;
+		uint32_t v32;
+		uint64_t v64;
+	} u;
+	const char __user *str;
+	size_t str_len;			/* Including the final '\0' */
+};
+
+/*
+ * Probe hit scratch space, too large for the kprobe handler stack. Kprobe
+ * handlers do not nest on a CPU: a probe hit while another one runs is
+ * counted as missed.
+ */
+struct lttng_kprobe_scratch {
+	struct lttng_kprobe_fetch_value values[LTTNG_KERNEL_KPROBE_FETCH_MAX];
+	/* ip, fetched fields, then the argument filter fields. */
+	char filter_stack[(1 + LTTNG_KERNEL_KPROBE_FETCH_MAX
+			+ LTTNG_KPROBE_NR_ARGS) * sizeof(int64_t)];
+};
+
+static DEFINE_PER_CPU(struct lttng_kprobe_scratch, lttng_kprobe_scratch);
+
+static
+size_t lttng_kprobe_fetch_align(unsigned int size)
+{
+	switch (size) {
+	case 1:
+		return lttng_alignof(uint8_t);
+	case 2:
+		return lttng_alignof(uint16_t);
+	case 4:
+		return lttng_alignof(uint32_t);
+	default:
+		return lttng_alignof(uint64_t);
+	}
+}
+
+static
+void lttng_kprobe_fetch(const struct lttng_kprobe_fetch *fetch,
+		struct pt_regs *regs, struct lttng_kprobe_fetch_value *value)
+{
+	unsigned long val;
+
+	value->u.v64 = 0;
+	switch (fetch->type) {
+	case LTTNG_KERNEL_KPROBE_FETCH_REGISTER:
+		val = lttng_kprobe_regs_arg(regs, fetch->index);
+		break;
+	case LTTNG_KERNEL_KPROBE_FETCH_STACK:
+		val = lttng_kprobe_regs_stack(regs, fetch->index);
+		break;
+	case LTTNG_KERNEL_KPROBE_FETCH_DEREF:
+		val = lttng_kprobe_regs_arg(regs, fetch->index) + fetch->offset;
+		/* A faulting address reads as 0. */
+		if (probe_kernel_read(&value->u, (void *) val, fetch->size))
+			value->u.v64 = 0;
+		return;
+	case LTTNG_KERNEL_KPROBE_FETCH_USER_STRING:
+		value->str = (const char __user *)
+			(lttng_kprobe_regs_arg(regs, fetch->index) + fetch->offset);
+		value->str_len = max_t(size_t,
+			lttng_strlen_user_inatomic((const char *) value->str), 1);
+		value->str_len = min_t(size_t, value->str_len,
+			LTTNG_KPROBE_FETCH_STRING_MAX);
+		return;
+	default:
+		return;
+	}
+	switch (fetch->size) {
+	case 1:
+		value->u.v8 = val;
+		break;
+	case 2:
+		value->u.v16 = val;
+		break;
+	case 4:
+		value->u.v32 = val;
+		break;
+	default:
+		value->u.v64 = val;
+		break;
+	}
+}
+
+static
+int64_t lttng_kprobe_fetch_s64(const struct lttng_kprobe_fetch *fetch,
+		const struct lttng_kprobe_fetch_value *value)
+{
+	switch (fetch->size) {
+	case 1:
+		return fetch->is_signed ? (int64_t) (int8_t) value->u.v8
+			: (int64_t) value->u.v8;
+	case 2:
+		return fetch->is_signed ? (int64_t) (int16_t) value->u.v16
+			: (int64_t) value->u.v16;
+	case 4:
+		return fetch->is_signed ? (int64_t) (int32_t) value->u.v32
+			: (int64_t) value->u.v32;
+	default:
+		return (int64_t) value->u.v64;
+	}
+}
 
 static
 int lttng_kprobes_handler_pre(struct kprobe *p, struct pt_regs *regs)
@@ -34,7 +157,12 @@ int lttng_kprobes_handler_pre(struct kprobe *p, struct pt_regs *regs)
 	struct lttng_event *event =
 		container_of(p, struct lttng_event, u.kprobe.kp);
 	struct lttng_channel *chan = event->chan;
+	const struct lttng_kprobe_fetch *fetch = event->u.kprobe.fetch;
+	unsigned int nr_fetch = event->u.kprobe.nr_fetch, i;
+	struct lttng_kprobe_scratch *scratch;
+	struct lttng_kprobe_fetch_value *values;
 	struct lib_ring_buffer_ctx ctx;
+	size_t event_len, event_align;
 	int ret;
 	unsigned long data = (unsigned long) p->addr;
 
@@ -44,28 +172,255 @@ int lttng_kprobes_handler_pre(struct kprobe *p, struct pt_regs *regs)
 		return 0;
 	if (unlikely(!ACCESS_ONCE(event->enabled)))
 		return 0;
+	lttng_event_count(event, hit);
+	if (!lttng_event_pid_tracked(chan->session)) {
+		lttng_event_count(event, pid_filtered);
+		return 0;
+	}
+	if (unlikely(!lttng_event_sampling_record(event)))
+		return 0;
+
+	scratch = lttng_this_cpu_ptr(&lttng_kprobe_scratch);
+	values = scratch->values;
+	for (i = 0; i < nr_fetch; i++)
+		lttng_kprobe_fetch(&fetch[i], regs, &values[i]);
+
+	if (unlikely(lttng_event_has_filter(event))) {
+		char *stack_data = scratch->filter_stack;
+		int64_t v;
+
+		v = (int64_t) data;
+		memcpy(stack_data, &v, sizeof(v));
+		stack_data += sizeof(v);
+		for (i = 0; i < nr_fetch; i++) {
+			if (fetch[i].type == LTTNG_KERNEL_KPROBE_FETCH_USER_STRING) {
+				memcpy(stack_data, &values[i].str, sizeof(void *));
+				stack_data += sizeof(void *);
+				continue;
+			}
+			v = lttng_kprobe_fetch_s64(&fetch[i], &values[i]);
+			memcpy(stack_data, &v, sizeof(v));
+			stack_data += sizeof(v);
+		}
+		for (i = 0; i < LTTNG_KPROBE_NR_ARGS; i++) {
+			v = (int64_t) lttng_kprobe_regs_arg(regs, i);
+			memcpy(stack_data, &v, sizeof(v));
+			stack_data += sizeof(v);
+		}
+		if (likely(!lttng_event_filter_record(event,
+				scratch->filter_stack))) {
+			lttng_event_count(event, filtered);
+			return 0;
+		}
+	}
+
+	event_len = sizeof(data);
+	event_align = lttng_alignof(data);
+	for (i = 0; i < nr_fetch; i++) {
+		size_t align;
+
+		if (fetch[i].type == LTTNG_KERNEL_KPROBE_FETCH_USER_STRING) {
+			event_len += values[i].str_len;
+			continue;
+		}
+		align = lttng_kprobe_fetch_align(fetch[i].size);
+		event_len += lib_ring_buffer_align(event_len, align);
+		event_len += fetch[i].size;
+		event_align = max_t(size_t, event_align, align);
+	}
 
-	lib_ring_buffer_ctx_init(&ctx, chan->chan, event, sizeof(data),
-				 lttng_alignof(data), -1);
+	lib_ring_buffer_ctx_init(&ctx, chan->chan, event, event_len,
+				 event_align, -1);
 	ret = chan->ops->event_reserve(&ctx, event->id);
-	if (ret < 0)
+	if (ret < 0) {
+		lttng_event_count(event, discarded);
 		return 0;
+	}
 	lib_ring_buffer_align_ctx(&ctx, lttng_alignof(data));
 	chan->ops->event_write(&ctx, &data, sizeof(data));
+	for (i = 0; i < nr_fetch; i++) {
+		if (fetch[i].type == LTTNG_KERNEL_KPROBE_FETCH_USER_STRING) {
+			chan->ops->event_strcpy_from_user(&ctx, values[i].str,
+				values[i].str_len);
+			continue;
+		}
+		lib_ring_buffer_align_ctx(&ctx,
+			lttng_kprobe_fetch_align(fetch[i].size));
+		chan->ops->event_write(&ctx, &values[i].u, fetch[i].size);
+	}
 	chan->ops->event_commit(&ctx);
 	return 0;
 }
 
+static
+int lttng_kprobe_fetch_name_valid(const char *name)
+{
+	const char *p;
+
+	if (!isalpha(name[0]) && name[0] != '_')
+		return 0;
+	for (p = name; *p; p++) {
+		if (!isalnum(*p) && *p != '_')
+			return 0;
+	}
+	return 1;
+}
+
+static
+int lttng_kprobe_fetch_check(const struct lttng_kernel_kprobe_fetch *ufetch)
+{
+	unsigned int i;
+
+	switch (ufetch->type) {
+	case LTTNG_KERNEL_KPROBE_FETCH_STACK:
+		if (!LTTNG_KPROBE_HAS_STACK)
+			return -EINVAL;
+		break;
+	case LTTNG_KERNEL_KPROBE_FETCH_REGISTER:
+	case LTTNG_KERNEL_KPROBE_FETCH_DEREF:
+	case LTTNG_KERNEL_KPROBE_FETCH_USER_STRING:
+		if (ufetch->index >= LTTNG_KPROBE_NR_ARGS)
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+	if (ufetch->type != LTTNG_KERNEL_KPROBE_FETCH_USER_STRING) {
+		switch (ufetch->size) {
+		case 1:
+		case 2:
+		case 4:
+		case 8:
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+	if (!lttng_kprobe_fetch_name_valid(ufetch->name))
+		return -EINVAL;
+	/* Argument filter field names are reserved on every architecture. */
+	for (i = 0; i < ARRAY_SIZE(lttng_kprobe_arg_names); i++) {
+		if (!strcmp(ufetch->name, lttng_kprobe_arg_names[i]))
+			return -EINVAL;
+	}
+	return 0;
+}
+
+static
+void lttng_kprobe_integer_field(struct lttng_event_field *field,
+		unsigned int size, int is_signed)
+{
+	field->type.atype = atype_integer;
+	field->type.u.basic.integer.size = size * CHAR_BIT;
+	field->type.u.basic.integer.alignment =
+		lttng_kprobe_fetch_align(size) * CHAR_BIT;
+	field->type.u.basic.integer.signedness = is_signed;
+	field->type.u.basic.integer.reverse_byte_order = 0;
+	field->type.u.basic.integer.base = is_signed ? 10 : 16;
+	field->type.u.basic.integer.encoding = lttng_encode_none;
+}
+
+/*
+ * Create the fetch fields of the event description, after ip, from the
+ * user-space fetch specs.
+ */
+static
+int lttng_create_kprobe_fetch(struct lttng_event *event,
+		struct lttng_event_field *fields,
+		const struct lttng_kernel_kprobe_fetch __user *ufetch,
+		unsigned int nr_fetch)
+{
+	struct lttng_kernel_kprobe_fetch *fetch_param;
+	struct lttng_kprobe_fetch *fetch;
+	unsigned int i, j;
+	int ret;
+
+	fetch_param = kcalloc(nr_fetch, sizeof(*fetch_param), GFP_KERNEL);
+	if (!fetch_param)
+		return -ENOMEM;
+	fetch = kcalloc(nr_fetch, sizeof(*fetch), GFP_KERNEL);
+	if (!fetch) {
+		ret = -ENOMEM;
+		goto error_fetch;
+	}
+	if (copy_from_user(fetch_param, ufetch,
+			nr_fetch * sizeof(*fetch_param))) {
+		ret = -EFAULT;
+		goto error_copy;
+	}
+	for (i = 0; i < nr_fetch; i++) {
+		struct lttng_kernel_kprobe_fetch *param = &fetch_param[i];
+		struct lttng_event_field *field = &fields[1 + i];
+
+		param->name[LTTNG_KERNEL_KPROBE_FETCH_NAME_LEN - 1] = '\0';
+		ret = lttng_kprobe_fetch_check(param);
+		if (ret)
+			goto error_names;
+		/* Field names must be unique. */
+		for (j = 0; j < 1 + i; j++) {
+			if (!strcmp(fields[j].name, param->name)) {
+				ret = -EINVAL;
+				goto error_names;
+			}
+		}
+		field->name = kstrdup(param->name, GFP_KERNEL);
+		if (!field->name) {
+			ret = -ENOMEM;
+			goto error_names;
+		}
+		fetch[i].type = param->type;
+		fetch[i].index = param->index;
+		fetch[i].offset = (long) param->offset;
+		fetch[i].size = param->size;
+		fetch[i].is_signed = !!param->is_signed;
+		if (param->type == LTTNG_KERNEL_KPROBE_FETCH_USER_STRING) {
+			field->type.atype = atype_string;
+			field->type.u.basic.string.encoding = lttng_encode_UTF8;
+			field->user = 1;
+		} else {
+			lttng_kprobe_integer_field(field, param->size,
+				fetch[i].is_signed);
+		}
+	}
+	kfree(fetch_param);
+	event->u.kprobe.fetch = fetch;
+	event->u.kprobe.nr_fetch = nr_fetch;
+	return 0;
+
+error_names:
+	while (i--)
+		kfree(fields[1 + i].name);
+error_copy:
+	kfree(fetch);
+error_fetch:
+	kfree(fetch_param);
+	return ret;
+}
+
+static
+void lttng_destroy_kprobe_fetch(struct lttng_event *event)
+{
+	unsigned int i;
+
+	for (i = 0; i < event->u.kprobe.nr_fetch; i++)
+		kfree(event->desc->fields[1 + i].name);
+	kfree(event->u.kprobe.fetch);
+}
+
 /*
  * Create event description
  */
 static
-int lttng_create_kprobe_event(const char *name, struct lttng_event *event)
+int lttng_create_kprobe_event(const char *name, struct lttng_event *event,
+		uint64_t ufetch, uint32_t nr_fetch)
 {
 	struct lttng_event_field *field;
 	struct lttng_event_desc *desc;
+	unsigned int i;
 	int ret;
 
+	if (nr_fetch > LTTNG_KERNEL_KPROBE_FETCH_MAX)
+		return -EINVAL;
 	desc = kzalloc(sizeof(*event->desc), GFP_KERNEL);
 	if (!desc)
 		return -ENOMEM;
@@ -74,9 +429,10 @@ int lttng_create_kprobe_event(const char *name, struct lttng_event *event)
 		ret = -ENOMEM;
 		goto error_str;
 	}
-	desc->nr_fields = 1;
+	desc->nr_fields = 1 + nr_fetch + LTTNG_KPROBE_NR_ARGS;
 	desc->fields = field =
-		kzalloc(1 * sizeof(struct lttng_event_field), GFP_KERNEL);
+		kzalloc(desc->nr_fields * sizeof(struct lttng_event_field),
+			GFP_KERNEL);
 	if (!field) {
 		ret = -ENOMEM;
 		goto error_field;
@@ -89,11 +445,28 @@ int lttng_create_kprobe_event(const char *name, struct lttng_event *event)
 	field->type.u.basic.integer.reverse_byte_order = 0;
 	field->type.u.basic.integer.base = 16;
 	field->type.u.basic.integer.encoding = lttng_encode_none;
+	if (nr_fetch) {
+		ret = lttng_create_kprobe_fetch(event, desc->fields,
+			(const struct lttng_kernel_kprobe_fetch __user *)
+				(unsigned long) ufetch,
+			nr_fetch);
+		if (ret)
+			goto error_fetch;
+	}
+	/* Arguments can be used in filters, but are not recorded. */
+	field += 1 + nr_fetch;
+	for (i = 0; i < LTTNG_KPROBE_NR_ARGS; i++, field++) {
+		field->name = lttng_kprobe_arg_names[i];
+		field->type = desc->fields[0].type;
+		field->nowrite = 1;
+	}
 	desc->owner = THIS_MODULE;
 	event->desc = desc;
 
 	return 0;
 
+error_fetch:
+	kfree(desc->fields);
 error_field:
 	kfree(desc->name);
 error_str:
@@ -105,6 +478,8 @@ int lttng_kprobes_register(const char *name,
 			   const char *symbol_name,
 			   uint64_t offset,
 			   uint64_t addr,
+			   uint64_t fetch,
+			   uint32_t nr_fetch,
 			   struct lttng_event *event)
 {
 	int ret;
@@ -113,7 +488,7 @@ int lttng_kprobes_register(const char *name,
 	if (symbol_name[0] == '\0')
 		symbol_name = NULL;
 
-	ret = lttng_create_kprobe_event(name, event);
+	ret = lttng_create_kprobe_event(name, event, fetch, nr_fetch);
 	if (ret)
 		goto error;
 	memset(&event->u.kprobe.kp, 0, sizeof(event->u.kprobe.kp));
@@ -149,6 +524,7 @@ int lttng_kprobes_register(const char *name,
 register_error:
 	kfree(event->u.kprobe.symbol_name);
 name_error:
+	lttng_destroy_kprobe_fetch(event);
 	kfree(event->desc->fields);
 	kfree(event->desc->name);
 	kfree(event->desc);
@@ -166,12 +542,19 @@ EXPORT_SYMBOL_GPL(lttng_kprobes_unregister);
 void lttng_kprobes_destroy_private(struct lttng_event *event)
 {
 	kfree(event->u.kprobe.symbol_name);
+	lttng_destroy_kprobe_fetch(event);
 	kfree(event->desc->fields);
 	kfree(event->desc->name);
 	kfree(event->desc);
 }
 EXPORT_SYMBOL_GPL(lttng_kprobes_destroy_private);
 
+uint64_t lttng_kprobes_nmissed(struct lttng_event *event)
+{
+	return ACCESS_ONCE(event->u.kprobe.kp.nmissed);
+}
+EXPORT_SYMBOL_GPL(lttng_kprobes_nmissed);
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Mathieu Desnoyers");
 MODULE_DESCRIPTION("Linux Trace Toolkit Kprobes Support");
@@ -28,6 +28,14 @@
 #include "../wrapper/ringbuffer/frontend_types.h"
 #include "../wrapper/vmalloc.h"
 #include "../lttng-tracer.h"
+#include "lttng-kprobes-regs.h"
+
+/*
+ * Default number of return instances per online CPU, and upper bound of
+ * the per-event maxactive.
+ */
+#define LTTNG_KRETPROBE_MAXACTIVE_PER_CPU	16
+#define LTTNG_KRETPROBE_MAXACTIVE_MAX		65536
 
 enum lttng_kretprobe_type {
 	EVENT_ENTRY = 0,
@@ -64,15 +72,54 @@ int _lttng_kretprobes_handler(struct kretprobe_instance *krpi,
 		return 0;
 	if (unlikely(!ACCESS_ONCE(event->enabled)))
 		return 0;
+	lttng_event_count(event, hit);
 
 	payload.ip = (unsigned long) krpi->rp->kp.addr;
 	payload.parent_ip = (unsigned long) krpi->ret_addr;
 
+	/*
+	 * Returning nonzero from the entry handler skips the return
+	 * handler of this instance: only the PID tracker and sampling,
+	 * which apply to the pair, do so.
+	 */
+	if (!lttng_event_pid_tracked(chan->session)) {
+		lttng_event_count(event, pid_filtered);
+		return type == EVENT_ENTRY;
+	}
+	/* The return event is sampled along with its entry. */
+	if (type == EVENT_ENTRY
+			&& unlikely(!lttng_event_sampling_record(event)))
+		return 1;
+	/*
+	 * Each event evaluates its own filter. An entry rejected by the
+	 * entry filter still lets the return event record.
+	 */
+	if (unlikely(lttng_event_has_filter(event))) {
+		/* ip, parent_ip, then the entry argument filter fields. */
+		int64_t filter_stack[2 + LTTNG_KPROBE_NR_ARGS];
+		unsigned int i;
+
+		filter_stack[0] = (int64_t) payload.ip;
+		filter_stack[1] = (int64_t) payload.parent_ip;
+		if (type == EVENT_ENTRY) {
+			for (i = 0; i < LTTNG_KPROBE_NR_ARGS; i++)
+				filter_stack[2 + i] =
+					(int64_t) lttng_kprobe_regs_arg(regs, i);
+		}
+		if (likely(!lttng_event_filter_record(event,
+				(const char *) filter_stack))) {
+			lttng_event_count(event, filtered);
+			return 0;
+		}
+	}
+
 	lib_ring_buffer_ctx_init(&ctx, chan->chan, event, sizeof(payload),
 				 lttng_alignof(payload), -1);
 	ret = chan->ops->event_reserve(&ctx, event->id);
-	if (ret < 0)
+	if (ret < 0) {
+		lttng_event_count(event, discarded);
 		return 0;
+	}
 	lib_ring_buffer_align_ctx(&ctx, lttng_alignof(payload));
 	chan->ops->event_write(&ctx, &payload, sizeof(payload));
 	chan->ops->event_commit(&ctx);
@@ -102,6 +149,7 @@ int lttng_create_kprobe_event(const char *name, struct lttng_event *event,
 {
 	struct lttng_event_field *fields;
 	struct lttng_event_desc *desc;
+	unsigned int i, nr_args;
 	int ret;
 	char *alloc_name;
 	size_t name_len;
@@ -128,9 +176,12 @@ int lttng_create_kprobe_event(const char *name, struct lttng_event *event,
 	strcpy(alloc_name, name);
 	strcat(alloc_name, suffix);
 	desc->name = alloc_name;
-	desc->nr_fields = 2;
+	/* Arguments are only available to the entry event filters. */
+	nr_args = (type == EVENT_ENTRY) ? LTTNG_KPROBE_NR_ARGS : 0;
+	desc->nr_fields = 2 + nr_args;
 	desc->fields = fields =
-		kzalloc(2 * sizeof(struct lttng_event_field), GFP_KERNEL);
+		kzalloc(desc->nr_fields * sizeof(struct lttng_event_field),
+			GFP_KERNEL);
 	if (!desc->fields) {
 		ret = -ENOMEM;
 		goto error_fields;
@@ -153,6 +204,13 @@ int lttng_create_kprobe_event(const char *name, struct lttng_event *event,
 	fields[1].type.u.basic.integer.base = 16;
 	fields[1].type.u.basic.integer.encoding = lttng_encode_none;
 
+	/* Arguments can be used in filters, but are not recorded. */
+	for (i = 0; i < nr_args; i++) {
+		fields[2 + i].name = lttng_kprobe_arg_names[i];
+		fields[2 + i].type = fields[0].type;
+		fields[2 + i].nowrite = 1;
+	}
+
 	desc->owner = THIS_MODULE;
 	event->desc = desc;
 
@@ -169,12 +227,19 @@ int lttng_kretprobes_register(const char *name,
 			   const char *symbol_name,
 			   uint64_t offset,
 			   uint64_t addr,
+			   uint32_t maxactive,
 			   struct lttng_event *event_entry,
 			   struct lttng_event *event_return)
 {
 	int ret;
 	struct lttng_krp *lttng_krp;
 
+	if (maxactive > LTTNG_KRETPROBE_MAXACTIVE_MAX)
+		return -EINVAL;
+	if (!maxactive)
+		maxactive = max_t(unsigned int, 64,
+			LTTNG_KRETPROBE_MAXACTIVE_PER_CPU * num_online_cpus());
+
 	/* Kprobes expects a NULL symbol name if unused */
 	if (symbol_name[0] == '\0')
 		symbol_name = NULL;
@@ -190,6 +255,7 @@ int lttng_kretprobes_register(const char *name,
 		goto krp_error;
 	lttng_krp->krp.entry_handler = lttng_kretprobes_handler_entry;
 	lttng_krp->krp.handler = lttng_kretprobes_handler_return;
+	lttng_krp->krp.maxactive = maxactive;
 	if (symbol_name) {
 		char *alloc_symbol;
 
@@ -285,6 +351,29 @@ void lttng_kretprobes_destroy_private(struct lttng_event *event)
 }
 EXPORT_SYMBOL_GPL(lttng_kretprobes_destroy_private);
 
+/*
+ * Return probes dropped for lack of a free instance, plus entries missed
+ * while another kprobe was running on the same CPU.
+ */
+uint64_t lttng_kretprobes_nmissed(struct lttng_event *event)
+{
+	struct lttng_krp *lttng_krp = event->u.kretprobe.lttng_krp;
+
+	return (uint64_t) ACCESS_ONCE(lttng_krp->krp.nmissed)
+		+ ACCESS_ONCE(lttng_krp->krp.kp.nmissed);
+}
+EXPORT_SYMBOL_GPL(lttng_kretprobes_nmissed);
+
+/*
+ * Return event of the kretprobe pair an event belongs to. Filters and
+ * counters of the return event are reached through it.
+ */
+struct lttng_event *lttng_kretprobes_return_event(struct lttng_event *event)
+{
+	return event->u.kretprobe.lttng_krp->event[EVENT_RETURN];
+}
+EXPORT_SYMBOL_GPL(lttng_kretprobes_return_event);
+
 int lttng_kretprobes_event_enable_state(struct lttng_event *event,
 		int enable)
 {
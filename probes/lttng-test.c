@@ -46,6 +46,18 @@ DEFINE_TRACE(lttng_test_filter_event);
 
 static struct proc_dir_entry *lttng_test_filter_event_dentry;
 
+/*
+ * Probed by the kprobe and kretprobe tests, once per test event. Its
+ * argument is the iteration number, and it returns it.
+ */
+noinline
+unsigned int lttng_test_probe_target(unsigned int iter)
+{
+	/* Keep the call from being optimized out. */
+	barrier();
+	return iter;
+}
+
 static
 void trace_test_event(unsigned int nr_iter)
 {
@@ -57,6 +69,7 @@ void trace_test_event(unsigned int nr_iter)
 	for (i = 0; i < nr_iter; i++) {
 		netint = htonl(i);
 		trace_lttng_test_filter_event(i, netint, values, text, strlen(text), escape);
+		(void) lttng_test_probe_target(i);
 	}
 }
 
@@ -0,0 +1,214 @@
+/*
+ * tests/exclusive-wakeup.c
+ *
+ * Measure consumer wakeups per delivered packet, with and without
+ * EPOLLEXCLUSIVE.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; only
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Requires root, and the lttng-tracer and lttng-test modules loaded.
+ * Usage: exclusive-wakeup [nr_threads]
+ *
+ * Each consumer thread has its own epoll set holding every stream of a
+ * channel, as a multi-threaded consumer daemon would. lttng-test events
+ * fill the buffers, and the threads consume whatever packet is ready.
+ * The run is done once with shared waiters, and once with
+ * EPOLLEXCLUSIVE waiters, which must get fewer wakeups per packet.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+
+#include "lttng-test-abi.h"
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE	(1U << 28)
+#endif
+
+#define NR_ROUNDS		256
+#define NR_EVENTS		1024
+#define READ_TIMER_US		1000
+#define DEFAULT_NR_THREADS	8
+
+struct stream {
+	int fd;
+	pthread_mutex_t lock;
+};
+
+static struct stream streams[LTTNG_TEST_MAX_STREAMS];
+static int nr_streams;
+static int exclusive;
+static volatile int done;
+static unsigned long nr_wakeups, nr_packets;
+static pthread_mutex_t count_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long consume(struct stream *stream)
+{
+	unsigned long packets = 0;
+
+	/* get_next/put_next are not meant for concurrent readers. */
+	pthread_mutex_lock(&stream->lock);
+	while (ioctl(stream->fd, RING_BUFFER_GET_NEXT_SUBBUF) == 0) {
+		if (ioctl(stream->fd, RING_BUFFER_PUT_NEXT_SUBBUF) < 0)
+			break;
+		packets++;
+	}
+	pthread_mutex_unlock(&stream->lock);
+	return packets;
+}
+
+static void *consumer_thread(void *arg)
+{
+	struct epoll_event ev, events[64];
+	unsigned long wakeups = 0, packets = 0;
+	int epfd, i, nr;
+
+	epfd = epoll_create1(0);
+	if (epfd < 0) {
+		perror("epoll_create1");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < nr_streams; i++) {
+		ev.events = EPOLLIN | (exclusive ? EPOLLEXCLUSIVE : 0);
+		ev.data.ptr = &streams[i];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, streams[i].fd, &ev) < 0) {
+			perror("epoll_ctl");
+			exit(EXIT_FAILURE);
+		}
+	}
+	while (!done) {
+		nr = epoll_wait(epfd, events, 64, 100);
+		if (nr <= 0)
+			continue;
+		wakeups++;
+		for (i = 0; i < nr; i++) {
+			if (events[i].events & (EPOLLHUP | EPOLLERR))
+				continue;
+			packets += consume(events[i].data.ptr);
+		}
+	}
+	close(epfd);
+	pthread_mutex_lock(&count_lock);
+	nr_wakeups += wakeups;
+	nr_packets += packets;
+	pthread_mutex_unlock(&count_lock);
+	return NULL;
+}
+
+static int run(int nr_threads, double *ratio)
+{
+	struct lttng_kernel_event ev;
+	pthread_t threads[nr_threads];
+	int stream_fds[LTTNG_TEST_MAX_STREAMS];
+	int session_fd, channel_fd, event_fd;
+	int i, round, ret = -1;
+
+	channel_fd = lttng_test_create_channel(&session_fd,
+			sysconf(_SC_PAGESIZE), 8, READ_TIMER_US);
+	if (channel_fd < 0)
+		return -1;
+	nr_streams = lttng_test_open_streams(channel_fd, stream_fds,
+			LTTNG_TEST_MAX_STREAMS);
+	if (nr_streams <= 0) {
+		fprintf(stderr, "No stream\n");
+		nr_streams = 0;
+		goto close_channel;
+	}
+	for (i = 0; i < nr_streams; i++) {
+		streams[i].fd = stream_fds[i];
+		pthread_mutex_init(&streams[i].lock, NULL);
+	}
+	memset(&ev, 0, sizeof(ev));
+	strcpy(ev.name, "lttng_test_filter_event");
+	ev.instrumentation = LTTNG_KERNEL_TRACEPOINT;
+	event_fd = lttng_test_create_event(channel_fd, &ev, 1);
+	if (event_fd < 0)
+		goto close_streams;
+
+	done = 0;
+	nr_wakeups = nr_packets = 0;
+	for (i = 0; i < nr_threads; i++)
+		pthread_create(&threads[i], NULL, consumer_thread, NULL);
+	if (ioctl(session_fd, LTTNG_KERNEL_SESSION_START) < 0) {
+		perror("LTTNG_KERNEL_SESSION_START");
+		goto join_threads;
+	}
+	for (round = 0; round < NR_ROUNDS; round++) {
+		if (lttng_test_trigger(NR_EVENTS))
+			break;
+		usleep(READ_TIMER_US);
+	}
+	ioctl(session_fd, LTTNG_KERNEL_SESSION_STOP);
+	if (round < NR_ROUNDS)
+		goto join_threads;
+	/* Let the read timer deliver the last packets. */
+	usleep(100 * READ_TIMER_US);
+	ret = 0;
+
+join_threads:
+	done = 1;
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	close(event_fd);
+close_streams:
+	for (i = 0; i < nr_streams; i++) {
+		close(streams[i].fd);
+		pthread_mutex_destroy(&streams[i].lock);
+	}
+close_channel:
+	close(channel_fd);
+	close(session_fd);
+	if (ret)
+		return ret;
+
+	if (!nr_packets) {
+		fprintf(stderr, "No packet delivered\n");
+		return -1;
+	}
+	*ratio = (double) nr_wakeups / nr_packets;
+	printf("%s: %d threads, %lu wakeups, %lu packets, %.2f wakeups/packet\n",
+		exclusive ? "exclusive" : "shared", nr_threads,
+		nr_wakeups, nr_packets, *ratio);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int nr_threads = DEFAULT_NR_THREADS;
+	double shared_ratio, exclusive_ratio;
+
+	if (argc > 1)
+		nr_threads = atoi(argv[1]);
+	if (nr_threads < 2) {
+		fprintf(stderr, "Need at least 2 consumer threads\n");
+		return EXIT_FAILURE;
+	}
+	exclusive = 0;
+	if (run(nr_threads, &shared_ratio))
+		return EXIT_FAILURE;
+	exclusive = 1;
+	if (run(nr_threads, &exclusive_ratio))
+		return EXIT_FAILURE;
+	if (exclusive_ratio >= shared_ratio) {
+		fprintf(stderr, "FAIL: exclusive waiters are not woken alone\n");
+		return EXIT_FAILURE;
+	}
+	printf("PASS\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,191 @@
+/*
+ * tests/filter-benchmark.c
+ *
+ * Compare the filter bytecode interpreter with the compiled executor.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; only
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Requires root, and the lttng-tracer and lttng-test modules loaded.
+ * Usage: filter-benchmark [nr_events]
+ *
+ * For each filter shape, lttng_test_filter_event is fired nr_events
+ * times with the filter attached, once linked while the filter_compile
+ * parameter of lttng-tracer is 0 (interpreter), and once while it is 1
+ * (compiled). Every filter rejects every event, so no event is recorded
+ * and the time per event is the probe plus filter cost. The best of
+ * NR_RUNS runs is reported.
+ */
+
+#define _GNU_SOURCE
+#include <time.h>
+
+#include "lttng-test-abi.h"
+
+#define FILTER_COMPILE_PARAM	"/sys/module/lttng_tracer/parameters/filter_compile"
+#define DEFAULT_NR_EVENTS	1000000
+#define NR_RUNS			5
+
+struct filter_shape {
+	const char *name;
+	void (*build)(struct lttng_test_bytecode *bc);
+};
+
+/* intfield == -1, the shape of pid == X */
+static void build_s64_eq(struct lttng_test_bytecode *bc)
+{
+	bc_field_ref(bc, "intfield");
+	bc_s64(bc, -1);
+	bc_op(bc, FILTER_OP_EQ);
+	bc_op(bc, FILTER_OP_RETURN);
+}
+
+/* stringfield == "foo*", the shape of comm == "foo*" */
+static void build_string_glob(struct lttng_test_bytecode *bc)
+{
+	bc_field_ref(bc, "stringfield");
+	bc_string(bc, "foo*");
+	bc_op(bc, FILTER_OP_EQ);
+	bc_op(bc, FILTER_OP_RETURN);
+}
+
+/* intfield > -1 && longfield < 0, the shape of fd > N && ret < 0 */
+static void build_s64_and(struct lttng_test_bytecode *bc)
+{
+	uint16_t and_pos;
+
+	bc_field_ref(bc, "intfield");
+	bc_s64(bc, -1);
+	bc_op(bc, FILTER_OP_GT);
+	and_pos = bc_logical(bc, FILTER_OP_AND);
+	bc_field_ref(bc, "longfield");
+	bc_s64(bc, 0);
+	bc_op(bc, FILTER_OP_LT);
+	bc_logical_target(bc, and_pos);
+	bc_op(bc, FILTER_OP_RETURN);
+}
+
+static const struct filter_shape shapes[] = {
+	{ "intfield == -1", build_s64_eq },
+	{ "stringfield == \"foo*\"", build_string_glob },
+	{ "intfield > -1 && longfield < 0", build_s64_and },
+};
+
+static int set_filter_compile(int compile)
+{
+	FILE *f;
+
+	f = fopen(FILTER_COMPILE_PARAM, "w");
+	if (!f) {
+		perror("open " FILTER_COMPILE_PARAM);
+		return -1;
+	}
+	fprintf(f, "%d\n", compile);
+	return fclose(f) ? -1 : 0;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Returns the best time per event in ns, or a negative value. */
+static double run_shape(const struct filter_shape *shape, int compile,
+		unsigned int nr_events)
+{
+	struct lttng_test_bytecode bc;
+	struct lttng_kernel_event ev;
+	int session_fd, channel_fd, event_fd, run;
+	double best = -1;
+
+	if (set_filter_compile(compile))
+		return -1;
+	channel_fd = lttng_test_create_channel(&session_fd,
+			sysconf(_SC_PAGESIZE), 4, 0);
+	if (channel_fd < 0)
+		return -1;
+	memset(&ev, 0, sizeof(ev));
+	strcpy(ev.name, "lttng_test_filter_event");
+	ev.instrumentation = LTTNG_KERNEL_TRACEPOINT;
+	event_fd = lttng_test_create_event(channel_fd, &ev, 0);
+	if (event_fd < 0)
+		goto end;
+	memset(&bc, 0, sizeof(bc));
+	shape->build(&bc);
+	if (lttng_test_attach_filter(event_fd, &bc))
+		goto end;
+	if (ioctl(event_fd, LTTNG_KERNEL_ENABLE) < 0) {
+		perror("LTTNG_KERNEL_ENABLE");
+		goto end;
+	}
+	if (ioctl(session_fd, LTTNG_KERNEL_SESSION_START) < 0) {
+		perror("LTTNG_KERNEL_SESSION_START");
+		goto end;
+	}
+	/* Warm up. */
+	if (lttng_test_trigger(nr_events / 10))
+		goto end;
+	for (run = 0; run < NR_RUNS; run++) {
+		uint64_t start = now_ns();
+		double ns;
+
+		if (lttng_test_trigger(nr_events))
+			goto end;
+		ns = (double) (now_ns() - start) / nr_events;
+		if (best < 0 || ns < best)
+			best = ns;
+	}
+end:
+	if (event_fd >= 0)
+		close(event_fd);
+	close(channel_fd);
+	close(session_fd);
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int nr_events = DEFAULT_NR_EVENTS;
+	int i, ret = EXIT_SUCCESS;
+
+	if (argc > 1)
+		nr_events = strtoul(argv[1], NULL, 10);
+	if (nr_events < 10) {
+		fprintf(stderr, "Need at least 10 events\n");
+		return EXIT_FAILURE;
+	}
+	printf("%-34s %12s %12s %8s\n", "filter", "interp ns", "compiled ns",
+		"speedup");
+	for (i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+		double interp, compiled;
+
+		interp = run_shape(&shapes[i], 0, nr_events);
+		compiled = run_shape(&shapes[i], 1, nr_events);
+		if (interp < 0 || compiled < 0) {
+			ret = EXIT_FAILURE;
+			break;
+		}
+		printf("%-34s %12.1f %12.1f %7.2fx\n", shapes[i].name,
+			interp, compiled, interp / compiled);
+	}
+	/* Restore the default. */
+	if (set_filter_compile(1))
+		ret = EXIT_FAILURE;
+	return ret;
+}
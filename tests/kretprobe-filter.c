@@ -0,0 +1,122 @@
+/*
+ * tests/kretprobe-filter.c
+ *
+ * Check that each event of a kretprobe pair evaluates its own filter.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; only
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Requires root, and the lttng-tracer and lttng-test modules loaded, on
+ * an architecture passing arguments in registers.
+ * Places a kretprobe on lttng_test_probe_target(), called by lttng-test
+ * with the iteration number as argument. The entry filter (arg0 == -1)
+ * rejects every call, while the return filter (parent_ip != 0) accepts
+ * every return: the return event must still see every hit.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "lttng-test-abi.h"
+
+#define NR_EVENTS	1000
+
+static int get_stats(int event_fd, const char *name,
+		struct lttng_kernel_event_stats *stats)
+{
+	if (ioctl(event_fd, LTTNG_KERNEL_EVENT_GET_STATS, stats) < 0) {
+		perror("LTTNG_KERNEL_EVENT_GET_STATS");
+		return -1;
+	}
+	printf("%s: hit %" PRIu64 " pid_filtered %" PRIu64
+		" filtered %" PRIu64 " discarded %" PRIu64 "\n",
+		name, stats->hit, stats->pid_filtered, stats->filtered,
+		stats->discarded);
+	return 0;
+}
+
+int main(void)
+{
+	struct lttng_kernel_event_stats entry_stats, return_stats;
+	struct lttng_test_bytecode bc;
+	struct lttng_kernel_event ev;
+	int session_fd, channel_fd, entry_fd, return_fd;
+
+	channel_fd = lttng_test_create_channel(&session_fd,
+			4 * sysconf(_SC_PAGESIZE), 4, 0);
+	if (channel_fd < 0)
+		return EXIT_FAILURE;
+	memset(&ev, 0, sizeof(ev));
+	strcpy(ev.name, "lttng_test_probe_target");
+	ev.instrumentation = LTTNG_KERNEL_KRETPROBE;
+	strcpy(ev.u.kretprobe.symbol_name, "lttng_test_probe_target");
+	entry_fd = lttng_test_create_event(channel_fd, &ev, 0);
+	if (entry_fd < 0)
+		return EXIT_FAILURE;
+	return_fd = ioctl(entry_fd, LTTNG_KERNEL_KRETPROBE_RETURN);
+	if (return_fd < 0) {
+		perror("LTTNG_KERNEL_KRETPROBE_RETURN");
+		return EXIT_FAILURE;
+	}
+
+	memset(&bc, 0, sizeof(bc));
+	bc_field_ref(&bc, "arg0");
+	bc_s64(&bc, -1);
+	bc_op(&bc, FILTER_OP_EQ);
+	bc_op(&bc, FILTER_OP_RETURN);
+	if (lttng_test_attach_filter(entry_fd, &bc))
+		return EXIT_FAILURE;
+	memset(&bc, 0, sizeof(bc));
+	bc_field_ref(&bc, "parent_ip");
+	bc_s64(&bc, 0);
+	bc_op(&bc, FILTER_OP_NE);
+	bc_op(&bc, FILTER_OP_RETURN);
+	if (lttng_test_attach_filter(return_fd, &bc))
+		return EXIT_FAILURE;
+
+	/* Enabling the entry event enables the pair. */
+	if (ioctl(entry_fd, LTTNG_KERNEL_ENABLE) < 0) {
+		perror("LTTNG_KERNEL_ENABLE");
+		return EXIT_FAILURE;
+	}
+	if (ioctl(session_fd, LTTNG_KERNEL_SESSION_START) < 0) {
+		perror("LTTNG_KERNEL_SESSION_START");
+		return EXIT_FAILURE;
+	}
+	if (lttng_test_trigger(NR_EVENTS))
+		return EXIT_FAILURE;
+	ioctl(session_fd, LTTNG_KERNEL_SESSION_STOP);
+
+	if (get_stats(entry_fd, "entry", &entry_stats)
+			|| get_stats(return_fd, "return", &return_stats))
+		return EXIT_FAILURE;
+	if (entry_stats.hit != NR_EVENTS
+			|| entry_stats.filtered != NR_EVENTS) {
+		fprintf(stderr, "FAIL: entry filter did not reject every call\n");
+		return EXIT_FAILURE;
+	}
+	if (return_stats.hit != NR_EVENTS || return_stats.filtered) {
+		fprintf(stderr, "FAIL: entry filter rejected return events\n");
+		return EXIT_FAILURE;
+	}
+	close(return_fd);
+	close(entry_fd);
+	close(channel_fd);
+	close(session_fd);
+	printf("PASS\n");
+	return EXIT_SUCCESS;
+}
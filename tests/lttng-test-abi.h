@@ -0,0 +1,267 @@
+#ifndef _LTTNG_TEST_ABI_H
+#define _LTTNG_TEST_ABI_H
+
+/*
+ * tests/lttng-test-abi.h
+ *
+ * Helpers driving the LTTng kernel ABI from user-space tests.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; only
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "../lttng-abi.h"
+#include "../filter-bytecode.h"
+
+#define LTTNG_TEST_ABI_FILE		"/proc/lttng"
+#define LTTNG_TEST_FILTER_EVENT_FILE	"/proc/lttng-test-filter-event"
+#define LTTNG_TEST_MAX_STREAMS		4096
+
+/* Ring buffer ioctls, from lib/ringbuffer/vfs.h (kernel-only header). */
+#define RING_BUFFER_GET_NEXT_SUBBUF		_IO(0xF6, 0x05)
+#define RING_BUFFER_PUT_NEXT_SUBBUF		_IO(0xF6, 0x06)
+#define RING_BUFFER_GET_PADDED_SUBBUF_SIZE	_IOR(0xF6, 0x08, unsigned long)
+#define RING_BUFFER_FLUSH			_IO(0xF6, 0x0C)
+
+struct lib_ring_buffer_page_pool_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t recycled;
+	uint64_t released;
+	uint64_t count;
+	uint64_t max;
+};
+
+#define RING_BUFFER_GET_PAGE_POOL_STATS		\
+	_IOR(0xF6, 0x0E, struct lib_ring_buffer_page_pool_stats)
+
+/*
+ * Create a session holding one discard-mode splice channel, with a read
+ * timer when read_timer_interval (usecs) is not 0. Returns the channel
+ * fd, and the session fd through session_fd, or -1.
+ */
+static inline
+int lttng_test_create_channel(int *session_fd, uint64_t subbuf_size,
+		uint64_t num_subbuf, unsigned int read_timer_interval)
+{
+	struct lttng_kernel_channel chan_param;
+	int abi_fd, sfd, cfd;
+
+	abi_fd = open(LTTNG_TEST_ABI_FILE, O_RDWR);
+	if (abi_fd < 0) {
+		perror("open " LTTNG_TEST_ABI_FILE);
+		return -1;
+	}
+	sfd = ioctl(abi_fd, LTTNG_KERNEL_SESSION);
+	close(abi_fd);
+	if (sfd < 0) {
+		perror("LTTNG_KERNEL_SESSION");
+		return -1;
+	}
+	memset(&chan_param, 0, sizeof(chan_param));
+	chan_param.subbuf_size = subbuf_size;
+	chan_param.num_subbuf = num_subbuf;
+	chan_param.read_timer_interval = read_timer_interval;
+	chan_param.output = LTTNG_KERNEL_SPLICE;
+	chan_param.overwrite = 0;
+	chan_param.backend = LTTNG_KERNEL_BUFFER_PAGE;
+	cfd = ioctl(sfd, LTTNG_KERNEL_CHANNEL, &chan_param);
+	if (cfd < 0) {
+		perror("LTTNG_KERNEL_CHANNEL");
+		close(sfd);
+		return -1;
+	}
+	*session_fd = sfd;
+	return cfd;
+}
+
+/*
+ * Open every per-CPU stream of a channel. Returns the number of streams
+ * opened, or -1 with none left open.
+ */
+static inline
+int lttng_test_open_streams(int channel_fd, int *stream_fds, int max)
+{
+	int nr = 0, fd;
+
+	while (nr < max) {
+		fd = ioctl(channel_fd, LTTNG_KERNEL_STREAM);
+		if (fd < 0) {
+			if (errno == ENOENT)
+				break;
+			perror("LTTNG_KERNEL_STREAM");
+			while (nr > 0)
+				close(stream_fds[--nr]);
+			return -1;
+		}
+		stream_fds[nr++] = fd;
+	}
+	return nr;
+}
+
+/*
+ * Create an event, enabled unless a filter still has to be attached.
+ * Returns the event fd, or -1.
+ */
+static inline
+int lttng_test_create_event(int channel_fd, struct lttng_kernel_event *ev,
+		int enable)
+{
+	int fd;
+
+	fd = ioctl(channel_fd, LTTNG_KERNEL_EVENT, ev);
+	if (fd < 0) {
+		perror("LTTNG_KERNEL_EVENT");
+		return -1;
+	}
+	if (enable && ioctl(fd, LTTNG_KERNEL_ENABLE) < 0) {
+		perror("LTTNG_KERNEL_ENABLE");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* Fire nr_iter lttng_test_filter_event from the lttng-test module. */
+static inline
+int lttng_test_trigger(unsigned int nr_iter)
+{
+	char buf[16];
+	int fd, len, ret = 0;
+
+	fd = open(LTTNG_TEST_FILTER_EVENT_FILE, O_WRONLY);
+	if (fd < 0) {
+		perror("open " LTTNG_TEST_FILTER_EVENT_FILE);
+		return -1;
+	}
+	len = snprintf(buf, sizeof(buf), "%u", nr_iter);
+	if (write(fd, buf, len) != len) {
+		perror("write " LTTNG_TEST_FILTER_EVENT_FILE);
+		ret = -1;
+	}
+	close(fd);
+	return ret;
+}
+
+/*
+ * Filter bytecode builder. Emits the same generic opcodes as the
+ * lttng-tools filter compiler, followed by the relocation table of the
+ * field references.
+ */
+#define LTTNG_TEST_BYTECODE_LEN	512
+
+struct lttng_test_bytecode {
+	char code[LTTNG_TEST_BYTECODE_LEN];
+	uint16_t code_len;
+	char reloc[LTTNG_TEST_BYTECODE_LEN];
+	uint16_t reloc_len;
+};
+
+static inline
+void bc_emit(struct lttng_test_bytecode *bc, const void *data, size_t len)
+{
+	if (bc->code_len + len > LTTNG_TEST_BYTECODE_LEN)
+		abort();
+	memcpy(&bc->code[bc->code_len], data, len);
+	bc->code_len += len;
+}
+
+static inline
+void bc_op(struct lttng_test_bytecode *bc, filter_opcode_t op)
+{
+	bc_emit(bc, &op, sizeof(op));
+}
+
+static inline
+void bc_field_ref(struct lttng_test_bytecode *bc, const char *name)
+{
+	uint16_t offset = bc->code_len, ref = 0;
+	size_t name_len = strlen(name) + 1;
+
+	if (bc->reloc_len + sizeof(offset) + name_len > LTTNG_TEST_BYTECODE_LEN)
+		abort();
+	memcpy(&bc->reloc[bc->reloc_len], &offset, sizeof(offset));
+	memcpy(&bc->reloc[bc->reloc_len + sizeof(offset)], name, name_len);
+	bc->reloc_len += sizeof(offset) + name_len;
+	bc_op(bc, FILTER_OP_LOAD_FIELD_REF);
+	bc_emit(bc, &ref, sizeof(ref));
+}
+
+static inline
+void bc_s64(struct lttng_test_bytecode *bc, int64_t v)
+{
+	bc_op(bc, FILTER_OP_LOAD_S64);
+	bc_emit(bc, &v, sizeof(v));
+}
+
+static inline
+void bc_string(struct lttng_test_bytecode *bc, const char *str)
+{
+	bc_op(bc, FILTER_OP_LOAD_STRING);
+	bc_emit(bc, str, strlen(str) + 1);
+}
+
+/* Emit an AND/OR, returning its position for bc_logical_target(). */
+static inline
+uint16_t bc_logical(struct lttng_test_bytecode *bc, filter_opcode_t op)
+{
+	uint16_t pos = bc->code_len, skip_offset = 0;
+
+	bc_op(bc, op);
+	bc_emit(bc, &skip_offset, sizeof(skip_offset));
+	return pos;
+}
+
+/* Make the logical operator at pos skip to the next instruction. */
+static inline
+void bc_logical_target(struct lttng_test_bytecode *bc, uint16_t pos)
+{
+	struct logical_op *insn = (struct logical_op *) &bc->code[pos];
+
+	insn->skip_offset = bc->code_len;
+}
+
+/* Attach the bytecode to an event or enabler fd. Returns 0, or -1. */
+static inline
+int lttng_test_attach_filter(int fd, const struct lttng_test_bytecode *bc)
+{
+	struct lttng_kernel_filter_bytecode *kbc;
+	int ret;
+
+	kbc = calloc(1, sizeof(*kbc) + bc->code_len + bc->reloc_len);
+	if (!kbc)
+		return -1;
+	kbc->len = bc->code_len + bc->reloc_len;
+	kbc->reloc_offset = bc->code_len;
+	memcpy(kbc->data, bc->code, bc->code_len);
+	memcpy(kbc->data + bc->code_len, bc->reloc, bc->reloc_len);
+	ret = ioctl(fd, LTTNG_KERNEL_FILTER, kbc);
+	if (ret < 0)
+		perror("LTTNG_KERNEL_FILTER");
+	free(kbc);
+	return ret < 0 ? -1 : 0;
+}
+
+#endif /* _LTTNG_TEST_ABI_H */
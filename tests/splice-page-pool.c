@@ -0,0 +1,149 @@
+/*
+ * tests/splice-page-pool.c
+ *
+ * Check that the splice page pool recycles the pages handed to the pipe.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; only
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Requires root, and the lttng-tracer and lttng-test modules loaded.
+ * Traces lttng_test_filter_event into a page backend splice channel, and
+ * consumes it the way the consumer daemon does (splice to a pipe, then
+ * from the pipe to /dev/null). Once the first pages come back from the
+ * pipe, later splices must be served from the pool.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "lttng-test-abi.h"
+
+#define NR_ROUNDS	32
+#define NR_EVENTS	4096
+
+static int consume_stream(int stream_fd, int pipe_fds[2], int null_fd)
+{
+	unsigned long len;
+	ssize_t ret;
+
+	while (ioctl(stream_fd, RING_BUFFER_GET_NEXT_SUBBUF) == 0) {
+		if (ioctl(stream_fd, RING_BUFFER_GET_PADDED_SUBBUF_SIZE,
+				&len) < 0) {
+			perror("RING_BUFFER_GET_PADDED_SUBBUF_SIZE");
+			return -1;
+		}
+		while (len) {
+			ret = splice(stream_fd, NULL, pipe_fds[1], NULL, len,
+				     SPLICE_F_MOVE);
+			if (ret <= 0) {
+				perror("splice from stream");
+				return -1;
+			}
+			len -= ret;
+			/* Drain the pipe so its pages are released. */
+			while (ret) {
+				ssize_t out;
+
+				out = splice(pipe_fds[0], NULL, null_fd, NULL,
+					     ret, SPLICE_F_MOVE);
+				if (out <= 0) {
+					perror("splice to /dev/null");
+					return -1;
+				}
+				ret -= out;
+			}
+		}
+		if (ioctl(stream_fd, RING_BUFFER_PUT_NEXT_SUBBUF) < 0) {
+			perror("RING_BUFFER_PUT_NEXT_SUBBUF");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int main(void)
+{
+	struct lib_ring_buffer_page_pool_stats stats, total;
+	struct lttng_kernel_event ev;
+	int session_fd, channel_fd, event_fd, null_fd;
+	int stream_fds[LTTNG_TEST_MAX_STREAMS];
+	int pipe_fds[2];
+	int nr_streams, i, round;
+
+	channel_fd = lttng_test_create_channel(&session_fd,
+			4 * sysconf(_SC_PAGESIZE), 4, 0);
+	if (channel_fd < 0)
+		return EXIT_FAILURE;
+	nr_streams = lttng_test_open_streams(channel_fd, stream_fds,
+			LTTNG_TEST_MAX_STREAMS);
+	if (nr_streams <= 0)
+		return EXIT_FAILURE;
+	memset(&ev, 0, sizeof(ev));
+	strcpy(ev.name, "lttng_test_filter_event");
+	ev.instrumentation = LTTNG_KERNEL_TRACEPOINT;
+	event_fd = lttng_test_create_event(channel_fd, &ev, 1);
+	if (event_fd < 0)
+		return EXIT_FAILURE;
+	if (ioctl(session_fd, LTTNG_KERNEL_SESSION_START) < 0) {
+		perror("LTTNG_KERNEL_SESSION_START");
+		return EXIT_FAILURE;
+	}
+	if (pipe(pipe_fds) < 0) {
+		perror("pipe");
+		return EXIT_FAILURE;
+	}
+	null_fd = open("/dev/null", O_WRONLY);
+	if (null_fd < 0) {
+		perror("open /dev/null");
+		return EXIT_FAILURE;
+	}
+
+	for (round = 0; round < NR_ROUNDS; round++) {
+		if (lttng_test_trigger(NR_EVENTS))
+			return EXIT_FAILURE;
+		for (i = 0; i < nr_streams; i++) {
+			if (ioctl(stream_fds[i], RING_BUFFER_FLUSH) < 0) {
+				perror("RING_BUFFER_FLUSH");
+				return EXIT_FAILURE;
+			}
+			if (consume_stream(stream_fds[i], pipe_fds, null_fd))
+				return EXIT_FAILURE;
+		}
+	}
+
+	memset(&total, 0, sizeof(total));
+	for (i = 0; i < nr_streams; i++) {
+		if (ioctl(stream_fds[i], RING_BUFFER_GET_PAGE_POOL_STATS,
+				&stats) < 0) {
+			perror("RING_BUFFER_GET_PAGE_POOL_STATS");
+			return EXIT_FAILURE;
+		}
+		total.hits += stats.hits;
+		total.misses += stats.misses;
+		total.recycled += stats.recycled;
+		total.released += stats.released;
+	}
+	printf("page pool: hits %" PRIu64 " misses %" PRIu64
+		" recycled %" PRIu64 " released %" PRIu64 "\n",
+		total.hits, total.misses, total.recycled, total.released);
+	if (!total.recycled || !total.hits || total.hits < total.misses) {
+		fprintf(stderr, "FAIL: splice pages are not reused\n");
+		return EXIT_FAILURE;
+	}
+	printf("PASS\n");
+	return EXIT_SUCCESS;
+}
@@ -26,6 +26,11 @@
 /*
  * Note: poll_wait_set_exclusive() is defined as no-op. Thundering herd
  * effect can be noticed with large number of consumer threads.
+ *
+ * Consumers can opt into exclusive wakeups on a stream or channel file
+ * descriptor by adding it to an epoll set with EPOLLEXCLUSIVE (Linux 4.5+).
+ * Data delivery wakes up a single exclusive waiter, whereas hangup wakes up
+ * all of them (see wake_up_interruptible_all() users).
  */
 
 #define poll_wait_set_exclusive(poll_table)
@@ -27,3 +27,201 @@
 DEFINE_PER_CPU(local_t, lttng_last_tsc);
 EXPORT_PER_CPU_SYMBOL(lttng_last_tsc);
 #endif /* #else #if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,16,0)) */
+
+#ifdef LTTNG_TRACE_CLOCK_TSC
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/smp.h>
+#include <linux/delay.h>
+#include <linux/clocksource.h>
+#include <linux/math64.h>
+#include <asm/tsc.h>
+#include <asm/cpufeature.h>
+
+static char *trace_clock = "monotonic";
+module_param(trace_clock, charp, 0444);
+MODULE_PARM_DESC(trace_clock, "Trace clock: monotonic (default) or tsc");
+
+int lttng_trace_clock_tsc __read_mostly;
+EXPORT_SYMBOL_GPL(lttng_trace_clock_tsc);
+u64 lttng_tsc_freq __read_mostly;
+EXPORT_SYMBOL_GPL(lttng_tsc_freq);
+
+/* Cycles to ns conversion, for the calibration checks only. */
+static u32 lttng_tsc_mult, lttng_tsc_shift;
+
+/* Largest spread of the TSC to monotonic clock offset across CPUs. */
+#define LTTNG_TSC_SYNC_MAX_NS		10000
+/* Largest error of tsc_khz against the monotonic clock. */
+#define LTTNG_TSC_FREQ_MAX_PPM		500
+#define LTTNG_TSC_CALIBRATE_MS		20
+#define LTTNG_TRACE_CLOCK_BENCH_LOOPS	100000
+
+struct lttng_tsc_sample {
+	u64 tsc;
+	u64 mono;
+};
+
+/* Called with interrupts off, on the CPU sampled. */
+static
+void lttng_tsc_sample(void *info)
+{
+	struct lttng_tsc_sample *sample = info;
+
+	sample->tsc = get_cycles();
+	sample->mono = ktime_get_mono_fast_ns();
+}
+
+static
+s64 lttng_tsc_offset_ns(const struct lttng_tsc_sample *sample)
+{
+	return (s64) (mul_u64_u32_shr(sample->tsc, lttng_tsc_mult,
+			lttng_tsc_shift) - sample->mono);
+}
+
+/*
+ * The offset between the TSC and the monotonic clock must be the same
+ * on all CPUs, and the TSC must tick at tsc_khz.
+ */
+static
+int lttng_tsc_calibrate(void)
+{
+	struct lttng_tsc_sample begin, end;
+	s64 offset, min_offset = 0, max_offset = 0;
+	u64 freq, error;
+	int cpu, ret = 0, first = 1;
+
+	if (!boot_cpu_has(X86_FEATURE_CONSTANT_TSC)
+			|| !boot_cpu_has(X86_FEATURE_NONSTOP_TSC)
+			|| check_tsc_unstable() || !tsc_khz)
+		return -ENODEV;
+	lttng_tsc_freq = (u64) tsc_khz * 1000;
+	clocks_calc_mult_shift(&lttng_tsc_mult, &lttng_tsc_shift,
+			lttng_tsc_freq, NSEC_PER_SEC, 600);
+
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		struct lttng_tsc_sample sample;
+
+		ret = smp_call_function_single(cpu, lttng_tsc_sample,
+				&sample, 1);
+		if (ret)
+			break;
+		offset = lttng_tsc_offset_ns(&sample);
+		if (first || offset < min_offset)
+			min_offset = offset;
+		if (first || offset > max_offset)
+			max_offset = offset;
+		first = 0;
+	}
+	put_online_cpus();
+	if (ret)
+		return ret;
+	if (max_offset - min_offset > LTTNG_TSC_SYNC_MAX_NS) {
+		printk(KERN_WARNING "LTTng: TSC offset spread across CPUs is %lld ns.\n",
+			(long long) (max_offset - min_offset));
+		return -ERANGE;
+	}
+
+	local_irq_disable();
+	lttng_tsc_sample(&begin);
+	local_irq_enable();
+	msleep(LTTNG_TSC_CALIBRATE_MS);
+	local_irq_disable();
+	lttng_tsc_sample(&end);
+	local_irq_enable();
+	freq = div64_u64((end.tsc - begin.tsc) * NSEC_PER_SEC,
+			end.mono - begin.mono);
+	error = freq > lttng_tsc_freq ? freq - lttng_tsc_freq
+			: lttng_tsc_freq - freq;
+	if (error > div_u64(lttng_tsc_freq * LTTNG_TSC_FREQ_MAX_PPM, 1000000)) {
+		printk(KERN_WARNING "LTTng: TSC measured at %llu Hz, expected %llu Hz.\n",
+			(unsigned long long) freq,
+			(unsigned long long) lttng_tsc_freq);
+		return -ERANGE;
+	}
+	return 0;
+}
+
+/*
+ * Cost of the timestamp of each event, in hundredths of ns.
+ */
+static
+void lttng_trace_clock_benchmark(void)
+{
+	u64 begin, tsc_cost, mono_cost;
+	unsigned int i;
+
+	preempt_disable();
+	begin = ktime_get_mono_fast_ns();
+	for (i = 0; i < LTTNG_TRACE_CLOCK_BENCH_LOOPS; i++)
+		(void) get_cycles();
+	tsc_cost = ktime_get_mono_fast_ns() - begin;
+	begin = ktime_get_mono_fast_ns();
+	for (i = 0; i < LTTNG_TRACE_CLOCK_BENCH_LOOPS; i++)
+		(void) trace_clock_monotonic_wrapper();
+	mono_cost = ktime_get_mono_fast_ns() - begin;
+	preempt_enable();
+	tsc_cost = div_u64(tsc_cost * 100, LTTNG_TRACE_CLOCK_BENCH_LOOPS);
+	mono_cost = div_u64(mono_cost * 100, LTTNG_TRACE_CLOCK_BENCH_LOOPS);
+	printk(KERN_INFO "LTTng: Trace clock cost per event: tsc %llu.%02llu ns, monotonic %llu.%02llu ns.\n",
+		(unsigned long long) div_u64(tsc_cost, 100),
+		(unsigned long long) (tsc_cost % 100),
+		(unsigned long long) div_u64(mono_cost, 100),
+		(unsigned long long) (mono_cost % 100));
+}
+
+/*
+ * TSC timestamps are cycles of another time base than the monotonic
+ * clock, so the TSC clock has its own uuid: the boot id with the "tsc"
+ * tag xored into its first three bytes. It stays constant for a boot,
+ * and never matches the uuid of the monotonic clock.
+ */
+int lttng_tsc_clock_uuid(char *uuid)
+{
+	static const char tag[] = "tsc";
+	int ret, i, nibble;
+
+	ret = wrapper_get_bootid(uuid);
+	if (ret)
+		return ret;
+	for (i = 0; i < 2 * (sizeof(tag) - 1); i++) {
+		nibble = hex_to_bin(uuid[i]);
+		if (nibble < 0)
+			return -EINVAL;
+		nibble ^= (i & 1) ? tag[i >> 1] & 0xF : tag[i >> 1] >> 4;
+		uuid[i] = hex_asc_lo(nibble);
+	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lttng_tsc_clock_uuid);
+
+/*
+ * Called at lttng-tracer load, before any session exists.
+ */
+int get_trace_clock(void)
+{
+	int ret;
+
+	if (!strcmp(trace_clock, "tsc")) {
+		ret = lttng_tsc_calibrate();
+		if (!ret) {
+			lttng_trace_clock_benchmark();
+			lttng_trace_clock_tsc = 1;
+			printk(KERN_WARNING "LTTng: Using invariant TSC clock at %llu Hz.\n",
+				(unsigned long long) lttng_tsc_freq);
+			return 0;
+		}
+		printk(KERN_WARNING "LTTng: TSC is not usable as trace clock (%d).\n",
+			ret);
+	} else if (strcmp(trace_clock, "monotonic")) {
+		printk(KERN_WARNING "LTTng: Unknown trace clock \"%s\".\n",
+			trace_clock);
+	}
+	printk(KERN_WARNING "LTTng: Using mainline kernel monotonic fast clock, which is NMI-safe.\n");
+	return 0;
+}
+EXPORT_SYMBOL_GPL(get_trace_clock);
+
+#endif /* LTTNG_TRACE_CLOCK_TSC */
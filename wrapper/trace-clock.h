@@ -26,6 +26,11 @@
 
 #ifdef CONFIG_HAVE_TRACE_CLOCK
 #include <linux/trace-clock.h>
+
+static inline const char *trace_clock_description(void)
+{
+	return "Architecture Trace Clock";
+}
 #else /* CONFIG_HAVE_TRACE_CLOCK */
 
 #include <linux/hardirq.h>
@@ -142,22 +147,78 @@ static inline u64 trace_clock_monotonic_wrapper(void)
 }
 #endif /* #else #if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,17,0)) */
 
+#if (defined(CONFIG_X86_TSC) && LINUX_VERSION_CODE >= KERNEL_VERSION(3,17,0))
+
+#define LTTNG_TRACE_CLOCK_TSC
+
+#include <asm/timex.h>
+
+/*
+ * Invariant TSC trace clock, selected at lttng-tracer load with its
+ * trace_clock=tsc parameter when the TSC is constant, non-stop and
+ * synchronized across CPUs. Timestamps are raw cycle counts: they are
+ * converted offline using the frequency declared in the clock metadata.
+ */
+extern int lttng_trace_clock_tsc;
+extern u64 lttng_tsc_freq;
+
+int lttng_tsc_clock_uuid(char *uuid);
+
 static inline u64 trace_clock_read64(void)
 {
+	if (lttng_trace_clock_tsc)
+		return (u64) get_cycles();
 	return (u64) trace_clock_monotonic_wrapper();
 }
 
 static inline u64 trace_clock_freq(void)
 {
+	if (lttng_trace_clock_tsc)
+		return lttng_tsc_freq;
 	return (u64) NSEC_PER_SEC;
 }
 
+static inline const char *trace_clock_description(void)
+{
+	if (lttng_trace_clock_tsc)
+		return "Invariant TSC";
+	return "Monotonic Clock";
+}
+
 static inline int trace_clock_uuid(char *uuid)
 {
+	if (lttng_trace_clock_tsc)
+		return lttng_tsc_clock_uuid(uuid);
 	return wrapper_get_bootid(uuid);
 }
 
-#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,17,0))
+#else /* #if (defined(CONFIG_X86_TSC) && LINUX_VERSION_CODE >= KERNEL_VERSION(3,17,0)) */
+
+static inline u64 trace_clock_read64(void)
+{
+	return (u64) trace_clock_monotonic_wrapper();
+}
+
+static inline u64 trace_clock_freq(void)
+{
+	return (u64) NSEC_PER_SEC;
+}
+
+static inline const char *trace_clock_description(void)
+{
+	return "Monotonic Clock";
+}
+
+static inline int trace_clock_uuid(char *uuid)
+{
+	return wrapper_get_bootid(uuid);
+}
+
+#endif /* #else #if (defined(CONFIG_X86_TSC) && LINUX_VERSION_CODE >= KERNEL_VERSION(3,17,0)) */
+
+#if defined(LTTNG_TRACE_CLOCK_TSC)
+int get_trace_clock(void);
+#elif (LINUX_VERSION_CODE >= KERNEL_VERSION(3,17,0))
 static inline int get_trace_clock(void)
 {
 	printk(KERN_WARNING "LTTng: Using mainline kernel monotonic fast clock, which is NMI-safe.\n");